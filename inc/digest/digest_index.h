@@ -0,0 +1,76 @@
+/********************************************************
+ * Description : persistent index of verified local file digests
+ * Author      : yanrk
+ * Email       : yanrkchina@163.com
+ * Version     : 1.0
+ * History     :
+ * Copyright(C): 2025
+ ********************************************************/
+
+#ifndef DIGEST_INDEX_H
+#define DIGEST_INDEX_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+struct file_identity_t
+{
+    file_identity_t();
+
+    uint64_t                file_size;
+    uint64_t                modify_time; /* 100 nanoseconds on windows, nanoseconds elsewhere */
+    uint64_t                inode;       /* file index on windows */
+};
+
+bool get_file_identity(const char * pathname, file_identity_t & file_identity);
+
+/*
+ * maps a save pathname to the digest it was last verified with, together with the size, modify time and inode the file had then,
+ * a file whose identity still matches need not be hashed again, the index file is memory mapped when it is loaded
+ */
+class DigestIndex
+{
+public:
+    DigestIndex();
+    ~DigestIndex();
+
+public:
+    bool load(const std::string & index_pathname); /* a missing index file loads as an empty index */
+    bool save();                                   /* writes the index back if it changed since load */
+    void clear();
+    size_t size();
+
+public:
+    bool find(const std::string & pathname, std::string & digest);         /* false if pathname is unknown or has changed */
+    void update(const std::string & pathname, const std::string & digest); /* records the identity pathname has now */
+    void remove(const std::string & pathname);
+
+private:
+    DigestIndex(const DigestIndex &);
+    DigestIndex & operator = (const DigestIndex &);
+
+private:
+    struct digest_entry_t
+    {
+        file_identity_t     file_identity;
+        std::string         digest;
+    };
+
+    typedef std::unordered_map<std::string, digest_entry_t> digest_entry_map_t;
+
+private:
+    bool parse(const char * data, size_t data_size);
+
+private:
+    std::string             m_index_pathname; /* empty means the index is not used */
+    digest_entry_map_t      m_entry_map;
+    bool                    m_changed;
+    std::mutex              m_mutex;
+};
+
+
+#endif // DIGEST_INDEX_H
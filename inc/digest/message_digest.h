@@ -0,0 +1,60 @@
+/********************************************************
+ * Description : incremental message digest (md5, sha1, sha256, xxh64)
+ * Author      : yanrk
+ * Email       : yanrkchina@163.com
+ * Version     : 1.0
+ * History     :
+ * Copyright(C): 2025
+ ********************************************************/
+
+#ifndef MESSAGE_DIGEST_H
+#define MESSAGE_DIGEST_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MessageDigest
+{
+public:
+    enum digest_type_t
+    {
+        digest_none,
+        digest_md5,
+        digest_sha1,
+        digest_sha256,
+        digest_xxh64
+    };
+
+public:
+    MessageDigest();
+
+public:
+    static digest_type_t get_type_by_hex_size(size_t hex_size);
+
+public:
+    bool init(digest_type_t digest_type);
+    void update(const void * data, size_t data_len);
+    std::string final(); /* lowercase hex string, the digest needs init again after it */
+    digest_type_t type() const;
+
+private:
+    void transform(const uint8_t * block);
+    void md5_transform(const uint8_t * block);
+    void sha1_transform(const uint8_t * block);
+    void sha256_transform(const uint8_t * block);
+    void xxh64_transform(const uint8_t * block);
+    size_t block_size() const;
+
+private:
+    digest_type_t           m_type;
+    uint64_t                m_total_size;
+    uint32_t                m_state[8];
+    uint64_t                m_xxh64_state[4];
+    uint8_t                 m_block[64];
+    size_t                  m_block_used;
+};
+
+
+#endif // MESSAGE_DIGEST_H
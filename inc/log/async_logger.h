@@ -0,0 +1,103 @@
+/********************************************************
+ * Description : asynchronous logger with per-thread lock-free rings
+ * Author      : yanrk
+ * Email       : yanrkchina@163.com
+ * Version     : 1.0
+ * History     :
+ * Copyright(C): 2025
+ ********************************************************/
+
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <condition_variable>
+
+/*
+ * every thread that writes gets its own ring, which only it produces into and only the flusher thread consumes from,
+ * so writing a record is a copy and a release store: no lock, no system call, no string building;
+ * while records come the flusher wakes every flush interval (or sooner when a ring is half full), merges what the rings hold by time,
+ * prefixes each record with its timestamp and writes the lot to the file in one go, and after a pass that finds nothing
+ * it sleeps until a write puts a record into an empty ring;
+ * a record that does not fit in its ring is dropped and counted, and the count is logged by the flusher;
+ * the file is opened by the first write, and once it would pass max file size it is renamed to pathname.1
+ * (pathname.1 to pathname.2 and so on, up to max file count of them) and started again;
+ * stop writes what is left and joins the flusher, a later write starts it again, call it before the destructor runs
+ * when the destructor can not join a thread (a static logger of a dll is destroyed under the loader lock)
+ */
+class AsyncLogger
+{
+public:
+    AsyncLogger(const char * pathname, size_t level = 0, size_t ring_size = 64 * 1024, uint32_t flush_interval_ms = 50, size_t max_file_size = 16 * 1024 * 1024, size_t max_file_count = 3);
+    ~AsyncLogger();
+
+public:
+    void set_level(size_t level);                                       /* records of a lower level are not wanted */
+    bool enabled(size_t level) const;                                   /* ask before formatting a record */
+    void set_rotation(size_t max_file_size, size_t max_file_count);     /* zero max file size means one file that grows */
+    void write(const char * data, size_t data_len);                     /* one record, without timestamp or trailing '\n' */
+    uint64_t dropped() const;
+    void stop();                                                        /* writes what the rings hold and stops the flusher */
+
+private:
+    AsyncLogger(const AsyncLogger &);
+    AsyncLogger & operator = (const AsyncLogger &);
+
+private:
+    struct ring_t;
+    struct thread_ring_t;
+
+private:
+    ring_t * get_ring();
+    void start();
+    void run();
+    bool rings_empty();
+    size_t drain();
+    void open_file();
+    void write_file(const char * data, size_t data_len);
+    void rotate_file();
+    const char * format_time(int64_t time_ms);
+
+private:
+    std::string                             m_name;
+    std::ofstream                           m_file;         /* flusher only, as is m_file_size */
+    uint64_t                                m_file_size;
+    std::atomic<size_t>                     m_level;
+    std::atomic<size_t>                     m_max_file_size;
+    std::atomic<size_t>                     m_max_file_count;
+    const size_t                            m_ring_size;
+    const uint32_t                          m_flush_interval_ms;
+    std::mutex                              m_rings_mutex;
+    std::vector<std::shared_ptr<ring_t>>    m_rings;
+    std::mutex                              m_start_mutex;
+    std::atomic<bool>                       m_running;      /* the flusher is started, or is being stopped */
+    std::thread                             m_flusher;
+    std::mutex                              m_wake_mutex;
+    std::condition_variable                 m_wake_condition;
+    std::atomic<bool>                       m_wake_pending;
+    std::atomic<bool>                       m_idle;         /* the flusher sleeps until a record comes */
+    std::atomic<bool>                       m_stopping;
+    std::atomic<uint64_t>                   m_dropped;
+    uint64_t                                m_dropped_reported;
+    std::vector<char>                       m_records;      /* flusher only: the records of one pass */
+    std::string                             m_output;       /* flusher only: the lines of one pass */
+    int64_t                                 m_time_second;  /* flusher only: the second m_time_text was made for */
+    char                                    m_time_text[32];
+};
+
+inline bool AsyncLogger::enabled(size_t level) const
+{
+    return (level >= m_level.load(std::memory_order_relaxed));
+}
+
+
+#endif // ASYNC_LOGGER_H
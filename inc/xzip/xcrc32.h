@@ -0,0 +1,46 @@
+// XCrc32.h
+//
+// CRC-32 (the zip/zlib polynomial) shared by XZip and XUnzip.
+//
+// The portable path is slicing-by-8: eight 256-entry tables let the loop
+// consume eight bytes per step instead of one. Where the processor has
+// carry-less multiply (x86 PCLMULQDQ) or the ARMv8 CRC32 instructions, a
+// hardware kernel is picked once at run time and the tables only handle
+// what is left over at the tail.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef XCRC32_H
+#define XCRC32_H
+
+
+#include <stddef.h>
+
+
+// xcrc32()
+//
+// Purpose:     Update a running CRC-32 with len bytes of buf
+//
+// Parameters:  crc     - running CRC-32, 0 to start a new one
+//              buf     - data, or NULL to get the initial value
+//              len     - number of bytes in buf
+//
+// Returns:     the updated CRC-32, same value as zlib's crc32()
+//
+unsigned long xcrc32(unsigned long crc, const unsigned char *buf, size_t len);
+
+// xcrc32_portable()
+//
+// Purpose:     Same as xcrc32(), but always uses the slicing-by-8 tables
+//
+unsigned long xcrc32_portable(unsigned long crc, const unsigned char *buf, size_t len);
+
+// xcrc32_engine()
+//
+// Purpose:     Name the kernel xcrc32() dispatches to on this processor:
+//              "pclmul", "armv8-crc" or "slice-by-8"
+//
+const char *xcrc32_engine();
+
+
+#endif // XCRC32_H
@@ -87,7 +87,23 @@
 #define XUNZIP_H
 
 
-#ifdef _MSC_VER
+#include "xzip/xzip_port.h"
+
+
+// XUNZIP_FAST_INFLATE selects the inflate backend at build time: 1 (the
+// default) decodes with a 64-bit bit buffer and wide match copies, 0 keeps
+// the original zlib 1.1.3 inner loop. Both read the same streams.
+#ifndef XUNZIP_FAST_INFLATE
+#define XUNZIP_FAST_INFLATE 1
+#endif
+
+// XUNZIP_MMAP_FILES: with 1 (the default) a zip opened with ZIP_FILENAME is
+// memory mapped whole, headers are parsed in place and entries are inflated
+// straight from the mapping; 0 reads it through the file handle instead.
+// The file must not be truncated while it is open.
+#ifndef XUNZIP_MMAP_FILES
+#define XUNZIP_MMAP_FILES 1
+#endif
 
 
 #ifndef XZIP_H
@@ -106,8 +122,8 @@ typedef struct
   char name[MAX_PATH];       // filename within the zip
   DWORD attr;                // attributes, as in GetFileAttributes.
   FILETIME atime,ctime,mtime;// access, create, modify filetimes
-  long comp_size;            // sizes of item, compressed and uncompressed. These
-  long unc_size;             // may be -1 if not yet known (e.g. being streamed in)
+  long long comp_size;       // sizes of item, compressed and uncompressed. These
+  long long unc_size;        // may be -1 if not yet known (e.g. being streamed in)
 } ZIPENTRY;
 
 typedef struct
@@ -115,8 +131,8 @@ typedef struct
   TCHAR name[MAX_PATH];      // filename within the zip
   DWORD attr;                // attributes, as in GetFileAttributes.
   FILETIME atime,ctime,mtime;// access, create, modify filetimes
-  long comp_size;            // sizes of item, compressed and uncompressed. These
-  long unc_size;             // may be -1 if not yet known (e.g. being streamed in)
+  long long comp_size;       // sizes of item, compressed and uncompressed. These
+  long long unc_size;        // may be -1 if not yet known (e.g. being streamed in)
 } ZIPENTRYW;
 
 
@@ -213,7 +229,9 @@ ZRESULT FindZipItemW(HZIP hz, const TCHAR *name, bool ic, int *index, ZIPENTRYW
 // FindZipItem - finds an item by name. ic means 'insensitive to case'.
 // It returns the index of the item, and returns information about it.
 // If nothing was found, then index is set to -1 and the function returns
-// an error code.
+// an error code. The first call reads every name in the central directory
+// into a hash index; later calls (and clones made after it) look names up
+// there. If a name occurs twice, the first of the two items is found.
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -251,6 +269,32 @@ ZRESULT UnzipItem(HZIP hz, int index, void *dst, unsigned int len, DWORD flags);
 // and it emits 0 bytes.
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// UnzipItems()
+//
+// Purpose:     Find items by name and unzip them to files
+//
+// Parameters:  hz      - handle of open zip archive
+//              names   - names of the items to unzip
+//              count   - number of names
+//              ic      - TRUE = case insensitive
+//              dir     - directory to unzip into, or NULL for the current
+//                        directory
+//              results - receives the ZRESULT of each name, or NULL
+//
+// Returns:     ZRESULT - ZR_OK if every item was found and unzipped,
+//                        otherwise the first other value in results
+//
+ZRESULT UnzipItems(HZIP hz, const TCHAR *const *names, int count, bool ic, const TCHAR *dir, ZRESULT *results);
+// UnzipItems - unzips each named item to dir/ze.name, as UnzipItem does
+// with ZIP_FILENAME. The items are unzipped in the order they are stored in,
+// whatever the order of names, so the archive is read through just once;
+// a name that is not found gets ZR_NOTFOUND. Like FindZipItem, the first
+// lookup by name indexes the whole central directory, after which each
+// name is found at once instead of by walking the directory.
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // CloseZip()
@@ -264,6 +308,68 @@ ZRESULT UnzipItem(HZIP hz, int index, void *dst, unsigned int len, DWORD flags);
 ZRESULT CloseZip(HZIP hz);
 // CloseZip - the zip handle must be closed with this function.
 
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// CloneZip()
+//
+// Purpose:     Open a zip archive once more, to unzip it on another thread
+//
+// Parameters:  hz      - handle to an open zip archive
+//
+// Returns:     HZIP    - non-zero if success, otherwise 0
+//
+HZIP CloneZip(HZIP hz);
+// CloneZip - the clone reads the archive through a cursor of its own, but
+// starts with all that hz has learned of the central directory: an item
+// that hz has reached with GetZipItem is reached by the clone at once,
+// without walking the directory again. One handle may only be used by one
+// thread at a time, so hz must not be in use while it is cloned. Only zips
+// opened from a file name or from memory can be cloned. Close each clone
+// with CloseZip.
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// OpenZipStream()
+//
+// Purpose:     Start extracting an archive whose bytes arrive in order,
+//              e.g. while it is still being downloaded
+//
+// Parameters:  dir     - directory the entries are extracted into, it must
+//                        end with a slash
+//
+// Returns:     HZIPSTREAM - non-zero if success, otherwise 0
+//
+DECLARE_HANDLE(HZIPSTREAM);
+HZIPSTREAM OpenZipStream(const char *dir);
+// OpenZipStream - entries are found through their local headers rather
+// than the central directory, so nothing needs to seek: each one is
+// inflated and written out as its bytes are passed to WriteZipStream, and
+// the central directory, which comes last, is only checked by EndZipStream.
+// Entries that can't be found without the central directory (zip64, or a
+// stored entry followed by a data descriptor) fail with ZR_SEEK, and the
+// archive should then be unzipped from its file with OpenZip instead.
+
+ZRESULT WriteZipStream(HZIPSTREAM hs, const void *data, unsigned int len);
+// WriteZipStream - passes the next len bytes of the archive, in any sized
+// pieces. Once it has failed, every later call returns ZR_FAILED.
+
+ZRESULT EndZipStream(HZIPSTREAM hs);
+// EndZipStream - call this after the last byte. It returns ZR_OK only if
+// the archive ended with a central directory that lists exactly the
+// entries that were extracted, with the same names, crcs and sizes.
+
+ZRESULT GetZipStreamItem(HZIPSTREAM hs, int index, ZIPENTRY *ze);
+// GetZipStreamItem - information about an entry extracted so far, including
+// the one being extracted. Index -1 returns the number of them in ze.index.
+// An entry written out only partly, because the stream failed, is listed
+// too, so that the caller can remove it.
+
+ZRESULT CloseZipStream(HZIPSTREAM hs);
+// CloseZipStream - the stream handle must be closed with this function. It
+// leaves the extracted files where they are.
+
 unsigned int FormatZipMessage(ZRESULT code, char *buf,unsigned int len);
 // FormatZipMessage - given an error code, formats it as a string.
 // It returns the length of the error message. If buf/len points
@@ -382,7 +488,4 @@ bool IsZipHandleU(HZIP hz);
 #endif
 
 
-#endif // _MSC_VER
-
-
 #endif //XUNZIP_H
@@ -108,6 +108,9 @@ typedef DWORD ZRESULT;		// result codes from any of the zip functions. Listed la
 #define ZIP_MEMORY   3
 #define ZIP_FOLDER   4
 
+// for ZipAddLevel: use the level set by ZipSetDeflate
+#define ZIP_LEVEL_DEFAULT (-1)
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -181,6 +184,51 @@ ZRESULT ZipAdd(HZIP hz, const TCHAR *dstzn, void *src, unsigned int len, DWORD f
 // function. This will let the zipfile store the items size ahead of the
 // compressed item itself, which in turn makes it easier when unzipping the
 // zipfile into a pipe.
+// Note: an item whose size is known (a file, memory, or a pipe given a len)
+// is stored rather than deflated if its first 64k look already compressed,
+// as images, installers and nested zips do; so are names ending .zip, .gz etc.
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZipAddLevel()
+//
+// Purpose:     Add a file to a zip archive, choosing how hard to compress it
+//
+// Parameters:  hz, dstzn, src, len, flags - as for ZipAdd
+//              level   - 0 to store the item, 1 (fastest) to 9 (smallest),
+//                        or ZIP_LEVEL_DEFAULT for the level of ZipSetDeflate
+//
+// Returns:     ZRESULT - ZR_OK if success, otherwise some other value
+//
+ZRESULT ZipAddLevel(HZIP hz, const TCHAR *dstzn, void *src, unsigned int len, DWORD flags, int level);
+// ZipAddLevel - ZipAdd(hz,dstzn,src,len,flags) is
+// ZipAddLevel(hz,dstzn,src,len,flags,ZIP_LEVEL_DEFAULT).
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// ZipSetDeflate()
+//
+// Purpose:     Choose how the items added from now on are deflated
+//
+// Parameters:  hz           - handle to an open zip archive
+//              level        - 1 (fastest) to 9 (smallest);  the default is 8
+//              thread_count - number of threads to deflate on;  0 for one
+//                             per processor, 1 (the default) to deflate on
+//                             the thread that calls ZipAdd
+//
+// Returns:     ZRESULT - ZR_OK if success, otherwise some other value
+//
+ZRESULT ZipSetDeflate(HZIP hz, int level, unsigned int thread_count);
+// ZipSetDeflate - with more than one thread, an item larger than 256k is
+// cut into 128k blocks that are deflated at the same time and joined into
+// one deflate stream, and smaller items are deflated several at a time:
+// ZipAdd reads such an item and returns, and it is written to the zip once
+// the items added before it have been. So a failure to deflate or write
+// it is returned by a later ZipAdd, ZipGetMemory or CloseZip. The zip is
+// an ordinary one either way; each block is primed with the 32k in front
+// of it, as deflate's window is, so it comes out only slightly larger.
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,63 @@
+// XZipPort.h
+//
+// Stand-ins for the few Windows types and macros that the XZip/XUnzip
+// interface uses, so that the same interface builds on POSIX systems.
+// On POSIX a ZIP_HANDLE is a file descriptor cast to a HANDLE.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef XZIP_PORT_H
+#define XZIP_PORT_H
+
+
+#ifndef _MSC_VER
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t  BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int      BOOL;
+typedef char     TCHAR;
+typedef void *   HANDLE;
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef MAX_PATH
+#define MAX_PATH 1024
+#endif
+
+typedef struct
+{ DWORD dwLowDateTime;       // 100 nanoseconds since 1601-01-01 UTC, as on Windows
+  DWORD dwHighDateTime;
+} FILETIME;
+
+#define DECLARE_HANDLE(name) struct name##__ { int unused; }; typedef struct name##__ *name
+
+#define FILE_ATTRIBUTE_READONLY  0x00000001
+#define FILE_ATTRIBUTE_HIDDEN    0x00000002
+#define FILE_ATTRIBUTE_SYSTEM    0x00000004
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_ARCHIVE   0x00000020
+#define FILE_ATTRIBUTE_NORMAL    0x00000080
+
+#define _T(x)    x
+#define _tcslen  strlen
+#define _tcscpy  strcpy
+#define _tcsncpy strncpy
+#define _tcscat  strcat
+#define _tcsstr  strstr
+
+
+#endif // !_MSC_VER
+
+
+#endif // XZIP_PORT_H
@@ -0,0 +1,333 @@
+/********************************************************
+ * Description : persistent index of verified local file digests
+ * Author      : yanrk
+ * Email       : yanrkchina@163.com
+ * Version     : 1.0
+ * History     :
+ * Copyright(C): 2025
+ ********************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _MSC_VER
+#include "digest/digest_index.h"
+
+/*
+ * index file layout, native byte order:
+ *     header: magic (4 bytes), version (4 bytes), entry count (8 bytes)
+ *     entry : file size (8 bytes), modify time (8 bytes), inode (8 bytes), pathname size (4 bytes), digest size (4 bytes), pathname, digest
+ */
+static const uint32_t DIGEST_INDEX_MAGIC = 0x58444348; /* "HCDX" */
+static const uint32_t DIGEST_INDEX_VERSION = 1;
+static const size_t DIGEST_INDEX_HEADER_SIZE = 16;
+static const size_t DIGEST_INDEX_ENTRY_HEAD_SIZE = 32;
+
+file_identity_t::file_identity_t()
+    : file_size(0)
+    , modify_time(0)
+    , inode(0)
+{
+
+}
+
+static bool operator == (const file_identity_t & lhs, const file_identity_t & rhs)
+{
+    return lhs.file_size == rhs.file_size && lhs.modify_time == rhs.modify_time && lhs.inode == rhs.inode;
+}
+
+bool get_file_identity(const char * pathname, file_identity_t & file_identity)
+{
+#ifdef _MSC_VER
+    HANDLE file = CreateFileA(pathname, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION file_information;
+    const bool ret = (FALSE != GetFileInformationByHandle(file, &file_information));
+    CloseHandle(file);
+    if (!ret || 0 != (file_information.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return false;
+    }
+    file_identity.file_size = (static_cast<uint64_t>(file_information.nFileSizeHigh) << 32) | file_information.nFileSizeLow;
+    file_identity.modify_time = (static_cast<uint64_t>(file_information.ftLastWriteTime.dwHighDateTime) << 32) | file_information.ftLastWriteTime.dwLowDateTime;
+    file_identity.inode = (static_cast<uint64_t>(file_information.nFileIndexHigh) << 32) | file_information.nFileIndexLow;
+#else
+    struct stat file_stat;
+    if (0 != stat(pathname, &file_stat) || !S_ISREG(file_stat.st_mode))
+    {
+        return false;
+    }
+    file_identity.file_size = static_cast<uint64_t>(file_stat.st_size);
+#ifdef __APPLE__
+    file_identity.modify_time = static_cast<uint64_t>(file_stat.st_mtimespec.tv_sec) * 1000000000ULL + static_cast<uint64_t>(file_stat.st_mtimespec.tv_nsec);
+#else
+    file_identity.modify_time = static_cast<uint64_t>(file_stat.st_mtim.tv_sec) * 1000000000ULL + static_cast<uint64_t>(file_stat.st_mtim.tv_nsec);
+#endif // __APPLE__
+    file_identity.inode = static_cast<uint64_t>(file_stat.st_ino);
+#endif // _MSC_VER
+    return true;
+}
+
+DigestIndex::DigestIndex()
+    : m_index_pathname()
+    , m_entry_map()
+    , m_changed(false)
+    , m_mutex()
+{
+
+}
+
+DigestIndex::~DigestIndex()
+{
+    clear();
+}
+
+bool DigestIndex::parse(const char * data, size_t data_size)
+{
+    if (data_size < DIGEST_INDEX_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t entry_count = 0;
+    memcpy(&magic, data, 4);
+    memcpy(&version, data + 4, 4);
+    memcpy(&entry_count, data + 8, 8);
+    if (DIGEST_INDEX_MAGIC != magic || DIGEST_INDEX_VERSION != version)
+    {
+        return false;
+    }
+
+    m_entry_map.reserve(static_cast<size_t>(entry_count < data_size / DIGEST_INDEX_ENTRY_HEAD_SIZE ? entry_count : data_size / DIGEST_INDEX_ENTRY_HEAD_SIZE));
+
+    size_t offset = DIGEST_INDEX_HEADER_SIZE;
+    for (uint64_t index = 0; index < entry_count; ++index)
+    {
+        if (data_size - offset < DIGEST_INDEX_ENTRY_HEAD_SIZE)
+        {
+            return false;
+        }
+        digest_entry_t digest_entry;
+        uint32_t pathname_size = 0;
+        uint32_t digest_size = 0;
+        memcpy(&digest_entry.file_identity.file_size, data + offset, 8);
+        memcpy(&digest_entry.file_identity.modify_time, data + offset + 8, 8);
+        memcpy(&digest_entry.file_identity.inode, data + offset + 16, 8);
+        memcpy(&pathname_size, data + offset + 24, 4);
+        memcpy(&digest_size, data + offset + 28, 4);
+        offset += DIGEST_INDEX_ENTRY_HEAD_SIZE;
+        if (data_size - offset < static_cast<size_t>(pathname_size) + static_cast<size_t>(digest_size))
+        {
+            return false;
+        }
+        digest_entry.digest.assign(data + offset + pathname_size, digest_size);
+        m_entry_map[std::string(data + offset, pathname_size)] = digest_entry;
+        offset += pathname_size + digest_size;
+    }
+
+    return true;
+}
+
+bool DigestIndex::load(const std::string & index_pathname)
+{
+    clear();
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_index_pathname = index_pathname;
+    if (m_index_pathname.empty())
+    {
+        return false;
+    }
+
+    bool ret = true;
+
+#ifdef _MSC_VER
+    HANDLE file = CreateFileA(m_index_pathname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return true;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        ret = false;
+    }
+    else if (file_size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const char * data = (nullptr == mapping ? nullptr : reinterpret_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)));
+        ret = (nullptr != data && parse(data, static_cast<size_t>(file_size.QuadPart)));
+        if (nullptr != data)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (nullptr != mapping)
+        {
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+#else
+    const int file = open(m_index_pathname.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        return true;
+    }
+    struct stat file_stat;
+    if (0 != fstat(file, &file_stat))
+    {
+        ret = false;
+    }
+    else if (file_stat.st_size > 0)
+    {
+        void * data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        ret = (MAP_FAILED != data && parse(reinterpret_cast<const char *>(data), static_cast<size_t>(file_stat.st_size)));
+        if (MAP_FAILED != data)
+        {
+            munmap(data, static_cast<size_t>(file_stat.st_size));
+        }
+    }
+    close(file);
+#endif // _MSC_VER
+
+    if (!ret)
+    {
+        m_entry_map.clear(); /* a broken index is rebuilt from scratch */
+        m_changed = true;
+    }
+
+    return ret;
+}
+
+bool DigestIndex::save()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_index_pathname.empty() || !m_changed)
+    {
+        return true;
+    }
+
+    const std::string temp_index_pathname(m_index_pathname + ".temp");
+    std::ofstream ofs(temp_index_pathname.c_str(), std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+    {
+        return false;
+    }
+
+    const uint64_t entry_count = m_entry_map.size();
+    ofs.write(reinterpret_cast<const char *>(&DIGEST_INDEX_MAGIC), 4);
+    ofs.write(reinterpret_cast<const char *>(&DIGEST_INDEX_VERSION), 4);
+    ofs.write(reinterpret_cast<const char *>(&entry_count), 8);
+
+    for (digest_entry_map_t::const_iterator iter = m_entry_map.begin(); m_entry_map.end() != iter; ++iter)
+    {
+        const uint32_t pathname_size = static_cast<uint32_t>(iter->first.size());
+        const uint32_t digest_size = static_cast<uint32_t>(iter->second.digest.size());
+        ofs.write(reinterpret_cast<const char *>(&iter->second.file_identity.file_size), 8);
+        ofs.write(reinterpret_cast<const char *>(&iter->second.file_identity.modify_time), 8);
+        ofs.write(reinterpret_cast<const char *>(&iter->second.file_identity.inode), 8);
+        ofs.write(reinterpret_cast<const char *>(&pathname_size), 4);
+        ofs.write(reinterpret_cast<const char *>(&digest_size), 4);
+        ofs.write(iter->first.data(), pathname_size);
+        ofs.write(iter->second.digest.data(), digest_size);
+    }
+
+    ofs.close();
+    if (ofs.fail())
+    {
+        std::remove(temp_index_pathname.c_str());
+        return false;
+    }
+
+    std::remove(m_index_pathname.c_str());
+    if (0 != std::rename(temp_index_pathname.c_str(), m_index_pathname.c_str()))
+    {
+        return false;
+    }
+
+    m_changed = false;
+
+    return true;
+}
+
+void DigestIndex::clear()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_index_pathname.clear();
+    m_entry_map.clear();
+    m_changed = false;
+}
+
+size_t DigestIndex::size()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_entry_map.size();
+}
+
+bool DigestIndex::find(const std::string & pathname, std::string & digest)
+{
+    file_identity_t file_identity;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_index_pathname.empty())
+        {
+            return false;
+        }
+        digest_entry_map_t::const_iterator iter = m_entry_map.find(pathname);
+        if (m_entry_map.end() == iter)
+        {
+            return false;
+        }
+        file_identity = iter->second.file_identity;
+        digest = iter->second.digest;
+    }
+
+    file_identity_t current_identity;
+    return get_file_identity(pathname.c_str(), current_identity) && current_identity == file_identity;
+}
+
+void DigestIndex::update(const std::string & pathname, const std::string & digest)
+{
+    digest_entry_t digest_entry;
+    const bool file_exists = get_file_identity(pathname.c_str(), digest_entry.file_identity);
+    digest_entry.digest = digest;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_index_pathname.empty())
+    {
+        return;
+    }
+    if (file_exists)
+    {
+        m_entry_map[pathname] = digest_entry;
+        m_changed = true;
+    }
+    else if (0 != m_entry_map.erase(pathname))
+    {
+        m_changed = true;
+    }
+}
+
+void DigestIndex::remove(const std::string & pathname)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (0 != m_entry_map.erase(pathname))
+    {
+        m_changed = true;
+    }
+}
@@ -0,0 +1,553 @@
+/********************************************************
+ * Description : incremental message digest (md5, sha1, sha256, xxh64)
+ * Author      : yanrk
+ * Email       : yanrkchina@163.com
+ * Version     : 1.0
+ * History     :
+ * Copyright(C): 2025
+ ********************************************************/
+
+#include <cstring>
+#include "digest/message_digest.h"
+
+static inline uint32_t rotate_left_32(uint32_t value, unsigned int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static inline uint32_t rotate_right_32(uint32_t value, unsigned int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static inline uint64_t rotate_left_64(uint64_t value, unsigned int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint32_t read_le_32(const uint8_t * data)
+{
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static inline uint64_t read_le_64(const uint8_t * data)
+{
+    return static_cast<uint64_t>(read_le_32(data)) | (static_cast<uint64_t>(read_le_32(data + 4)) << 32);
+}
+
+static inline uint32_t read_be_32(const uint8_t * data)
+{
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+static void append_hex(std::string & hex, const uint8_t * data, size_t data_len)
+{
+    static const char s_hex_digits[] = "0123456789abcdef";
+    for (size_t index = 0; index < data_len; ++index)
+    {
+        hex.push_back(s_hex_digits[data[index] >> 4]);
+        hex.push_back(s_hex_digits[data[index] & 0x0F]);
+    }
+}
+
+static const uint64_t XXH64_PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH64_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH64_PRIME_3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH64_PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH64_PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t xxh64_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * XXH64_PRIME_2;
+    accumulator = rotate_left_64(accumulator, 31);
+    return accumulator * XXH64_PRIME_1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= xxh64_round(0, value);
+    return accumulator * XXH64_PRIME_1 + XXH64_PRIME_4;
+}
+
+MessageDigest::MessageDigest()
+    : m_type(digest_none)
+    , m_total_size(0)
+    , m_state()
+    , m_xxh64_state()
+    , m_block()
+    , m_block_used(0)
+{
+
+}
+
+MessageDigest::digest_type_t MessageDigest::get_type_by_hex_size(size_t hex_size)
+{
+    switch (hex_size)
+    {
+        case 16:
+        {
+            return digest_xxh64;
+        }
+        case 32:
+        {
+            return digest_md5;
+        }
+        case 40:
+        {
+            return digest_sha1;
+        }
+        case 64:
+        {
+            return digest_sha256;
+        }
+        default:
+        {
+            return digest_none;
+        }
+    }
+}
+
+bool MessageDigest::init(digest_type_t digest_type)
+{
+    m_type = digest_type;
+    m_total_size = 0;
+    m_block_used = 0;
+
+    switch (m_type)
+    {
+        case digest_md5:
+        {
+            m_state[0] = 0x67452301;
+            m_state[1] = 0xEFCDAB89;
+            m_state[2] = 0x98BADCFE;
+            m_state[3] = 0x10325476;
+            return true;
+        }
+        case digest_sha1:
+        {
+            m_state[0] = 0x67452301;
+            m_state[1] = 0xEFCDAB89;
+            m_state[2] = 0x98BADCFE;
+            m_state[3] = 0x10325476;
+            m_state[4] = 0xC3D2E1F0;
+            return true;
+        }
+        case digest_sha256:
+        {
+            m_state[0] = 0x6A09E667;
+            m_state[1] = 0xBB67AE85;
+            m_state[2] = 0x3C6EF372;
+            m_state[3] = 0xA54FF53A;
+            m_state[4] = 0x510E527F;
+            m_state[5] = 0x9B05688C;
+            m_state[6] = 0x1F83D9AB;
+            m_state[7] = 0x5BE0CD19;
+            return true;
+        }
+        case digest_xxh64:
+        {
+            /* seed is zero */
+            m_xxh64_state[0] = XXH64_PRIME_1 + XXH64_PRIME_2;
+            m_xxh64_state[1] = XXH64_PRIME_2;
+            m_xxh64_state[2] = 0;
+            m_xxh64_state[3] = 0 - XXH64_PRIME_1;
+            return true;
+        }
+        default:
+        {
+            m_type = digest_none;
+            return false;
+        }
+    }
+}
+
+MessageDigest::digest_type_t MessageDigest::type() const
+{
+    return m_type;
+}
+
+size_t MessageDigest::block_size() const
+{
+    return (digest_xxh64 == m_type ? 32 : 64);
+}
+
+void MessageDigest::transform(const uint8_t * block)
+{
+    switch (m_type)
+    {
+        case digest_md5:
+        {
+            md5_transform(block);
+            break;
+        }
+        case digest_sha1:
+        {
+            sha1_transform(block);
+            break;
+        }
+        case digest_sha256:
+        {
+            sha256_transform(block);
+            break;
+        }
+        case digest_xxh64:
+        {
+            xxh64_transform(block);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+void MessageDigest::update(const void * data, size_t data_len)
+{
+    if (digest_none == m_type || nullptr == data)
+    {
+        return;
+    }
+
+    const uint8_t * input = reinterpret_cast<const uint8_t *>(data);
+    const size_t digest_block_size = block_size();
+
+    m_total_size += data_len;
+
+    if (m_block_used > 0)
+    {
+        const size_t copy_len = (digest_block_size - m_block_used < data_len ? digest_block_size - m_block_used : data_len);
+        memcpy(m_block + m_block_used, input, copy_len);
+        m_block_used += copy_len;
+        input += copy_len;
+        data_len -= copy_len;
+        if (m_block_used < digest_block_size)
+        {
+            return;
+        }
+        transform(m_block);
+        m_block_used = 0;
+    }
+
+    while (data_len >= digest_block_size)
+    {
+        transform(input);
+        input += digest_block_size;
+        data_len -= digest_block_size;
+    }
+
+    if (data_len > 0)
+    {
+        memcpy(m_block, input, data_len);
+        m_block_used = data_len;
+    }
+}
+
+std::string MessageDigest::final()
+{
+    std::string hex;
+
+    if (digest_none == m_type)
+    {
+        return hex;
+    }
+
+    if (digest_xxh64 == m_type)
+    {
+        uint64_t hash = 0;
+        if (m_total_size >= 32)
+        {
+            hash = rotate_left_64(m_xxh64_state[0], 1) + rotate_left_64(m_xxh64_state[1], 7) + rotate_left_64(m_xxh64_state[2], 12) + rotate_left_64(m_xxh64_state[3], 18);
+            for (size_t index = 0; index < 4; ++index)
+            {
+                hash = xxh64_merge_round(hash, m_xxh64_state[index]);
+            }
+        }
+        else
+        {
+            hash = m_xxh64_state[2] + XXH64_PRIME_5;
+        }
+        hash += m_total_size;
+
+        const uint8_t * tail = m_block;
+        const uint8_t * tail_end = m_block + m_block_used;
+        while (tail + 8 <= tail_end)
+        {
+            hash ^= xxh64_round(0, read_le_64(tail));
+            hash = rotate_left_64(hash, 27) * XXH64_PRIME_1 + XXH64_PRIME_4;
+            tail += 8;
+        }
+        if (tail + 4 <= tail_end)
+        {
+            hash ^= static_cast<uint64_t>(read_le_32(tail)) * XXH64_PRIME_1;
+            hash = rotate_left_64(hash, 23) * XXH64_PRIME_2 + XXH64_PRIME_3;
+            tail += 4;
+        }
+        while (tail < tail_end)
+        {
+            hash ^= static_cast<uint64_t>(*tail) * XXH64_PRIME_5;
+            hash = rotate_left_64(hash, 11) * XXH64_PRIME_1;
+            ++tail;
+        }
+
+        hash ^= hash >> 33;
+        hash *= XXH64_PRIME_2;
+        hash ^= hash >> 29;
+        hash *= XXH64_PRIME_3;
+        hash ^= hash >> 32;
+
+        uint8_t digest[8];
+        for (size_t index = 0; index < 8; ++index)
+        {
+            digest[index] = static_cast<uint8_t>(hash >> (56 - 8 * index)); /* canonical big endian form */
+        }
+        append_hex(hex, digest, sizeof(digest));
+
+        m_type = digest_none;
+        return hex;
+    }
+
+    const uint64_t total_bits = m_total_size * 8;
+
+    uint8_t padding[72] = { 0x80 };
+    const size_t padding_len = (m_block_used < 56 ? 56 - m_block_used : 120 - m_block_used);
+    uint8_t length_bytes[8];
+    for (size_t index = 0; index < 8; ++index)
+    {
+        if (digest_md5 == m_type)
+        {
+            length_bytes[index] = static_cast<uint8_t>(total_bits >> (8 * index));
+        }
+        else
+        {
+            length_bytes[index] = static_cast<uint8_t>(total_bits >> (56 - 8 * index));
+        }
+    }
+    update(padding, padding_len);
+    update(length_bytes, sizeof(length_bytes));
+
+    uint8_t digest[32];
+    size_t digest_size = 0;
+    if (digest_md5 == m_type)
+    {
+        for (size_t index = 0; index < 4; ++index)
+        {
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index]);
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index] >> 8);
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index] >> 16);
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index] >> 24);
+        }
+    }
+    else
+    {
+        const size_t word_count = (digest_sha1 == m_type ? 5 : 8);
+        for (size_t index = 0; index < word_count; ++index)
+        {
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index] >> 24);
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index] >> 16);
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index] >> 8);
+            digest[digest_size++] = static_cast<uint8_t>(m_state[index]);
+        }
+    }
+    append_hex(hex, digest, digest_size);
+
+    m_type = digest_none;
+    return hex;
+}
+
+void MessageDigest::md5_transform(const uint8_t * block)
+{
+    static const uint32_t s_md5_sine[64] =
+    {
+        0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+        0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+        0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+        0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+        0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+        0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+        0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+        0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391
+    };
+    static const unsigned int s_md5_shift[64] =
+    {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+
+    uint32_t words[16];
+    for (size_t index = 0; index < 16; ++index)
+    {
+        words[index] = read_le_32(block + 4 * index);
+    }
+
+    uint32_t a = m_state[0];
+    uint32_t b = m_state[1];
+    uint32_t c = m_state[2];
+    uint32_t d = m_state[3];
+
+    for (size_t index = 0; index < 64; ++index)
+    {
+        uint32_t f = 0;
+        size_t word_index = 0;
+        if (index < 16)
+        {
+            f = (b & c) | (~b & d);
+            word_index = index;
+        }
+        else if (index < 32)
+        {
+            f = (d & b) | (~d & c);
+            word_index = (5 * index + 1) & 0x0F;
+        }
+        else if (index < 48)
+        {
+            f = b ^ c ^ d;
+            word_index = (3 * index + 5) & 0x0F;
+        }
+        else
+        {
+            f = c ^ (b | ~d);
+            word_index = (7 * index) & 0x0F;
+        }
+        const uint32_t temp = d;
+        d = c;
+        c = b;
+        b = b + rotate_left_32(a + f + s_md5_sine[index] + words[word_index], s_md5_shift[index]);
+        a = temp;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+}
+
+void MessageDigest::sha1_transform(const uint8_t * block)
+{
+    uint32_t words[80];
+    for (size_t index = 0; index < 16; ++index)
+    {
+        words[index] = read_be_32(block + 4 * index);
+    }
+    for (size_t index = 16; index < 80; ++index)
+    {
+        words[index] = rotate_left_32(words[index - 3] ^ words[index - 8] ^ words[index - 14] ^ words[index - 16], 1);
+    }
+
+    uint32_t a = m_state[0];
+    uint32_t b = m_state[1];
+    uint32_t c = m_state[2];
+    uint32_t d = m_state[3];
+    uint32_t e = m_state[4];
+
+    for (size_t index = 0; index < 80; ++index)
+    {
+        uint32_t f = 0;
+        uint32_t k = 0;
+        if (index < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (index < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (index < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        const uint32_t temp = rotate_left_32(a, 5) + f + e + k + words[index];
+        e = d;
+        d = c;
+        c = rotate_left_32(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+}
+
+void MessageDigest::sha256_transform(const uint8_t * block)
+{
+    static const uint32_t s_sha256_round[64] =
+    {
+        0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+        0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+        0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+        0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+        0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+        0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+        0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+        0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+    };
+
+    uint32_t words[64];
+    for (size_t index = 0; index < 16; ++index)
+    {
+        words[index] = read_be_32(block + 4 * index);
+    }
+    for (size_t index = 16; index < 64; ++index)
+    {
+        const uint32_t s0 = rotate_right_32(words[index - 15], 7) ^ rotate_right_32(words[index - 15], 18) ^ (words[index - 15] >> 3);
+        const uint32_t s1 = rotate_right_32(words[index - 2], 17) ^ rotate_right_32(words[index - 2], 19) ^ (words[index - 2] >> 10);
+        words[index] = words[index - 16] + s0 + words[index - 7] + s1;
+    }
+
+    uint32_t a = m_state[0];
+    uint32_t b = m_state[1];
+    uint32_t c = m_state[2];
+    uint32_t d = m_state[3];
+    uint32_t e = m_state[4];
+    uint32_t f = m_state[5];
+    uint32_t g = m_state[6];
+    uint32_t h = m_state[7];
+
+    for (size_t index = 0; index < 64; ++index)
+    {
+        const uint32_t s1 = rotate_right_32(e, 6) ^ rotate_right_32(e, 11) ^ rotate_right_32(e, 25);
+        const uint32_t choice = (e & f) ^ (~e & g);
+        const uint32_t temp1 = h + s1 + choice + s_sha256_round[index] + words[index];
+        const uint32_t s0 = rotate_right_32(a, 2) ^ rotate_right_32(a, 13) ^ rotate_right_32(a, 22);
+        const uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t temp2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+    m_state[5] += f;
+    m_state[6] += g;
+    m_state[7] += h;
+}
+
+void MessageDigest::xxh64_transform(const uint8_t * block)
+{
+    m_xxh64_state[0] = xxh64_round(m_xxh64_state[0], read_le_64(block));
+    m_xxh64_state[1] = xxh64_round(m_xxh64_state[1], read_le_64(block + 8));
+    m_xxh64_state[2] = xxh64_round(m_xxh64_state[2], read_le_64(block + 16));
+    m_xxh64_state[3] = xxh64_round(m_xxh64_state[3], read_le_64(block + 24));
+}
@@ -1,10 +1,32 @@
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <set>
+#include <map>
+#include <unordered_map>
 #include <list>
 #include <vector>
 #include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <fstream>
+#include <condition_variable>
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _MSC_VER
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif // __linux__
 #include "http_client.h"
 #include "base/charset/charset.h"
 #include "base/filesystem/file.h"
@@ -16,55 +38,28 @@
 #include "base/string/string.h"
 #include "base/time/time.h"
 #include "curl/curl.h"
+#ifdef HTTP_CLIENT_WITH_OPENSSL
+#include "openssl/ssl.h"
+#endif // HTTP_CLIENT_WITH_OPENSSL
 #include "xzip/xunzip.h"
+#include "digest/message_digest.h"
+#include "digest/digest_index.h"
+#include "log/async_logger.h"
 
-class Logger
-{
-public:
-    static Logger   s_logger;
-
-public:
-    void write(const char * data, size_t data_len);
-
-private:
-    Logger();
-    ~Logger();
-
-private:
-    typedef Stupid::Base::ThreadLocker              thread_locker_t;
-    typedef Stupid::Base::Guard<thread_locker_t>    thread_locker_guard_t;
-
-private:
-    std::string         m_name;
-    std::ofstream       m_file;
-    thread_locker_t     m_locker;
-};
-
-Logger Logger::s_logger;
+#ifndef HTTP_CLIENT_LOG_MIN_LEVEL
+#define HTTP_CLIENT_LOG_MIN_LEVEL 0 /* http_client_log_level_t::value_t, records below it are compiled out */
+#endif // HTTP_CLIENT_LOG_MIN_LEVEL
 
-Logger::Logger()
-    : m_name("./http_client.log")
-    , m_file(m_name.c_str(), std::ios::binary | std::ios::trunc)
-    , m_locker()
-{
-
-}
-
-Logger::~Logger()
-{
-    m_file.close();
-}
+/* the download threads only copy their records into rings, a background thread writes the file */
+static AsyncLogger s_run_logger("./http_client.log", http_client_log_level_t::log_info);
 
-void Logger::write(const char * data, size_t data_len)
+static const char * get_run_log_level_name(size_t level)
 {
-    if (nullptr != data)
-    {
-        thread_locker_guard_t guard(m_locker);
-        m_file.write(data, data_len);
-    }
+    static const char * s_level_names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "CRITICAL" };
+    return (level < sizeof(s_level_names) / sizeof(s_level_names[0]) ? s_level_names[level] : "UNKNOWN");
 }
 
-static void do_run_log(const char * file, const char * func, size_t line, const char * format, va_list args)
+static void do_run_log(size_t level, const char * file, const char * func, size_t line, const char * format, va_list args)
 {
     if (nullptr == file || nullptr == func || nullptr == format || nullptr == args)
     {
@@ -74,17 +69,12 @@ static void do_run_log(const char * file, const char * func, size_t line, const
     char record[2048] = { 0 };
     size_t record_size = 0;
 
-    record_size += Stupid::Base::stupid_snprintf
-    (
-        record + record_size, sizeof(record) - record_size, 
-        "%s", Stupid::Base::stupid_get_comprehensive_datetime("-", ":", " ", true).c_str()
-    );
-
+    /* the logger puts the time in front of the record */
     record_size += Stupid::Base::stupid_snprintf
     (
         record + record_size, sizeof(record) - record_size, 
         " | %s | T%010u | %s:%s:%05d | ", 
-        "TRACE", Stupid::Base::get_tid(), file, func, line
+        get_run_log_level_name(level), Stupid::Base::get_tid(), file, func, line
     );
 
     record_size += Stupid::Base::stupid_vsnprintf
@@ -92,34 +82,53 @@ static void do_run_log(const char * file, const char * func, size_t line, const
         record + record_size, sizeof(record) - record_size, format, args
     );
 
-    record_size += 1; /* for '\n' or '\0' */
-    if (record_size > sizeof(record))
+    if (record_size >= sizeof(record))
     {
-        record_size = sizeof(record);
+        record_size = sizeof(record) - 1;
     }
 
-#ifdef _MSC_VER
-    record[record_size - 1] = '\0';
-    OutputDebugStringA(record);
-#endif // _MSC_VER
-
-    record[record_size - 1] = '\n';
-    Logger::s_logger.write(record, record_size);
+    s_run_logger.write(record, record_size);
 }
 
-static void run_log(const char * file, const char * func, size_t line, const char * format, ...)
+static void run_log(size_t level, const char * file, const char * func, size_t line, const char * format, ...)
 {
     va_list args;
 
     va_start(args, format);
 
-    do_run_log(file, func, line, format, args);
+    do_run_log(level, file, func, line, format, args);
 
     va_end(args);
 }
 
-#define RUN_LOG(fmt, ...)                                   \
-run_log(__FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
+/* the arguments are not evaluated, nor the record formatted, unless the level is wanted */
+#define RUN_LOG(level, fmt, ...)                                                    \
+do                                                                                  \
+{                                                                                   \
+    if ((level) >= HTTP_CLIENT_LOG_MIN_LEVEL && s_run_logger.enabled(level))        \
+    {                                                                               \
+        run_log(level, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__);       \
+    }                                                                               \
+} while (false)
+
+#define RUN_LOG_TRK(fmt, ...) RUN_LOG(http_client_log_level_t::log_trace, fmt, ##__VA_ARGS__)
+#define RUN_LOG_DBG(fmt, ...) RUN_LOG(http_client_log_level_t::log_debug, fmt, ##__VA_ARGS__)
+#define RUN_LOG_INF(fmt, ...) RUN_LOG(http_client_log_level_t::log_info, fmt, ##__VA_ARGS__)
+#define RUN_LOG_WAR(fmt, ...) RUN_LOG(http_client_log_level_t::log_warning, fmt, ##__VA_ARGS__)
+#define RUN_LOG_ERR(fmt, ...) RUN_LOG(http_client_log_level_t::log_error, fmt, ##__VA_ARGS__)
+#define RUN_LOG_CRI(fmt, ...) RUN_LOG(http_client_log_level_t::log_critical, fmt, ##__VA_ARGS__)
+
+http_transfer_timing_t::http_transfer_timing_t()
+    : namelookup_time(0)
+    , connect_time(0)
+    , appconnect_time(0)
+    , starttransfer_time(0)
+    , total_time(0)
+    , download_speed(0)
+    , download_size(0)
+{
+
+}
 
 http_response_callback_info_t::http_response_callback_info_t()
     : user_data(0)
@@ -127,6 +136,7 @@ http_response_callback_info_t::http_response_callback_info_t()
     , error_code(http_response_callback_error_t::callback_message_response_xxx_failure)
     , url_request()
     , save_pathname()
+    , transfer_timing()
 {
     memset(url_request, 0x00, sizeof(url_request));
     memset(save_pathname, 0x00, sizeof(save_pathname));
@@ -137,6 +147,36 @@ IHttpClientSink::~IHttpClientSink()
 
 }
 
+http_data_callback_info_t::http_data_callback_info_t()
+    : request_type(http_data_request_type_t::request_get_data)
+    , user_data(0)
+    , status_code(0)
+    , error_code(http_response_callback_error_t::callback_message_response_xxx_failure)
+    , url_request()
+    , file_size(0)
+    , data(nullptr)
+    , data_len(0)
+    , transfer_timing()
+{
+    memset(url_request, 0x00, sizeof(url_request));
+}
+
+IHttpDataSink::~IHttpDataSink()
+{
+
+}
+
+http_data_request_t::http_data_request_t()
+    : request_type(http_data_request_type_t::request_get_data)
+    , user_data(0)
+    , data_sink(nullptr)
+    , url_request()
+    , storage_callback(nullptr)
+    , storage_buffer(nullptr)
+{
+    memset(url_request, 0x00, sizeof(url_request));
+}
+
 http_download_request_t::http_download_request_t()
     : need_unzip(true)
     , user_data(0)
@@ -145,6 +185,7 @@ http_download_request_t::http_download_request_t()
     , hash_request()
     , save_pathname()
     , message_digest()
+    , digest_check_mode(http_digest_check_t::check_by_hash_request)
 {
     memset(url_request, 0x00, sizeof(url_request));
     memset(hash_request, 0x00, sizeof(hash_request));
@@ -152,6 +193,77 @@ http_download_request_t::http_download_request_t()
     memset(message_digest, 0x00, sizeof(message_digest));
 }
 
+http_client_option_t::http_client_option_t()
+    : engine_mode(http_client_engine_t::engine_blocking_downloader)
+    , max_downloader_count(1)
+    , max_in_flight_count(64)
+    , connection_idle_timeout(60)
+    , max_host_connection_count(8)
+    , share_connection_cache(false)
+    , max_segment_count(1)
+    , min_segment_size(4 * 1024 * 1024)
+    , digest_index_pathname()
+    , max_unzip_thread_count(1)
+{
+    memset(digest_index_pathname, 0x00, sizeof(digest_index_pathname));
+}
+
+http_client_connection_stats_t::http_client_connection_stats_t()
+    : transfer_count(0)
+    , new_connection_count(0)
+    , reused_connection_count(0)
+    , tls_stats_available(false)
+    , tls_handshake_count(0)
+    , tls_resumed_count(0)
+{
+
+}
+
+http_latency_stats_t::http_latency_stats_t()
+    : count(0)
+    , min_time(0)
+    , max_time(0)
+    , mean_time(0)
+    , p50_time(0)
+    , p90_time(0)
+    , p99_time(0)
+    , p999_time(0)
+{
+
+}
+
+http_client_metrics_t::http_client_metrics_t()
+    : request_count(0)
+    , download_bytes(0)
+    , download_speed(0)
+    , namelookup_latency()
+    , connect_latency()
+    , tls_latency()
+    , first_byte_latency()
+    , transfer_latency()
+    , total_latency()
+    , posted_count(0)
+    , duplicate_count(0)
+    , queue_length(0)
+    , in_flight_count(0)
+    , worker_count(0)
+    , queue_latency()
+    , dispatch_first_byte_latency()
+    , dispatch_response_latency()
+{
+
+}
+
+http_client_worker_stats_t::http_client_worker_stats_t()
+    : slot_count(0)
+    , in_flight_count(0)
+    , completed_count(0)
+    , busy_time(0)
+    , up_time(0)
+{
+
+}
+
 IHttpClient::~IHttpClient()
 {
 
@@ -162,16 +274,289 @@ struct download_request_status_t
     download_request_status_t();
 
     bool                        been_stopped;
+    bool                        is_data_request; /* the slot serves data_request, not download_request */
     http_download_request_t     download_request;
+    http_data_request_t         data_request;
+    HZIPSTREAM                  unzip_stream; /* unzips into the unzip stage while the zip downloads */
+    size_t                      slot_index;   /* of this status in the status vector */
+    size_t                      worker_index; /* the thread which serves this slot */
+    int64_t                     enqueue_time; /* monotonic microseconds, as are the rest */
+    int64_t                     dispatch_time;
+    int64_t                     first_byte_time; /* zero until the first byte of the file comes */
 };
 
 download_request_status_t::download_request_status_t()
     : been_stopped(false)
+    , is_data_request(false)
     , download_request()
+    , data_request()
+    , unzip_stream(nullptr)
+    , slot_index(0)
+    , worker_index(0)
+    , enqueue_time(0)
+    , dispatch_time(0)
+    , first_byte_time(0)
 {
 
 }
 
+class DownloadRequestQueue
+{
+public:
+    DownloadRequestQueue();
+
+public:
+    void open();
+    void close();
+
+public:
+    void push(const http_download_request_t & download_request);
+    void push(const http_data_request_t & data_request);
+    void push(const std::vector<const http_download_request_t *> & download_requests);
+    bool pop(download_request_status_t & download_request_status, bool wait);
+    void remove(const http_download_request_t & download_request);
+    void clear(std::vector<http_data_request_t> & data_requests); /* the queued data requests are handed back, so they can still be answered */
+    size_t size();
+
+private:
+    struct queued_request_t
+    {
+        bool                                        is_data_request;
+        http_download_request_t                     download_request;
+        http_data_request_t                         data_request;
+        int64_t                                     enqueue_time;
+    };
+
+    typedef std::list<queued_request_t>             download_request_list_t;
+    typedef std::unordered_multimap<std::string, download_request_list_t::iterator> download_request_index_t; /* url -> its queued downloads, so remove need not walk the queue */
+    typedef std::unique_lock<std::mutex>            download_request_lock_t;
+
+private:
+    bool                                            m_is_closed;
+    download_request_list_t                         m_data_request_list;     /* popped before any download, they are small and the caller is waiting */
+    download_request_list_t                         m_download_request_list;
+    download_request_index_t                        m_download_request_index;
+    std::mutex                                      m_download_request_mutex;
+    std::condition_variable                         m_download_request_condition;
+};
+
+class LibcurlHandlePool
+{
+public:
+    LibcurlHandlePool();
+    ~LibcurlHandlePool();
+
+public:
+    void init(size_t idle_timeout, size_t max_host_idle_count, bool share_connection_cache);
+    void clear();
+
+public:
+    CURL * acquire(const char * url_request);
+    void release(const char * url_request, CURL * curl);
+
+private:
+    struct idle_handle_t
+    {
+        CURL                                      * curl;
+        int64_t                                     idle_time;
+    };
+
+    typedef std::list<idle_handle_t>                idle_handle_list_t;
+    typedef std::map<std::string, idle_handle_list_t> idle_handle_map_t;
+    typedef std::unique_lock<std::mutex>            idle_handle_lock_t;
+
+private:
+    void expire_idle_handles(int64_t current_time, std::vector<CURL *> & expired_handle_vector);
+
+private:
+    size_t                                          m_idle_timeout;
+    size_t                                          m_max_host_idle_count;
+    bool                                            m_share_connection_cache;
+    idle_handle_map_t                               m_idle_handle_map;
+    std::mutex                                      m_idle_handle_mutex;
+};
+
+class LibcurlConnectionStats
+{
+public:
+    LibcurlConnectionStats();
+
+public:
+    void reset();
+    void attach(CURL * curl);
+    void record(CURL * curl);
+    void get(http_client_connection_stats_t & connection_stats) const;
+
+#ifdef HTTP_CLIENT_WITH_OPENSSL
+private:
+    static int get_ssl_ctx_index();
+    static CURLcode ssl_ctx_callback(CURL * curl, void * ssl_ctx, void * user_data);
+    static void ssl_info_callback(const SSL * ssl, int where, int ret);
+#endif // HTTP_CLIENT_WITH_OPENSSL
+
+private:
+    std::atomic<size_t>                             m_transfer_count;
+    std::atomic<size_t>                             m_new_connection_count;
+    std::atomic<size_t>                             m_reused_connection_count;
+    std::atomic<size_t>                             m_tls_handshake_count;
+    std::atomic<size_t>                             m_tls_resumed_count;
+};
+
+/*
+ * latency histograms in the manner of HdrHistogram: values below 64 microseconds get a bucket each,
+ * above that every power of two is cut into 32 buckets, so a bucket is at most 1/32 of its value wide,
+ * up to 2^36 microseconds (19 hours), larger values go to the last bucket
+ */
+class LatencyHistogram
+{
+public:
+    enum { bucket_count = 1024 };
+
+public:
+    LatencyHistogram();
+
+public:
+    void reset();
+    void record(uint64_t value);
+    void add_to(std::vector<uint64_t> & bucket_counts, uint64_t & count, uint64_t & sum, uint64_t & min_value, uint64_t & max_value) const;
+
+public:
+    static size_t get_bucket_index(uint64_t value);
+    static uint64_t get_bucket_value(size_t bucket_index);
+    static void get_stats(const std::vector<uint64_t> & bucket_counts, uint64_t count, uint64_t sum, uint64_t min_value, uint64_t max_value, http_latency_stats_t & latency_stats);
+
+private:
+    std::atomic<uint32_t>                           m_bucket_counts[bucket_count];
+    std::atomic<uint64_t>                           m_count;
+    std::atomic<uint64_t>                           m_sum;
+    std::atomic<uint64_t>                           m_min;
+    std::atomic<uint64_t>                           m_max;
+};
+
+/*
+ * timing of every transfer from CURLINFO, kept in shards which threads take by the order they first record in,
+ * so threads mostly add to counters no other thread touches, and no lock is taken, a snapshot adds the shards up
+ */
+class LibcurlTransferMetrics
+{
+public:
+    LibcurlTransferMetrics();
+    ~LibcurlTransferMetrics();
+
+public:
+    void reset();
+    void record(CURL * curl, http_transfer_timing_t * transfer_timing);
+    void get(http_client_metrics_t & metrics) const;
+
+private:
+    LibcurlTransferMetrics(const LibcurlTransferMetrics &);
+    LibcurlTransferMetrics & operator = (const LibcurlTransferMetrics &);
+
+private:
+    enum latency_type_t
+    {
+        latency_namelookup,
+        latency_connect,
+        latency_tls,
+        latency_first_byte,
+        latency_transfer,
+        latency_total,
+        latency_type_count
+    };
+
+    struct metrics_shard_t
+    {
+        metrics_shard_t();
+
+        std::atomic<uint64_t>                       request_count;
+        std::atomic<uint64_t>                       download_bytes;
+        std::atomic<uint64_t>                       receive_time;
+        LatencyHistogram                            latency_histograms[latency_type_count];
+    };
+
+    enum { shard_count = 16 };
+
+private:
+    metrics_shard_t * get_shard();
+
+private:
+    std::atomic<metrics_shard_t *>                  m_shards[shard_count];
+};
+
+/*
+ * how requests wait for the workers (downloader threads, or event loop threads) and how busy the workers are,
+ * an event loop begins requests which its completion threads end, so the gauges are changed by atomic steps
+ */
+class DownloadSchedulerMetrics
+{
+public:
+    DownloadSchedulerMetrics();
+
+public:
+    void init(size_t worker_count, size_t slot_count);
+    void record_post(size_t count);
+    void record_duplicate(size_t count);
+    void begin_request(const download_request_status_t & download_request_status);
+    void end_request(const download_request_status_t & download_request_status);
+    void get(http_client_metrics_t & metrics) const;
+    bool get_worker(size_t worker_index, http_client_worker_stats_t & worker_stats) const;
+
+private:
+    DownloadSchedulerMetrics(const DownloadSchedulerMetrics &);
+    DownloadSchedulerMetrics & operator = (const DownloadSchedulerMetrics &);
+
+private:
+    struct worker_t
+    {
+        worker_t();
+
+        std::atomic<size_t>                         in_flight_count;
+        std::atomic<size_t>                         completed_count;
+        std::atomic<int64_t>                        busy_begin_time; /* when in flight count last rose from zero */
+        std::atomic<int64_t>                        busy_time;       /* of the busy spells already ended */
+    };
+
+private:
+    size_t                                          m_worker_count;
+    size_t                                          m_slot_count;
+    int64_t                                         m_init_time;
+    std::unique_ptr<worker_t[]>                     m_workers;
+    std::atomic<size_t>                             m_posted_count;
+    std::atomic<size_t>                             m_duplicate_count;
+    LatencyHistogram                                m_queue_histogram;
+    LatencyHistogram                                m_first_byte_histogram;
+    LatencyHistogram                                m_response_histogram;
+};
+
+struct event_loop_t;
+struct event_transfer_t;
+
+/* transfers the event loops hand to the completion threads, which do their file work and callbacks */
+class EventTransferQueue
+{
+public:
+    EventTransferQueue();
+
+public:
+    void open();
+    void close();
+
+public:
+    void push(event_transfer_t * event_transfer);
+    bool pop(event_transfer_t *& event_transfer); /* waits, false once closed and empty */
+
+private:
+    typedef std::unique_lock<std::mutex>            event_transfer_lock_t;
+
+private:
+    bool                                            m_is_closed;
+    std::list<event_transfer_t *>                   m_event_transfer_list;
+    std::mutex                                      m_event_transfer_mutex;
+    std::condition_variable                         m_event_transfer_condition;
+};
+
+static const size_t no_slot_index = ~static_cast<size_t>(0);
+
 class HttpClient : public IHttpClient
 {
 public:
@@ -180,48 +565,101 @@ public:
 
 public:
     virtual bool init(size_t max_downloader_count) override;
+    virtual bool init(const http_client_option_t & client_option) override;
     virtual void exit() override;
 
 public:
     virtual void post_download_request(const http_download_request_t & download_request) override;
+    virtual size_t post_download_requests(const http_download_request_t * download_requests, size_t download_request_count) override;
     virtual void stop_download_request(const http_download_request_t & download_request) override;
 
 public:
     virtual bool get_file_size(const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code);
     virtual bool get_data(const char * url_request, storage_callback_t storage_callback, void * storage_buffer, size_t & url_status_code, size_t & url_error_code);
+    virtual bool post_data_request(const http_data_request_t & data_request) override;
+
+public:
+    virtual void get_connection_stats(http_client_connection_stats_t & connection_stats) override;
+    virtual void get_metrics(http_client_metrics_t & metrics) override;
+    virtual bool get_worker_stats(size_t worker_index, http_client_worker_stats_t & worker_stats) override;
 
 public:
     void do_download(size_t thread_index);
+    void do_event_loop(size_t thread_index);
+    void do_event_completion(size_t thread_index);
 
 private:
     void clear();
 
 private:
+    bool acquire_download_request(download_request_status_t & download_request_status, bool wait);
+    void handle_download_response(download_request_status_t & download_request_status, http_response_callback_info_t & callback_info, bool download_success);
+    void fetch_data(download_request_status_t & download_request_status, http_data_callback_info_t & callback_info, std::string & data_buffer);
+    void handle_data_response(download_request_status_t & download_request_status, http_data_callback_info_t & callback_info, const std::string & data_buffer);
+    void answer_stopped_data_request(const http_data_request_t & data_request);
+
+private:
+    bool skip_unchanged_download(const http_download_request_t & download_request);
     bool url_download_with_libcurl(download_request_status_t & download_request_status, http_response_callback_info_t & callback_info);
+    bool url_segmented_download(CURL * curl, download_request_status_t & download_request_status, const std::string & expected_digest, http_response_callback_info_t & callback_info);
+
+private:
+    void start_event_transfers(event_loop_t & event_loop);
+    bool begin_event_transfer(event_loop_t & event_loop, event_transfer_t & event_transfer);
+    bool begin_event_data(event_loop_t & event_loop, event_transfer_t & event_transfer);
+    bool add_event_transfer(event_loop_t & event_loop, event_transfer_t & event_transfer);
+    void complete_event_transfer(event_loop_t & event_loop, event_transfer_t * event_transfer, CURLcode curl_code);
+    void post_event_transfer(event_loop_t & event_loop, event_transfer_t * event_transfer, size_t stage);
+    void collect_event_transfers(event_loop_t & event_loop);
+    void stop_event_transfers(event_loop_t & event_loop, bool stop_all);
+    void wake_event_loops();
+
+private:
+    void run_event_transfer(event_transfer_t * event_transfer);
+    bool open_event_download(event_transfer_t & event_transfer);
+    bool check_event_transfer(event_transfer_t & event_transfer);
+    void finish_event_transfer(event_transfer_t * event_transfer);
 
 private:
     typedef Stupid::Base::ThreadGroup               thread_group_t;
     typedef Stupid::Base::ThreadLocker              thread_locker_t;
     typedef Stupid::Base::Guard<thread_locker_t>    thread_locker_guard_t;
-    typedef std::set<http_download_request_t>       download_request_set_t;
-    typedef std::list<http_download_request_t>      download_request_list_t;
+    typedef std::unordered_map<std::string, size_t> download_request_map_t; /* url -> slot index of the download, or no_slot_index while it is queued */
     typedef std::vector<download_request_status_t>  download_request_status_vector_t;
 
 private:
     CURLSH                                        * m_share_handle; /* can be a static member */
+    std::mutex                                      m_share_mutex_array[CURL_LOCK_DATA_LAST]; /* one lock per shared data type */
+    LibcurlConnectionStats                          m_connection_stats;
+    LibcurlTransferMetrics                          m_transfer_metrics;
+    DownloadSchedulerMetrics                        m_scheduler_metrics;
+    DigestIndex                                     m_digest_index;
 
 private:
     bool                                            m_is_running;
+    size_t                                          m_engine_mode;
+    size_t                                          m_max_downloader_count;
+    size_t                                          m_max_segment_count;
+    size_t                                          m_min_segment_size;
+    size_t                                          m_max_unzip_thread_count;
 
-    download_request_set_t                          m_download_request_set;
-    thread_locker_t                                 m_download_request_set_locker;
+    download_request_map_t                          m_download_request_map;
+    thread_locker_t                                 m_download_request_map_locker;
 
-    download_request_list_t                         m_download_request_list;
-    thread_locker_t                                 m_download_request_list_locker;
+    DownloadRequestQueue                            m_download_request_queue;
+
+    LibcurlHandlePool                               m_handle_pool;
 
     download_request_status_vector_t                m_download_request_status_vector;
 
+#ifdef __linux__
+    std::vector<int>                                m_event_wakeup_fd_vector;
+#endif // __linux__
+
+    EventTransferQueue                              m_event_transfer_queue;
+
     thread_group_t                                  m_download_thread_group;
+    thread_group_t                                  m_completion_thread_group;
 };
 
 struct http_thread_param_t
@@ -247,827 +685,4529 @@ thread_return_t STUPID_STDCALL download_thread_run(thread_argument_t argument)
     return THREAD_DEFAULT_RET;
 }
 
-static bool operator < (const http_download_request_t & lhs, const http_download_request_t & rhs)
+thread_return_t STUPID_STDCALL event_loop_thread_run(thread_argument_t argument)
+{
+    http_thread_param_t * thread_param = reinterpret_cast<http_thread_param_t *>(argument);
+    if (nullptr != thread_param)
+    {
+        thread_param->http_client.do_event_loop(thread_param->thread_index);
+        delete thread_param;
+    }
+    return THREAD_DEFAULT_RET;
+}
+
+thread_return_t STUPID_STDCALL event_completion_thread_run(thread_argument_t argument)
 {
-    return strncmp(lhs.url_request, rhs.url_request, sizeof(lhs.url_request)) < 0;
+    http_thread_param_t * thread_param = reinterpret_cast<http_thread_param_t *>(argument);
+    if (nullptr != thread_param)
+    {
+        thread_param->http_client.do_event_completion(thread_param->thread_index);
+        delete thread_param;
+    }
+    return THREAD_DEFAULT_RET;
 }
 
-static bool operator == (const http_download_request_t & lhs, const http_download_request_t & rhs)
+/* downloads are told apart by url, which need not end with '\0' if it fills the array */
+static std::string get_download_request_key(const http_download_request_t & download_request)
 {
-    return 0 == strncmp(lhs.url_request, rhs.url_request, sizeof(lhs.url_request));
+    const char * url_end = reinterpret_cast<const char *>(memchr(download_request.url_request, '\0', sizeof(download_request.url_request)));
+    return (std::string(download_request.url_request, nullptr == url_end ? sizeof(download_request.url_request) : static_cast<size_t>(url_end - download_request.url_request)));
 }
 
-HttpClient::HttpClient()
-    : m_is_running(false)
-    , m_download_request_set()
-    , m_download_request_set_locker()
+static int64_t get_monotonic_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t get_monotonic_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DownloadRequestQueue::DownloadRequestQueue()
+    : m_is_closed(false)
+    , m_data_request_list()
     , m_download_request_list()
-    , m_download_request_list_locker()
-    , m_download_request_status_vector()
-    , m_download_thread_group()
+    , m_download_request_index()
+    , m_download_request_mutex()
+    , m_download_request_condition()
 {
 
 }
 
-HttpClient::~HttpClient()
+void DownloadRequestQueue::open()
 {
-    exit();
+    download_request_lock_t download_request_lock(m_download_request_mutex);
+    m_is_closed = false;
 }
 
-bool HttpClient::init(size_t max_downloader_count)
+void DownloadRequestQueue::close()
 {
-    exit();
+    {
+        download_request_lock_t download_request_lock(m_download_request_mutex);
+        m_is_closed = true;
+    }
+    m_download_request_condition.notify_all();
+}
 
-    do
+void DownloadRequestQueue::push(const http_download_request_t & download_request)
+{
+    queued_request_t queued_request;
+    queued_request.is_data_request = false;
+    queued_request.download_request = download_request;
+    queued_request.enqueue_time = get_monotonic_us();
+    std::string download_request_key(get_download_request_key(download_request));
     {
-        m_is_running = true;
+        download_request_lock_t download_request_lock(m_download_request_mutex);
+        m_download_request_list.push_back(queued_request);
+        m_download_request_index.insert(std::make_pair(std::move(download_request_key), --m_download_request_list.end()));
+    }
+    m_download_request_condition.notify_one();
+}
 
-        RUN_LOG("[http_client] init begin");
+void DownloadRequestQueue::push(const http_data_request_t & data_request)
+{
+    queued_request_t queued_request;
+    queued_request.is_data_request = true;
+    queued_request.data_request = data_request;
+    queued_request.enqueue_time = get_monotonic_us();
+    {
+        download_request_lock_t download_request_lock(m_download_request_mutex);
+        m_data_request_list.push_back(queued_request);
+    }
+    m_download_request_condition.notify_one();
+}
 
-        if (0 == max_downloader_count)
+void DownloadRequestQueue::push(const std::vector<const http_download_request_t *> & download_requests)
+{
+    /* the nodes and keys are made before the lock is taken, the nodes are spliced in under it and stay valid */
+    download_request_list_t batch_request_list;
+    std::vector<std::pair<std::string, download_request_list_t::iterator>> batch_index_vector;
+    batch_index_vector.reserve(download_requests.size());
+    queued_request_t queued_request;
+    queued_request.is_data_request = false;
+    queued_request.enqueue_time = get_monotonic_us();
+    for (std::vector<const http_download_request_t *>::const_iterator iter = download_requests.begin(); download_requests.end() != iter; ++iter)
+    {
+        batch_request_list.push_back(queued_request);
+        batch_request_list.back().download_request = **iter;
+        batch_index_vector.push_back(std::make_pair(get_download_request_key(**iter), --batch_request_list.end()));
+    }
+    {
+        download_request_lock_t download_request_lock(m_download_request_mutex);
+        m_download_request_list.splice(m_download_request_list.end(), batch_request_list);
+        m_download_request_index.reserve(m_download_request_index.size() + batch_index_vector.size());
+        for (std::vector<std::pair<std::string, download_request_list_t::iterator>>::iterator iter = batch_index_vector.begin(); batch_index_vector.end() != iter; ++iter)
         {
-            RUN_LOG("[http_client] init warning: max downloader count is zero (means: can not download asynchronously)");
+            m_download_request_index.insert(std::move(*iter));
         }
+    }
+    m_download_request_condition.notify_all();
+}
 
-        curl_global_init(CURL_GLOBAL_DEFAULT);
-
-        m_share_handle = curl_share_init();
-        if (nullptr == m_share_handle)
+bool DownloadRequestQueue::pop(download_request_status_t & download_request_status, bool wait)
+{
+    download_request_lock_t download_request_lock(m_download_request_mutex);
+    while (wait && !m_is_closed && m_data_request_list.empty() && m_download_request_list.empty())
+    {
+        m_download_request_condition.wait(download_request_lock);
+    }
+    if (!m_data_request_list.empty())
+    {
+        const queued_request_t & queued_request = m_data_request_list.front();
+        download_request_status.is_data_request = true;
+        download_request_status.data_request = queued_request.data_request;
+        download_request_status.enqueue_time = queued_request.enqueue_time;
+        m_data_request_list.pop_front();
+        return true;
+    }
+    if (m_download_request_list.empty())
+    {
+        return false;
+    }
+    const queued_request_t & queued_request = m_download_request_list.front();
+    download_request_status.is_data_request = false;
+    download_request_status.download_request = queued_request.download_request;
+    std::pair<download_request_index_t::iterator, download_request_index_t::iterator> index_range = m_download_request_index.equal_range(get_download_request_key(queued_request.download_request));
+    for (download_request_index_t::iterator iter = index_range.first; index_range.second != iter; ++iter)
+    {
+        if (m_download_request_list.begin() == iter->second)
         {
-            RUN_LOG("[http_client] init failure: curl_share_init failure");
+            m_download_request_index.erase(iter);
             break;
         }
+    }
+    download_request_status.enqueue_time = queued_request.enqueue_time;
+    m_download_request_list.pop_front();
+    return true;
+}
 
-        curl_share_setopt(m_share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
-
-        m_download_request_status_vector.resize(max_downloader_count);
+void DownloadRequestQueue::remove(const http_download_request_t & download_request)
+{
+    const std::string download_request_key(get_download_request_key(download_request));
+    download_request_lock_t download_request_lock(m_download_request_mutex);
+    std::pair<download_request_index_t::iterator, download_request_index_t::iterator> index_range = m_download_request_index.equal_range(download_request_key);
+    for (download_request_index_t::iterator iter = index_range.first; index_range.second != iter; ++iter)
+    {
+        m_download_request_list.erase(iter->second);
+    }
+    m_download_request_index.erase(index_range.first, index_range.second);
+}
 
-        for (size_t index = 0; index < max_downloader_count; ++index)
-        {
+void DownloadRequestQueue::clear(std::vector<http_data_request_t> & data_requests)
+{
+    download_request_lock_t download_request_lock(m_download_request_mutex);
+    data_requests.reserve(data_requests.size() + m_data_request_list.size());
+    for (download_request_list_t::const_iterator iter = m_data_request_list.begin(); m_data_request_list.end() != iter; ++iter)
+    {
+        data_requests.push_back(iter->data_request);
+    }
+    m_data_request_list.clear();
+    m_download_request_list.clear();
+    m_download_request_index.clear();
+}
+
+size_t DownloadRequestQueue::size()
+{
+    download_request_lock_t download_request_lock(m_download_request_mutex);
+    return (m_data_request_list.size() + m_download_request_list.size());
+}
+
+EventTransferQueue::EventTransferQueue()
+    : m_is_closed(false)
+    , m_event_transfer_list()
+    , m_event_transfer_mutex()
+    , m_event_transfer_condition()
+{
+
+}
+
+void EventTransferQueue::open()
+{
+    event_transfer_lock_t event_transfer_lock(m_event_transfer_mutex);
+    m_is_closed = false;
+}
+
+void EventTransferQueue::close()
+{
+    {
+        event_transfer_lock_t event_transfer_lock(m_event_transfer_mutex);
+        m_is_closed = true;
+    }
+    m_event_transfer_condition.notify_all();
+}
+
+void EventTransferQueue::push(event_transfer_t * event_transfer)
+{
+    {
+        event_transfer_lock_t event_transfer_lock(m_event_transfer_mutex);
+        m_event_transfer_list.push_back(event_transfer);
+    }
+    m_event_transfer_condition.notify_one();
+}
+
+bool EventTransferQueue::pop(event_transfer_t *& event_transfer)
+{
+    event_transfer_lock_t event_transfer_lock(m_event_transfer_mutex);
+    while (!m_is_closed && m_event_transfer_list.empty())
+    {
+        m_event_transfer_condition.wait(event_transfer_lock);
+    }
+    if (m_event_transfer_list.empty())
+    {
+        return false;
+    }
+    event_transfer = m_event_transfer_list.front();
+    m_event_transfer_list.pop_front();
+    return true;
+}
+
+/* "scheme://host:port", the key of keep-alive connections in libcurl connection cache */
+static std::string get_url_origin(const char * url_request)
+{
+    std::string url(nullptr == url_request ? "" : url_request);
+
+    std::string scheme("http");
+    std::string::size_type authority_begin = 0;
+    const std::string::size_type scheme_end = url.find("://");
+    if (std::string::npos != scheme_end)
+    {
+        scheme = url.substr(0, scheme_end);
+        authority_begin = scheme_end + 3;
+    }
+    for (std::string::iterator iter = scheme.begin(); scheme.end() != iter; ++iter)
+    {
+        *iter = static_cast<char>(tolower(static_cast<unsigned char>(*iter)));
+    }
+
+    std::string::size_type authority_end = url.find_first_of("/?#", authority_begin);
+    if (std::string::npos == authority_end)
+    {
+        authority_end = url.size();
+    }
+    std::string authority(url.substr(authority_begin, authority_end - authority_begin));
+    const std::string::size_type userinfo_end = authority.rfind('@');
+    if (std::string::npos != userinfo_end)
+    {
+        authority.erase(0, userinfo_end + 1);
+    }
+    for (std::string::iterator iter = authority.begin(); authority.end() != iter; ++iter)
+    {
+        *iter = static_cast<char>(tolower(static_cast<unsigned char>(*iter)));
+    }
+
+    const std::string::size_type port_begin = authority.rfind(':');
+    if (std::string::npos == port_begin || std::string::npos != authority.find(']', port_begin))
+    {
+        if ("https" == scheme)
+        {
+            authority += ":443";
+        }
+        else if ("ftp" == scheme)
+        {
+            authority += ":21";
+        }
+        else
+        {
+            authority += ":80";
+        }
+    }
+
+    return scheme + "://" + authority;
+}
+
+LibcurlHandlePool::LibcurlHandlePool()
+    : m_idle_timeout(0)
+    , m_max_host_idle_count(0)
+    , m_share_connection_cache(false)
+    , m_idle_handle_map()
+    , m_idle_handle_mutex()
+{
+
+}
+
+LibcurlHandlePool::~LibcurlHandlePool()
+{
+    clear();
+}
+
+void LibcurlHandlePool::init(size_t idle_timeout, size_t max_host_idle_count, bool share_connection_cache)
+{
+    clear();
+
+    idle_handle_lock_t idle_handle_lock(m_idle_handle_mutex);
+    m_idle_timeout = idle_timeout;
+    m_max_host_idle_count = max_host_idle_count;
+    m_share_connection_cache = share_connection_cache;
+}
+
+void LibcurlHandlePool::clear()
+{
+    idle_handle_map_t idle_handle_map;
+
+    {
+        idle_handle_lock_t idle_handle_lock(m_idle_handle_mutex);
+        idle_handle_map.swap(m_idle_handle_map);
+    }
+
+    for (idle_handle_map_t::iterator map_iter = idle_handle_map.begin(); idle_handle_map.end() != map_iter; ++map_iter)
+    {
+        for (idle_handle_list_t::iterator list_iter = map_iter->second.begin(); map_iter->second.end() != list_iter; ++list_iter)
+        {
+            curl_easy_cleanup(list_iter->curl);
+        }
+    }
+}
+
+void LibcurlHandlePool::expire_idle_handles(int64_t current_time, std::vector<CURL *> & expired_handle_vector)
+{
+    const int64_t idle_timeout_ms = static_cast<int64_t>(m_idle_timeout) * 1000;
+
+    idle_handle_map_t::iterator map_iter = m_idle_handle_map.begin();
+    while (m_idle_handle_map.end() != map_iter)
+    {
+        idle_handle_list_t & idle_handle_list = map_iter->second;
+        while (!idle_handle_list.empty() && idle_handle_list.front().idle_time + idle_timeout_ms <= current_time)
+        {
+            expired_handle_vector.push_back(idle_handle_list.front().curl);
+            idle_handle_list.pop_front();
+        }
+        if (idle_handle_list.empty())
+        {
+            m_idle_handle_map.erase(map_iter++);
+        }
+        else
+        {
+            ++map_iter;
+        }
+    }
+}
+
+CURL * LibcurlHandlePool::acquire(const char * url_request)
+{
+    const std::string url_origin(get_url_origin(url_request));
+
+    CURL * curl = nullptr;
+    size_t idle_timeout = 0;
+    bool share_connection_cache = false;
+    std::vector<CURL *> expired_handle_vector;
+
+    {
+        idle_handle_lock_t idle_handle_lock(m_idle_handle_mutex);
+
+        idle_timeout = m_idle_timeout;
+        share_connection_cache = m_share_connection_cache;
+
+        expire_idle_handles(get_monotonic_ms(), expired_handle_vector);
+
+        idle_handle_map_t::iterator map_iter = m_idle_handle_map.find(url_origin);
+        if (m_idle_handle_map.end() != map_iter)
+        {
+            curl = map_iter->second.back().curl; /* most recently used, its connection is the least likely to be closed by server */
+            map_iter->second.pop_back();
+            if (map_iter->second.empty())
+            {
+                m_idle_handle_map.erase(map_iter);
+            }
+        }
+    }
+
+    for (std::vector<CURL *>::iterator iter = expired_handle_vector.begin(); expired_handle_vector.end() != iter; ++iter)
+    {
+        curl_easy_cleanup(*iter);
+    }
+
+    if (nullptr == curl)
+    {
+        curl = curl_easy_init();
+        if (nullptr == curl)
+        {
+            return nullptr;
+        }
+    }
+    else
+    {
+        curl_easy_reset(curl); /* keeps the live connection, drops options of the previous request */
+    }
+
+    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, (0 == idle_timeout ? 1L : 0L));
+    if (!share_connection_cache)
+    {
+        curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, 1L); /* one keep-alive connection per idle handle */
+    }
+#if LIBCURL_VERSION_NUM >= 0x074100
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, static_cast<long>(idle_timeout));
+#endif // LIBCURL_VERSION_NUM >= 0x074100
+
+    return curl;
+}
+
+void LibcurlHandlePool::release(const char * url_request, CURL * curl)
+{
+    if (nullptr == curl)
+    {
+        return;
+    }
+
+    const std::string url_origin(get_url_origin(url_request));
+
+    std::vector<CURL *> expired_handle_vector;
+
+    {
+        idle_handle_lock_t idle_handle_lock(m_idle_handle_mutex);
+
+        if (0 == m_idle_timeout || 0 == m_max_host_idle_count)
+        {
+            expired_handle_vector.push_back(curl);
+        }
+        else
+        {
+            const int64_t current_time = get_monotonic_ms();
+
+            expire_idle_handles(current_time, expired_handle_vector);
+
+            idle_handle_list_t & idle_handle_list = m_idle_handle_map[url_origin];
+            if (idle_handle_list.size() >= m_max_host_idle_count)
+            {
+                expired_handle_vector.push_back(idle_handle_list.front().curl);
+                idle_handle_list.pop_front();
+            }
+
+            idle_handle_t idle_handle;
+            idle_handle.curl = curl;
+            idle_handle.idle_time = current_time;
+            idle_handle_list.push_back(idle_handle);
+        }
+    }
+
+    for (std::vector<CURL *>::iterator iter = expired_handle_vector.begin(); expired_handle_vector.end() != iter; ++iter)
+    {
+        curl_easy_cleanup(*iter);
+    }
+}
+
+LibcurlConnectionStats::LibcurlConnectionStats()
+    : m_transfer_count(0)
+    , m_new_connection_count(0)
+    , m_reused_connection_count(0)
+    , m_tls_handshake_count(0)
+    , m_tls_resumed_count(0)
+{
+
+}
+
+void LibcurlConnectionStats::reset()
+{
+    m_transfer_count = 0;
+    m_new_connection_count = 0;
+    m_reused_connection_count = 0;
+    m_tls_handshake_count = 0;
+    m_tls_resumed_count = 0;
+}
+
+#ifdef HTTP_CLIENT_WITH_OPENSSL
+int LibcurlConnectionStats::get_ssl_ctx_index()
+{
+    static const int s_ssl_ctx_index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return s_ssl_ctx_index;
+}
+
+/* libcurl creates a ssl context for every new connection, before the handshake */
+CURLcode LibcurlConnectionStats::ssl_ctx_callback(CURL * curl, void * ssl_ctx, void * user_data)
+{
+    SSL_CTX * ctx = reinterpret_cast<SSL_CTX *>(ssl_ctx);
+    if (nullptr != ctx && get_ssl_ctx_index() >= 0)
+    {
+        SSL_CTX_set_ex_data(ctx, get_ssl_ctx_index(), user_data);
+        SSL_CTX_set_info_callback(ctx, ssl_info_callback);
+    }
+    return CURLE_OK;
+}
+
+void LibcurlConnectionStats::ssl_info_callback(const SSL * ssl, int where, int ret)
+{
+    if (0 == (where & SSL_CB_HANDSHAKE_DONE))
+    {
+        return;
+    }
+    LibcurlConnectionStats * connection_stats = reinterpret_cast<LibcurlConnectionStats *>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), get_ssl_ctx_index()));
+    if (nullptr != connection_stats)
+    {
+        ++connection_stats->m_tls_handshake_count;
+        if (SSL_session_reused(const_cast<SSL *>(ssl)))
+        {
+            ++connection_stats->m_tls_resumed_count;
+        }
+    }
+}
+#endif // HTTP_CLIENT_WITH_OPENSSL
+
+void LibcurlConnectionStats::attach(CURL * curl)
+{
+#ifdef HTTP_CLIENT_WITH_OPENSSL
+    curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, ssl_ctx_callback);
+    curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, reinterpret_cast<void *>(this));
+#else
+    (void)curl;
+#endif // HTTP_CLIENT_WITH_OPENSSL
+}
+
+void LibcurlConnectionStats::record(CURL * curl)
+{
+    long status_code = 0;
+    long connect_count = 0;
+    if (CURLE_OK != curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code) || 0 == status_code)
+    {
+        return; /* no response, neither a new connection nor a reused one served it */
+    }
+    if (CURLE_OK != curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connect_count))
+    {
+        return;
+    }
+    ++m_transfer_count;
+    if (connect_count > 0)
+    {
+        ++m_new_connection_count;
+    }
+    else
+    {
+        ++m_reused_connection_count;
+    }
+}
+
+void LibcurlConnectionStats::get(http_client_connection_stats_t & connection_stats) const
+{
+    connection_stats.transfer_count = m_transfer_count;
+    connection_stats.new_connection_count = m_new_connection_count;
+    connection_stats.reused_connection_count = m_reused_connection_count;
+#ifdef HTTP_CLIENT_WITH_OPENSSL
+    connection_stats.tls_stats_available = true;
+#else
+    connection_stats.tls_stats_available = false;
+#endif // HTTP_CLIENT_WITH_OPENSSL
+    connection_stats.tls_handshake_count = m_tls_handshake_count;
+    connection_stats.tls_resumed_count = m_tls_resumed_count;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_count(0)
+    , m_sum(0)
+    , m_min(~static_cast<uint64_t>(0))
+    , m_max(0)
+{
+    for (size_t index = 0; index < bucket_count; ++index)
+    {
+        m_bucket_counts[index] = 0;
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (size_t index = 0; index < bucket_count; ++index)
+    {
+        m_bucket_counts[index].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(~static_cast<uint64_t>(0), std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::get_bucket_index(uint64_t value)
+{
+    if (value < 64)
+    {
+        return (static_cast<size_t>(value));
+    }
+    size_t shift = 0;
+    while ((value >> shift) >= 64)
+    {
+        ++shift;
+    }
+    /* value >> shift is in [32, 64) */
+    const size_t bucket_index = 64 + (shift - 1) * 32 + static_cast<size_t>((value >> shift) - 32);
+    return (bucket_index < bucket_count ? bucket_index : bucket_count - 1);
+}
+
+uint64_t LatencyHistogram::get_bucket_value(size_t bucket_index)
+{
+    if (bucket_index < 64)
+    {
+        return (bucket_index);
+    }
+    const size_t shift = (bucket_index - 64) / 32 + 1;
+    const uint64_t lowest = static_cast<uint64_t>((bucket_index - 64) % 32 + 32) << shift;
+    return (lowest + (static_cast<uint64_t>(1) << shift) / 2); /* the middle of the bucket */
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    m_bucket_counts[get_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t min_value = m_min.load(std::memory_order_relaxed);
+    while (value < min_value && !m_min.compare_exchange_weak(min_value, value, std::memory_order_relaxed))
+    {
+    }
+    uint64_t max_value = m_max.load(std::memory_order_relaxed);
+    while (value > max_value && !m_max.compare_exchange_weak(max_value, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::add_to(std::vector<uint64_t> & bucket_counts, uint64_t & count, uint64_t & sum, uint64_t & min_value, uint64_t & max_value) const
+{
+    bucket_counts.resize(bucket_count, 0);
+    for (size_t index = 0; index < bucket_count; ++index)
+    {
+        bucket_counts[index] += m_bucket_counts[index].load(std::memory_order_relaxed);
+    }
+    count += m_count.load(std::memory_order_relaxed);
+    sum += m_sum.load(std::memory_order_relaxed);
+    const uint64_t shard_min = m_min.load(std::memory_order_relaxed);
+    const uint64_t shard_max = m_max.load(std::memory_order_relaxed);
+    min_value = (shard_min < min_value ? shard_min : min_value);
+    max_value = (shard_max > max_value ? shard_max : max_value);
+}
+
+void LatencyHistogram::get_stats(const std::vector<uint64_t> & bucket_counts, uint64_t count, uint64_t sum, uint64_t min_value, uint64_t max_value, http_latency_stats_t & latency_stats)
+{
+    latency_stats = http_latency_stats_t();
+    if (0 == count)
+    {
+        return;
+    }
+    latency_stats.count = static_cast<size_t>(count);
+    latency_stats.min_time = static_cast<size_t>(min_value);
+    latency_stats.max_time = static_cast<size_t>(max_value);
+    latency_stats.mean_time = static_cast<size_t>(sum / count);
+
+    const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    size_t * percentile_times[] = { &latency_stats.p50_time, &latency_stats.p90_time, &latency_stats.p99_time, &latency_stats.p999_time };
+    uint64_t seen_count = 0;
+    size_t percentile_index = 0;
+    for (size_t bucket_index = 0; bucket_index < bucket_counts.size() && percentile_index < 4; ++bucket_index)
+    {
+        seen_count += bucket_counts[bucket_index];
+        while (percentile_index < 4 && static_cast<double>(seen_count) >= percentiles[percentile_index] * static_cast<double>(count))
+        {
+            uint64_t value = get_bucket_value(bucket_index);
+            value = (value < min_value ? min_value : value > max_value ? max_value : value);
+            *percentile_times[percentile_index++] = static_cast<size_t>(value);
+        }
+    }
+}
+
+LibcurlTransferMetrics::metrics_shard_t::metrics_shard_t()
+    : request_count(0)
+    , download_bytes(0)
+    , receive_time(0)
+    , latency_histograms()
+{
+
+}
+
+LibcurlTransferMetrics::LibcurlTransferMetrics()
+{
+    for (size_t index = 0; index < shard_count; ++index)
+    {
+        m_shards[index] = nullptr;
+    }
+}
+
+LibcurlTransferMetrics::~LibcurlTransferMetrics()
+{
+    for (size_t index = 0; index < shard_count; ++index)
+    {
+        delete m_shards[index].load();
+    }
+}
+
+void LibcurlTransferMetrics::reset()
+{
+    for (size_t index = 0; index < shard_count; ++index)
+    {
+        metrics_shard_t * shard = m_shards[index].load(std::memory_order_acquire);
+        if (nullptr == shard)
+        {
+            continue;
+        }
+        shard->request_count.store(0, std::memory_order_relaxed);
+        shard->download_bytes.store(0, std::memory_order_relaxed);
+        shard->receive_time.store(0, std::memory_order_relaxed);
+        for (size_t type = 0; type < latency_type_count; ++type)
+        {
+            shard->latency_histograms[type].reset();
+        }
+    }
+}
+
+LibcurlTransferMetrics::metrics_shard_t * LibcurlTransferMetrics::get_shard()
+{
+    static std::atomic<size_t> s_thread_count(0);
+    static thread_local size_t s_shard_index = s_thread_count.fetch_add(1, std::memory_order_relaxed) % shard_count;
+
+    metrics_shard_t * shard = m_shards[s_shard_index].load(std::memory_order_acquire);
+    if (nullptr == shard)
+    {
+        metrics_shard_t * new_shard = new metrics_shard_t;
+        if (m_shards[s_shard_index].compare_exchange_strong(shard, new_shard, std::memory_order_acq_rel))
+        {
+            shard = new_shard;
+        }
+        else
+        {
+            delete new_shard; /* another thread of this shard made it first */
+        }
+    }
+    return (shard);
+}
+
+void LibcurlTransferMetrics::record(CURL * curl, http_transfer_timing_t * transfer_timing)
+{
+    long status_code = 0;
+    if (CURLE_OK != curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code) || 0 == status_code)
+    {
+        return; /* no response, nothing to time */
+    }
+
+    uint64_t namelookup_time = 0;
+    uint64_t connect_time = 0;
+    uint64_t appconnect_time = 0;
+    uint64_t starttransfer_time = 0;
+    uint64_t total_time = 0;
+    uint64_t download_speed = 0;
+    uint64_t download_size = 0;
+
+#if LIBCURL_VERSION_NUM >= 0x073d00
+    curl_off_t value = 0;
+    namelookup_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+    connect_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+    appconnect_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+    starttransfer_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+    total_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+    download_speed = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+    download_size = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &value) && value > 0 ? static_cast<uint64_t>(value) : 0);
+#else
+    double value = 0.0;
+    namelookup_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &value) && value > 0.0 ? static_cast<uint64_t>(value * 1000000.0) : 0);
+    connect_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &value) && value > 0.0 ? static_cast<uint64_t>(value * 1000000.0) : 0);
+    appconnect_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &value) && value > 0.0 ? static_cast<uint64_t>(value * 1000000.0) : 0);
+    starttransfer_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &value) && value > 0.0 ? static_cast<uint64_t>(value * 1000000.0) : 0);
+    total_time = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &value) && value > 0.0 ? static_cast<uint64_t>(value * 1000000.0) : 0);
+    download_speed = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD, &value) && value > 0.0 ? static_cast<uint64_t>(value) : 0);
+    download_size = (CURLE_OK == curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &value) && value > 0.0 ? static_cast<uint64_t>(value) : 0);
+#endif // LIBCURL_VERSION_NUM >= 0x073d00
+
+    if (nullptr != transfer_timing)
+    {
+        transfer_timing->namelookup_time = static_cast<size_t>(namelookup_time);
+        transfer_timing->connect_time = static_cast<size_t>(connect_time);
+        transfer_timing->appconnect_time = static_cast<size_t>(appconnect_time);
+        transfer_timing->starttransfer_time = static_cast<size_t>(starttransfer_time);
+        transfer_timing->total_time = static_cast<size_t>(total_time);
+        transfer_timing->download_speed = static_cast<size_t>(download_speed);
+        transfer_timing->download_size = static_cast<size_t>(download_size);
+    }
+
+    /* the times curl gives are from the start of the transfer, these are the phases between them */
+    const uint64_t connected_time = (connect_time > namelookup_time ? connect_time : namelookup_time);
+    const uint64_t ready_time = (appconnect_time > connected_time ? appconnect_time : connected_time);
+    const uint64_t first_byte_time = (starttransfer_time > ready_time ? starttransfer_time : ready_time);
+    const uint64_t last_byte_time = (total_time > first_byte_time ? total_time : first_byte_time);
+
+    metrics_shard_t * shard = get_shard();
+    shard->request_count.fetch_add(1, std::memory_order_relaxed);
+    shard->download_bytes.fetch_add(download_size, std::memory_order_relaxed);
+    shard->receive_time.fetch_add(last_byte_time - first_byte_time, std::memory_order_relaxed);
+    shard->latency_histograms[latency_namelookup].record(namelookup_time);
+    shard->latency_histograms[latency_connect].record(connected_time - namelookup_time);
+    if (appconnect_time > 0)
+    {
+        shard->latency_histograms[latency_tls].record(ready_time - connected_time);
+    }
+    shard->latency_histograms[latency_first_byte].record(first_byte_time - ready_time);
+    shard->latency_histograms[latency_transfer].record(last_byte_time - first_byte_time);
+    shard->latency_histograms[latency_total].record(total_time);
+}
+
+void LibcurlTransferMetrics::get(http_client_metrics_t & metrics) const
+{
+    http_latency_stats_t * latency_stats[latency_type_count] = { &metrics.namelookup_latency, &metrics.connect_latency, &metrics.tls_latency, &metrics.first_byte_latency, &metrics.transfer_latency, &metrics.total_latency };
+    uint64_t request_count = 0;
+    uint64_t download_bytes = 0;
+    uint64_t receive_time = 0;
+
+    for (size_t type = 0; type < latency_type_count; ++type)
+    {
+        std::vector<uint64_t> bucket_counts(LatencyHistogram::bucket_count, 0);
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min_value = ~static_cast<uint64_t>(0);
+        uint64_t max_value = 0;
+        for (size_t index = 0; index < shard_count; ++index)
+        {
+            const metrics_shard_t * shard = m_shards[index].load(std::memory_order_acquire);
+            if (nullptr != shard)
+            {
+                shard->latency_histograms[type].add_to(bucket_counts, count, sum, min_value, max_value);
+            }
+        }
+        LatencyHistogram::get_stats(bucket_counts, count, sum, min_value, max_value, *latency_stats[type]);
+    }
+
+    for (size_t index = 0; index < shard_count; ++index)
+    {
+        const metrics_shard_t * shard = m_shards[index].load(std::memory_order_acquire);
+        if (nullptr != shard)
+        {
+            request_count += shard->request_count.load(std::memory_order_relaxed);
+            download_bytes += shard->download_bytes.load(std::memory_order_relaxed);
+            receive_time += shard->receive_time.load(std::memory_order_relaxed);
+        }
+    }
+
+    metrics.request_count = static_cast<size_t>(request_count);
+    metrics.download_bytes = static_cast<size_t>(download_bytes);
+    metrics.download_speed = static_cast<size_t>(receive_time > 0 ? download_bytes * 1000000 / receive_time : 0);
+}
+
+DownloadSchedulerMetrics::worker_t::worker_t()
+    : in_flight_count(0)
+    , completed_count(0)
+    , busy_begin_time(0)
+    , busy_time(0)
+{
+
+}
+
+DownloadSchedulerMetrics::DownloadSchedulerMetrics()
+    : m_worker_count(0)
+    , m_slot_count(0)
+    , m_init_time(0)
+    , m_workers()
+    , m_posted_count(0)
+    , m_duplicate_count(0)
+    , m_queue_histogram()
+    , m_first_byte_histogram()
+    , m_response_histogram()
+{
+
+}
+
+void DownloadSchedulerMetrics::init(size_t worker_count, size_t slot_count)
+{
+    m_worker_count = worker_count;
+    m_slot_count = slot_count;
+    m_init_time = get_monotonic_us();
+    m_workers.reset(worker_count > 0 ? new worker_t[worker_count] : nullptr);
+    m_posted_count = 0;
+    m_duplicate_count = 0;
+    m_queue_histogram.reset();
+    m_first_byte_histogram.reset();
+    m_response_histogram.reset();
+}
+
+void DownloadSchedulerMetrics::record_post(size_t count)
+{
+    m_posted_count.fetch_add(count, std::memory_order_relaxed);
+}
+
+void DownloadSchedulerMetrics::record_duplicate(size_t count)
+{
+    m_duplicate_count.fetch_add(count, std::memory_order_relaxed);
+}
+
+void DownloadSchedulerMetrics::begin_request(const download_request_status_t & download_request_status)
+{
+    m_queue_histogram.record(static_cast<uint64_t>(download_request_status.dispatch_time - download_request_status.enqueue_time));
+
+    worker_t & worker = m_workers[download_request_status.worker_index];
+    if (0 == worker.in_flight_count.fetch_add(1, std::memory_order_acq_rel))
+    {
+        worker.busy_begin_time.store(download_request_status.dispatch_time, std::memory_order_relaxed);
+    }
+}
+
+void DownloadSchedulerMetrics::end_request(const download_request_status_t & download_request_status)
+{
+    const int64_t response_time = get_monotonic_us();
+    if (download_request_status.first_byte_time > 0)
+    {
+        m_first_byte_histogram.record(static_cast<uint64_t>(download_request_status.first_byte_time - download_request_status.dispatch_time));
+    }
+    m_response_histogram.record(static_cast<uint64_t>(response_time - download_request_status.dispatch_time));
+
+    worker_t & worker = m_workers[download_request_status.worker_index];
+    const int64_t busy_begin_time = worker.busy_begin_time.load(std::memory_order_relaxed); /* stable while this request is in flight */
+    worker.completed_count.fetch_add(1, std::memory_order_relaxed);
+    if (1 == worker.in_flight_count.fetch_sub(1, std::memory_order_acq_rel))
+    {
+        worker.busy_time.fetch_add(response_time - busy_begin_time, std::memory_order_relaxed);
+    }
+}
+
+void DownloadSchedulerMetrics::get(http_client_metrics_t & metrics) const
+{
+    metrics.posted_count = m_posted_count.load(std::memory_order_relaxed);
+    metrics.duplicate_count = m_duplicate_count.load(std::memory_order_relaxed);
+    metrics.worker_count = m_worker_count;
+    metrics.in_flight_count = 0;
+    for (size_t index = 0; index < m_worker_count; ++index)
+    {
+        metrics.in_flight_count += m_workers[index].in_flight_count.load(std::memory_order_acquire);
+    }
+
+    const LatencyHistogram * latency_histograms[] = { &m_queue_histogram, &m_first_byte_histogram, &m_response_histogram };
+    http_latency_stats_t * latency_stats[] = { &metrics.queue_latency, &metrics.dispatch_first_byte_latency, &metrics.dispatch_response_latency };
+    for (size_t type = 0; type < 3; ++type)
+    {
+        std::vector<uint64_t> bucket_counts(LatencyHistogram::bucket_count, 0);
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min_value = ~static_cast<uint64_t>(0);
+        uint64_t max_value = 0;
+        latency_histograms[type]->add_to(bucket_counts, count, sum, min_value, max_value);
+        LatencyHistogram::get_stats(bucket_counts, count, sum, min_value, max_value, *latency_stats[type]);
+    }
+}
+
+bool DownloadSchedulerMetrics::get_worker(size_t worker_index, http_client_worker_stats_t & worker_stats) const
+{
+    if (worker_index >= m_worker_count)
+    {
+        return false;
+    }
+
+    const worker_t & worker = m_workers[worker_index];
+    const int64_t current_time = get_monotonic_us();
+    worker_stats.slot_count = (m_slot_count + m_worker_count - 1 - worker_index) / m_worker_count; /* slot i belongs to worker i % worker count */
+    worker_stats.in_flight_count = worker.in_flight_count.load(std::memory_order_acquire);
+    worker_stats.completed_count = worker.completed_count.load(std::memory_order_relaxed);
+    int64_t busy_time = worker.busy_time.load(std::memory_order_relaxed);
+    if (worker_stats.in_flight_count > 0)
+    {
+        busy_time += current_time - worker.busy_begin_time.load(std::memory_order_relaxed); /* the spell going on */
+    }
+    worker_stats.busy_time = static_cast<size_t>(busy_time > 0 ? busy_time : 0);
+    worker_stats.up_time = static_cast<size_t>(current_time - m_init_time);
+    return true;
+}
+
+static void libcurl_share_lock_callback(CURL * curl, curl_lock_data data, curl_lock_access access, void * user_data)
+{
+    std::mutex * share_mutex_array = reinterpret_cast<std::mutex *>(user_data);
+    if (nullptr != share_mutex_array && data >= 0 && data < CURL_LOCK_DATA_LAST)
+    {
+        share_mutex_array[data].lock();
+    }
+}
+
+static void libcurl_share_unlock_callback(CURL * curl, curl_lock_data data, void * user_data)
+{
+    std::mutex * share_mutex_array = reinterpret_cast<std::mutex *>(user_data);
+    if (nullptr != share_mutex_array && data >= 0 && data < CURL_LOCK_DATA_LAST)
+    {
+        share_mutex_array[data].unlock();
+    }
+}
+
+HttpClient::HttpClient()
+    : m_share_handle(nullptr)
+    , m_share_mutex_array()
+    , m_connection_stats()
+    , m_transfer_metrics()
+    , m_scheduler_metrics()
+    , m_is_running(false)
+    , m_engine_mode(http_client_engine_t::engine_blocking_downloader)
+    , m_max_downloader_count(0)
+    , m_max_segment_count(1)
+    , m_min_segment_size(0)
+    , m_max_unzip_thread_count(1)
+    , m_download_request_map()
+    , m_download_request_map_locker()
+    , m_download_request_queue()
+    , m_handle_pool()
+    , m_download_request_status_vector()
+#ifdef __linux__
+    , m_event_wakeup_fd_vector()
+#endif // __linux__
+    , m_event_transfer_queue()
+    , m_download_thread_group()
+    , m_completion_thread_group()
+{
+
+}
+
+HttpClient::~HttpClient()
+{
+    exit();
+}
+
+bool HttpClient::init(size_t max_downloader_count)
+{
+    http_client_option_t client_option;
+    client_option.engine_mode = http_client_engine_t::engine_blocking_downloader;
+    client_option.max_downloader_count = max_downloader_count;
+    return init(client_option);
+}
+
+bool HttpClient::init(const http_client_option_t & client_option)
+{
+    exit();
+
+    do
+    {
+        m_is_running = true;
+
+        RUN_LOG_INF("[http_client] init begin");
+
+        const size_t max_downloader_count = client_option.max_downloader_count;
+        if (0 == max_downloader_count)
+        {
+            RUN_LOG_WAR("[http_client] init warning: max downloader count is zero (means: can not download asynchronously)");
+        }
+
+        size_t download_request_status_count = max_downloader_count;
+        thread_return_t (STUPID_STDCALL * thread_run)(thread_argument_t) = download_thread_run;
+        if (http_client_engine_t::engine_event_driven == client_option.engine_mode)
+        {
+            if (client_option.max_in_flight_count < max_downloader_count)
+            {
+                RUN_LOG_WAR("[http_client] init warning: max in flight count (%u) is less than event loop count (%u)", client_option.max_in_flight_count, max_downloader_count);
+            }
+            else if (max_downloader_count > 0) /* without event loops there is nothing to hold transfers */
+            {
+                download_request_status_count = client_option.max_in_flight_count;
+            }
+            thread_run = event_loop_thread_run;
+        }
+        else if (http_client_engine_t::engine_blocking_downloader != client_option.engine_mode)
+        {
+            RUN_LOG_CRI("[http_client] init failure: engine mode (%u) is invalid", client_option.engine_mode);
+            break;
+        }
+
+        if (http_client_engine_t::engine_event_driven == client_option.engine_mode && client_option.max_segment_count > 1)
+        {
+            RUN_LOG_WAR("[http_client] init warning: segmented download is not supported by event driven engine");
+        }
+
+        m_engine_mode = client_option.engine_mode;
+        m_max_downloader_count = max_downloader_count;
+        m_max_segment_count = client_option.max_segment_count;
+        m_min_segment_size = client_option.min_segment_size;
+        m_max_unzip_thread_count = client_option.max_unzip_thread_count;
+
+        if ('\0' != client_option.digest_index_pathname[0])
+        {
+            if (!m_digest_index.load(client_option.digest_index_pathname))
+            {
+                RUN_LOG_WAR("[http_client] init warning: digest index (%s) is broken, it will be rebuilt", client_option.digest_index_pathname);
+            }
+            RUN_LOG_INF("[http_client] digest index (%s) has %u files", client_option.digest_index_pathname, m_digest_index.size());
+        }
+
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+
+        m_share_handle = curl_share_init();
+        if (nullptr == m_share_handle)
+        {
+            RUN_LOG_CRI("[http_client] init failure: curl_share_init failure");
+            break;
+        }
+
+        curl_share_setopt(m_share_handle, CURLSHOPT_LOCKFUNC, libcurl_share_lock_callback);
+        curl_share_setopt(m_share_handle, CURLSHOPT_UNLOCKFUNC, libcurl_share_unlock_callback);
+        curl_share_setopt(m_share_handle, CURLSHOPT_USERDATA, reinterpret_cast<void *>(m_share_mutex_array));
+
+        curl_share_setopt(m_share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+
+        if (CURLSHE_OK != curl_share_setopt(m_share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION))
+        {
+            RUN_LOG_WAR("[http_client] init warning: libcurl can not share ssl session");
+        }
+
+        bool share_connection_cache = false;
+        if (client_option.share_connection_cache)
+        {
+#if LIBCURL_VERSION_NUM >= 0x073900
+            share_connection_cache = (CURLSHE_OK == curl_share_setopt(m_share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT));
+            if (!share_connection_cache)
+            {
+                RUN_LOG_WAR("[http_client] init warning: libcurl can not share connection cache");
+            }
+#else
+            RUN_LOG_WAR("[http_client] init warning: libcurl is too old to share connection cache");
+#endif // LIBCURL_VERSION_NUM >= 0x073900
+        }
+
+        m_connection_stats.reset();
+        m_transfer_metrics.reset();
+
+        m_handle_pool.init(client_option.connection_idle_timeout, client_option.max_host_connection_count, share_connection_cache);
+
+        m_download_request_status_vector.resize(download_request_status_count);
+        for (size_t index = 0; index < download_request_status_count; ++index)
+        {
+            m_download_request_status_vector[index].slot_index = index;
+            m_download_request_status_vector[index].worker_index = (max_downloader_count > 0 ? index % max_downloader_count : 0); /* how event loops share the slots */
+        }
+
+        m_scheduler_metrics.init(max_downloader_count, download_request_status_count);
+
+        m_download_request_queue.open();
+
+#ifdef __linux__
+        if (http_client_engine_t::engine_event_driven == m_engine_mode)
+        {
+            for (size_t index = 0; index < max_downloader_count; ++index)
+            {
+                const int wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (wakeup_fd < 0)
+                {
+                    RUN_LOG_CRI("[http_client] init failure: create event loop %u wakeup eventfd failure (%d)", index, errno);
+                    break;
+                }
+                m_event_wakeup_fd_vector.push_back(wakeup_fd);
+            }
+            if (m_event_wakeup_fd_vector.size() != max_downloader_count)
+            {
+                break;
+            }
+        }
+#endif // __linux__
+
+        if (http_client_engine_t::engine_event_driven == m_engine_mode)
+        {
+            m_event_transfer_queue.open();
+            for (size_t index = 0; index < max_downloader_count; ++index)
+            {
+                http_thread_param_t * thread_param = new http_thread_param_t(*this, index);
+                if (nullptr == thread_param)
+                {
+                    RUN_LOG_CRI("[http_client] init failure: create completion thread %u parameter failure", index);
+                    break;
+                }
+                if (!m_completion_thread_group.acquire_thread(event_completion_thread_run, thread_param))
+                {
+                    RUN_LOG_CRI("[http_client] init failure: acquire completion thread %u failure", index);
+                    delete thread_param;
+                    break;
+                }
+            }
+            if (m_completion_thread_group.size() != max_downloader_count)
+            {
+                break;
+            }
+        }
+
+        for (size_t index = 0; index < max_downloader_count; ++index)
+        {
             http_thread_param_t * thread_param = new http_thread_param_t(*this, index);
             if (nullptr == thread_param)
             {
-                RUN_LOG("[http_client] init failure: create download thread %u parameter failure", index);
+                RUN_LOG_CRI("[http_client] init failure: create download thread %u parameter failure", index);
+                break;
+            }
+            if (!m_download_thread_group.acquire_thread(thread_run, thread_param))
+            {
+                RUN_LOG_CRI("[http_client] init failure: acquire download thread %u failure", index);
+                delete thread_param;
+                break;
+            }
+        }
+        if (m_download_thread_group.size() != max_downloader_count)
+        {
+            break;
+        }
+
+        RUN_LOG_INF("[http_client] init success");
+
+        return true;
+    } while (false);
+
+    exit();
+
+    return false;
+}
+
+void HttpClient::exit()
+{
+    if (m_is_running)
+    {
+        RUN_LOG_INF("[http_client] exit begin");
+        clear();
+        RUN_LOG_INF("[http_client] exit end");
+    }
+
+    /* the log flusher is joined here, not by the destructor of s_run_logger, which runs under the loader lock in a dll */
+    s_run_logger.stop();
+}
+
+void HttpClient::clear()
+{
+    m_is_running = false;
+
+    for (download_request_status_vector_t::iterator iter = m_download_request_status_vector.begin(); m_download_request_status_vector.end() != iter; ++iter)
+    {
+        iter->been_stopped = true;
+    }
+
+    m_download_request_queue.close();
+
+    wake_event_loops();
+
+    m_download_thread_group.release_threads();
+
+    m_event_transfer_queue.close(); /* the event loops have got back every transfer they handed out */
+
+    m_completion_thread_group.release_threads();
+
+    {
+        std::vector<http_data_request_t> data_requests;
+        m_download_request_queue.clear(data_requests);
+        for (std::vector<http_data_request_t>::const_iterator iter = data_requests.begin(); data_requests.end() != iter; ++iter)
+        {
+            answer_stopped_data_request(*iter);
+        }
+    }
+
+    if (!m_digest_index.save())
+    {
+        RUN_LOG_WAR("[http_client] exit warning: save digest index failure");
+    }
+    m_digest_index.clear();
+
+    m_handle_pool.clear(); /* easy handles must go before the share handle they use */
+
+#ifdef __linux__
+    for (std::vector<int>::iterator iter = m_event_wakeup_fd_vector.begin(); m_event_wakeup_fd_vector.end() != iter; ++iter)
+    {
+        close(*iter);
+    }
+    m_event_wakeup_fd_vector.clear();
+#endif // __linux__
+
+    curl_share_cleanup(m_share_handle);
+    m_share_handle = nullptr;
+
+    curl_global_cleanup();
+
+    m_download_request_status_vector.clear();
+
+    {
+        thread_locker_guard_t map_guard(m_download_request_map_locker);
+        m_download_request_map.clear();
+    }
+}
+
+void HttpClient::post_download_request(const http_download_request_t & download_request)
+{
+    if (!m_is_running)
+    {
+        RUN_LOG_ERR("post_download_request failed, http_client is exit");
+        return;
+    }
+
+    if (0 == m_download_thread_group.size())
+    {
+        RUN_LOG_ERR("post_download_request failed, can not download asynchronously");
+        return;
+    }
+
+    if ('\0' == download_request.url_request[0] || '\0' == download_request.save_pathname[0])
+    {
+        RUN_LOG_ERR("post download request[url request:%s, save pathname:%s] failure, url request and save pathname must not be empty", download_request.url_request, download_request.save_pathname);
+        return;
+    }
+
+    if (skip_unchanged_download(download_request))
+    {
+        return;
+    }
+
+    {
+        thread_locker_guard_t map_guard(m_download_request_map_locker);
+        if (!m_download_request_map.insert(std::make_pair(get_download_request_key(download_request), no_slot_index)).second)
+        {
+            m_scheduler_metrics.record_duplicate(1);
+            RUN_LOG_WAR("post download request[url request:%s, save pathname:%s] ignored, it is queued or downloading", download_request.url_request, download_request.save_pathname);
+            return;
+        }
+    }
+
+    m_scheduler_metrics.record_post(1);
+
+    m_download_request_queue.push(download_request);
+
+    wake_event_loops();
+
+    RUN_LOG_DBG("post download request[url request:%s, save pathname:%s] success", download_request.url_request, download_request.save_pathname);
+}
+
+size_t HttpClient::post_download_requests(const http_download_request_t * download_requests, size_t download_request_count)
+{
+    if (!m_is_running)
+    {
+        RUN_LOG_ERR("post_download_requests failed, http_client is exit");
+        return 0;
+    }
+
+    if (0 == m_download_thread_group.size())
+    {
+        RUN_LOG_ERR("post_download_requests failed, can not download asynchronously");
+        return 0;
+    }
+
+    if (nullptr == download_requests || 0 == download_request_count)
+    {
+        return 0;
+    }
+
+    size_t invalid_count = 0;
+    size_t unchanged_count = 0;
+    std::vector<const http_download_request_t *> candidate_requests;
+    candidate_requests.reserve(download_request_count);
+    for (size_t index = 0; index < download_request_count; ++index)
+    {
+        const http_download_request_t & download_request = download_requests[index];
+        if ('\0' == download_request.url_request[0] || '\0' == download_request.save_pathname[0])
+        {
+            ++invalid_count;
+        }
+        else if (skip_unchanged_download(download_request))
+        {
+            ++unchanged_count;
+        }
+        else
+        {
+            candidate_requests.push_back(&download_request);
+        }
+    }
+
+    std::vector<std::string> candidate_keys;
+    candidate_keys.reserve(candidate_requests.size());
+    for (std::vector<const http_download_request_t *>::const_iterator iter = candidate_requests.begin(); candidate_requests.end() != iter; ++iter)
+    {
+        candidate_keys.push_back(get_download_request_key(**iter));
+    }
+
+    /* one pass under the map lock, a request is a duplicate if its url is downloading, queued, or earlier in the batch */
+    std::vector<const http_download_request_t *> accepted_requests;
+    accepted_requests.reserve(candidate_requests.size());
+    {
+        thread_locker_guard_t map_guard(m_download_request_map_locker);
+        m_download_request_map.reserve(m_download_request_map.size() + candidate_keys.size());
+        for (size_t index = 0; index < candidate_requests.size(); ++index)
+        {
+            if (m_download_request_map.insert(std::make_pair(std::move(candidate_keys[index]), no_slot_index)).second)
+            {
+                accepted_requests.push_back(candidate_requests[index]);
+            }
+        }
+    }
+
+    const size_t duplicate_count = candidate_requests.size() - accepted_requests.size();
+    m_scheduler_metrics.record_duplicate(duplicate_count);
+    m_scheduler_metrics.record_post(accepted_requests.size());
+
+    if (!accepted_requests.empty())
+    {
+        m_download_request_queue.push(accepted_requests);
+        wake_event_loops();
+    }
+
+    if (0 == invalid_count && 0 == duplicate_count)
+    {
+        RUN_LOG_DBG("post download requests (%u): (%u) queued, (%u) unchanged", download_request_count, accepted_requests.size(), unchanged_count);
+    }
+    else if (0 == invalid_count)
+    {
+        RUN_LOG_WAR("post download requests (%u): (%u) queued, (%u) unchanged, (%u) duplicate", download_request_count, accepted_requests.size(), unchanged_count, duplicate_count);
+    }
+    else
+    {
+        RUN_LOG_ERR("post download requests (%u): (%u) queued, (%u) unchanged, (%u) duplicate, (%u) invalid", download_request_count, accepted_requests.size(), unchanged_count, duplicate_count, invalid_count);
+    }
+
+    return (accepted_requests.size() + unchanged_count);
+}
+
+void HttpClient::stop_download_request(const http_download_request_t & download_request)
+{
+    if (!m_is_running)
+    {
+        RUN_LOG_ERR("stop_download_request failed, http_client is exit");
+        return;
+    }
+
+    if (0 == m_download_thread_group.size())
+    {
+        RUN_LOG_ERR("stop_download_request failed, can not download asynchronously");
+        return;
+    }
+
+    RUN_LOG_DBG("stop download request[url request:%s, save pathname:%s] begin", download_request.url_request, download_request.save_pathname);
+
+    m_download_request_queue.remove(download_request);
+
+    {
+        thread_locker_guard_t map_guard(m_download_request_map_locker);
+        download_request_map_t::iterator iter = m_download_request_map.find(get_download_request_key(download_request));
+        if (m_download_request_map.end() != iter)
+        {
+            if (no_slot_index != iter->second)
+            {
+                m_download_request_status_vector[iter->second].been_stopped = true; /* the slot is not reused before the download leaves the map */
+            }
+            m_download_request_map.erase(iter);
+        }
+    }
+
+    wake_event_loops();
+
+    RUN_LOG_DBG("stop download request[url request:%s, save pathname:%s] end", download_request.url_request, download_request.save_pathname);
+}
+
+static void libcurl_get_file_size_setopt(CURL * curl, CURLSH * share_handle, const char * url_request)
+{
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
+    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L); /* headers in the body went to stdout, as there is no write function */
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_URL, url_request);
+}
+
+static bool libcurl_get_file_size_result(CURL * curl, CURLcode curl_code, const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code)
+{
+    file_size = 0;
+
+    if (CURLE_OK != curl_code)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_perform(get_file_size) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
+        return false;
+    }
+
+    double content_length = 0.0;
+    curl_code = curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &content_length);
+    if (CURLE_OK != curl_code)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_libcurl_getinfo_failure;
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_getinfo(get_file_size) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
+        return false;
+    }
+
+    url_status_code = 200;
+    url_error_code = http_response_callback_error_t::callback_message_response_success;
+    file_size = static_cast<size_t>(content_length);
+    return true;
+}
+
+static bool libcurl_get_file_size(CURL * curl, CURLSH * share_handle, const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code)
+{
+    libcurl_get_file_size_setopt(curl, share_handle, url_request);
+
+    return libcurl_get_file_size_result(curl, curl_easy_perform(curl), url_request, file_size, url_status_code, url_error_code);
+}
+
+bool HttpClient::get_file_size(const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code)
+{
+    if (!m_is_running)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+        RUN_LOG_ERR("get_file_size failed, http_client is exit");
+        return false;
+    }
+
+    if (nullptr == url_request)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
+        RUN_LOG_ERR("get_file_size failed, url_request is nullptr");
+        return false;
+    }
+
+    CURL * curl = m_handle_pool.acquire(url_request);
+    if (nullptr == curl)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
+        RUN_LOG_ERR("curl_easy_init(get_file_size) failed, when get url (%s)", url_request);
+        return false;
+    }
+
+    m_connection_stats.attach(curl);
+
+    libcurl_get_file_size(curl, m_share_handle, url_request, file_size, url_status_code, url_error_code);
+
+    m_connection_stats.record(curl);
+    m_transfer_metrics.record(curl, nullptr);
+
+    m_handle_pool.release(url_request, curl);
+
+    return http_response_callback_error_t::callback_message_response_success == url_error_code;
+}
+
+struct get_data_userdata_t
+{
+    get_data_userdata_t(storage_callback_t callback, void * buffer);
+
+    storage_callback_t      storage_callback;
+    void                  * storage_buffer;
+};
+
+get_data_userdata_t::get_data_userdata_t(storage_callback_t callback, void * buffer)
+    : storage_callback(callback)
+    , storage_buffer(buffer)
+{
+
+}
+
+static size_t libcurl_get_data_callback(void * ptr, size_t size, size_t nmemb, void * user_data)
+{
+    get_data_userdata_t * get_data_userdata = reinterpret_cast<get_data_userdata_t *>(user_data);
+    if (nullptr == get_data_userdata || nullptr == get_data_userdata->storage_callback || nullptr == get_data_userdata->storage_buffer)
+    {
+        return 0; /* tell libcurl to stop get_data */
+    }
+    const size_t recv_len = size * nmemb;
+    const char * data = reinterpret_cast<char *>(ptr);
+    if (!get_data_userdata->storage_callback(data, recv_len, get_data_userdata->storage_buffer))
+    {
+        return 0; /* tell libcurl to stop get_data */
+    }
+    return recv_len;
+}
+
+static void libcurl_get_data_setopt(CURL * curl, CURLSH * share_handle, const char * url_request, get_data_userdata_t & get_data_userdata)
+{
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
+    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 5L);
+    curl_easy_setopt(curl, CURLOPT_URL, url_request);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, libcurl_get_data_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, reinterpret_cast<void *>(&get_data_userdata));
+}
+
+static bool libcurl_get_data_result(CURL * curl, CURLcode curl_code, const char * url_request, size_t & url_status_code, size_t & url_error_code)
+{
+    if (CURLE_OK != curl_code)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_perform(get_data) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
+        return false;
+    }
+
+    long status_code = 0;
+
+    curl_code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+    if (CURLE_OK != curl_code)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_libcurl_getinfo_failure;
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_getinfo(get_data) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
+        return false;
+    }
+
+    url_status_code = status_code;
+
+    if (200L == status_code)
+    {
+        url_error_code = http_response_callback_error_t::callback_message_response_success;
+        RUN_LOG_DBG("libcurl_get_data success, when get url (%s)", url_request);
+        return true;
+    }
+
+    switch (status_code / 100)
+    {
+        case 2:
+        {
+            url_error_code = http_response_callback_error_t::callback_message_response_2xx_failure;
+            break;
+        }
+        case 3:
+        {
+            url_error_code = http_response_callback_error_t::callback_message_response_3xx_failure;
+            break;
+        }
+        case 4:
+        {
+            url_error_code = http_response_callback_error_t::callback_message_response_4xx_failure;
+            break;
+        }
+        case 5:
+        {
+            url_error_code = http_response_callback_error_t::callback_message_response_5xx_failure;
+            break;
+        }
+        default:
+        {
+            url_error_code = http_response_callback_error_t::callback_message_response_xxx_failure;
+            break;
+        }
+    }
+
+    RUN_LOG_ERR("curl_easy_getinfo(get_data) status code (%d), when get url (%s)", status_code, url_request);
+
+    return false;
+}
+
+static bool libcurl_get_data(CURL * curl, CURLSH * share_handle, const char * url_request, storage_callback_t storage_callback, void * storage_buffer, size_t & url_status_code, size_t & url_error_code)
+{
+    get_data_userdata_t get_data_userdata(storage_callback, storage_buffer);
+
+    libcurl_get_data_setopt(curl, share_handle, url_request, get_data_userdata);
+
+    return libcurl_get_data_result(curl, curl_easy_perform(curl), url_request, url_status_code, url_error_code);
+}
+
+bool HttpClient::get_data(const char * url_request, storage_callback_t storage_callback, void * storage_buffer, size_t & url_status_code, size_t & url_error_code)
+{
+    if (!m_is_running)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+        RUN_LOG_ERR("get_data failed, http_client is exit");
+        return false;
+    }
+
+    if (nullptr == url_request)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
+        RUN_LOG_ERR("get_data failed, url_request is nullptr");
+        return false;
+    }
+
+    if (nullptr == storage_callback)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
+        RUN_LOG_ERR("get_data failed, storage_callback is nullptr");
+        return false;
+    }
+
+    if (nullptr == storage_buffer)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
+        RUN_LOG_ERR("get_data failed, storage_buffer is nullptr");
+        return false;
+    }
+
+    CURL * curl = m_handle_pool.acquire(url_request);
+    if (nullptr == curl)
+    {
+        url_status_code = 0;
+        url_error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
+        RUN_LOG_ERR("curl_easy_init(get_data) failed, when get url (%s)", url_request);
+        return false;
+    }
+
+    m_connection_stats.attach(curl);
+
+    libcurl_get_data(curl, m_share_handle, url_request, storage_callback, storage_buffer, url_status_code, url_error_code);
+
+    m_connection_stats.record(curl);
+    m_transfer_metrics.record(curl, nullptr);
+
+    m_handle_pool.release(url_request, curl);
+
+    return http_response_callback_error_t::callback_message_response_success == url_error_code;
+}
+
+void HttpClient::get_connection_stats(http_client_connection_stats_t & connection_stats)
+{
+    m_connection_stats.get(connection_stats);
+}
+
+void HttpClient::get_metrics(http_client_metrics_t & metrics)
+{
+    m_transfer_metrics.get(metrics);
+    m_scheduler_metrics.get(metrics);
+    metrics.queue_length = m_download_request_queue.size();
+}
+
+bool HttpClient::get_worker_stats(size_t worker_index, http_client_worker_stats_t & worker_stats)
+{
+    return (m_scheduler_metrics.get_worker(worker_index, worker_stats));
+}
+
+static bool get_data_storage(const char * data, size_t data_len, void * storage)
+{
+    std::string * buffer = reinterpret_cast<std::string *>(storage);
+    if (nullptr == buffer)
+    {
+        return false;
+    }
+    buffer->append(data, data_len);
+    return true;
+}
+
+bool HttpClient::post_data_request(const http_data_request_t & data_request)
+{
+    if (!m_is_running)
+    {
+        RUN_LOG_ERR("post_data_request failed, http_client is exit");
+        return false;
+    }
+
+    if (0 == m_download_thread_group.size())
+    {
+        RUN_LOG_ERR("post_data_request failed, can not download asynchronously");
+        return false;
+    }
+
+    if (nullptr == data_request.data_sink || '\0' == data_request.url_request[0])
+    {
+        RUN_LOG_ERR("post_data_request failed, data_sink or url_request is empty");
+        return false;
+    }
+
+    if (http_data_request_type_t::request_get_data != data_request.request_type && http_data_request_type_t::request_get_file_size != data_request.request_type)
+    {
+        RUN_LOG_ERR("post_data_request failed, request type (%u) is invalid", data_request.request_type);
+        return false;
+    }
+
+    if (nullptr != data_request.storage_callback && nullptr == data_request.storage_buffer)
+    {
+        RUN_LOG_ERR("post_data_request failed, storage_buffer is nullptr");
+        return false;
+    }
+
+    m_scheduler_metrics.record_post(1);
+
+    m_download_request_queue.push(data_request);
+
+    wake_event_loops();
+
+    RUN_LOG_DBG("post data request[url request:%s] success", data_request.url_request);
+
+    return true;
+}
+
+static void init_data_callback_info(const http_data_request_t & data_request, http_data_callback_info_t & callback_info)
+{
+    callback_info = http_data_callback_info_t();
+    callback_info.request_type = data_request.request_type;
+    callback_info.user_data = data_request.user_data;
+    strncpy(callback_info.url_request, data_request.url_request, sizeof(callback_info.url_request));
+}
+
+static bool need_check_message_digest(const http_download_request_t & download_request)
+{
+    return '\0' != download_request.hash_request[0] && '\0' != download_request.message_digest[0] && http_digest_check_t::check_by_hash_request == download_request.digest_check_mode;
+}
+
+static bool need_check_local_message_digest(const http_download_request_t & download_request)
+{
+    return '\0' != download_request.message_digest[0] && http_digest_check_t::check_by_local_file == download_request.digest_check_mode;
+}
+
+static bool update_file_message_digest(const char * pathname, MessageDigest & message_digest)
+{
+    std::ifstream ifs(pathname, std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+
+    char buffer[64 * 1024];
+    while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount() > 0)
+    {
+        message_digest.update(buffer, static_cast<size_t>(ifs.gcount()));
+    }
+
+    return ifs.eof();
+}
+
+static bool get_file_message_digest(const char * pathname, MessageDigest::digest_type_t digest_type, std::string & digest)
+{
+    MessageDigest message_digest;
+    if (!message_digest.init(digest_type) || !update_file_message_digest(pathname, message_digest))
+    {
+        return false;
+    }
+    digest = message_digest.final();
+    return true;
+}
+
+/* the leading hex word of a hash response, empty if it is not a digest of a known kind */
+static std::string get_response_message_digest(const std::string & storage_buffer)
+{
+    std::string::size_type digest_size = 0;
+    while (digest_size < storage_buffer.size() && isxdigit(static_cast<unsigned char>(storage_buffer[digest_size])))
+    {
+        ++digest_size;
+    }
+    if (MessageDigest::digest_none == MessageDigest::get_type_by_hex_size(digest_size))
+    {
+        return std::string();
+    }
+    return storage_buffer.substr(0, digest_size);
+}
+
+static bool match_message_digest(const std::string & digest, const http_download_request_t & download_request)
+{
+    return digest.size() == strlen(download_request.message_digest) && 0 == Stupid::Base::stupid_strncmp_ignore_case(digest.c_str(), download_request.message_digest, digest.size());
+}
+
+/* returns false if local file already matches message_digest, so the download is skipped without any request */
+static bool check_local_message_digest(DigestIndex & digest_index, const http_download_request_t & download_request, http_response_callback_info_t & callback_info)
+{
+    const MessageDigest::digest_type_t digest_type = MessageDigest::get_type_by_hex_size(strlen(download_request.message_digest));
+    std::string local_digest;
+    if (MessageDigest::digest_none == digest_type)
+    {
+        return true;
+    }
+    if (!digest_index.find(download_request.save_pathname, local_digest) || MessageDigest::get_type_by_hex_size(local_digest.size()) != digest_type)
+    {
+        if (!get_file_message_digest(download_request.save_pathname, digest_type, local_digest))
+        {
+            return true;
+        }
+        digest_index.update(download_request.save_pathname, local_digest);
+    }
+
+    if (match_message_digest(local_digest, download_request))
+    {
+        callback_info.status_code = 200;
+        callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
+        RUN_LOG_DBG("check local message digest success (need not update), when get url (%s)", download_request.url_request);
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_message_digest(const http_download_request_t & download_request, const std::string & storage_buffer, http_response_callback_info_t & callback_info)
+{
+    const size_t digest_size = strlen(download_request.message_digest);
+    if (storage_buffer.size() < digest_size || std::string::npos != storage_buffer.substr(0, digest_size).find('<'))
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_response_4xx_failure;
+        RUN_LOG_ERR("get_data(message_digest) failure, message_digest is invalid, when get url (%s)", download_request.hash_request);
+        return false;
+    }
+    else if (0 == Stupid::Base::stupid_strncmp_ignore_case(storage_buffer.c_str(), download_request.message_digest, digest_size))
+    {
+        callback_info.status_code = 200;
+        callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
+        RUN_LOG_DBG("get_data(message_digest) success (need not update), when get url (%s)", download_request.hash_request);
+        return false;
+    }
+
+    return true;
+}
+
+static bool libcurl_check_need_download(CURL * curl, CURLSH * share_handle, DigestIndex & digest_index, download_request_status_t & download_request_status, std::string & expected_digest, http_response_callback_info_t & callback_info)
+{
+    http_download_request_t & download_request = download_request_status.download_request;
+
+    expected_digest.clear();
+
+    if (need_check_local_message_digest(download_request))
+    {
+        expected_digest = download_request.message_digest;
+        return check_local_message_digest(digest_index, download_request, callback_info);
+    }
+
+    if (!need_check_message_digest(download_request))
+    {
+        return true;
+    }
+
+    std::string storage_buffer;
+    if (!libcurl_get_data(curl, share_handle, download_request.hash_request, get_data_storage, reinterpret_cast<void *>(&storage_buffer), callback_info.status_code, callback_info.error_code))
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_get_message_digest_failure;
+        RUN_LOG_ERR("get_data(message_digest) failure, when get url (%s)", download_request.hash_request);
+        return false;
+    }
+
+    if (!check_message_digest(download_request, storage_buffer, callback_info))
+    {
+        return false;
+    }
+
+    expected_digest = get_response_message_digest(storage_buffer);
+
+    return true;
+}
+
+class SaveFile
+{
+public:
+    SaveFile();
+    ~SaveFile();
+
+public:
+    bool open(const char * pathname); /* keeps the old content, writes go to the end */
+    void close();
+    bool truncate();
+    bool write(const char * data, size_t data_len);
+    uint64_t size() const;
+
+public:
+    bool allocate(uint64_t file_size); /* drops the old content */
+    bool write_at(uint64_t offset, const char * data, size_t data_len);
+
+private:
+    SaveFile(const SaveFile &);
+    SaveFile & operator = (const SaveFile &);
+
+private:
+#ifdef _MSC_VER
+    HANDLE                      m_file;
+#else
+    int                         m_file;
+#endif // _MSC_VER
+    uint64_t                    m_size;
+};
+
+#ifdef _MSC_VER
+SaveFile::SaveFile()
+    : m_file(INVALID_HANDLE_VALUE)
+    , m_size(0)
+{
+
+}
+
+bool SaveFile::open(const char * pathname)
+{
+    close();
+
+    m_file = CreateFileA(pathname, GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == m_file)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    LARGE_INTEGER zero_offset;
+    zero_offset.QuadPart = 0;
+    if (!GetFileSizeEx(m_file, &file_size) || !SetFilePointerEx(m_file, zero_offset, nullptr, FILE_END))
+    {
+        close();
+        return false;
+    }
+    m_size = static_cast<uint64_t>(file_size.QuadPart);
+
+    return true;
+}
+
+void SaveFile::close()
+{
+    if (INVALID_HANDLE_VALUE != m_file)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_size = 0;
+}
+
+bool SaveFile::truncate()
+{
+    LARGE_INTEGER zero_offset;
+    zero_offset.QuadPart = 0;
+    if (INVALID_HANDLE_VALUE == m_file || !SetFilePointerEx(m_file, zero_offset, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+    {
+        return false;
+    }
+    m_size = 0;
+    return true;
+}
+
+bool SaveFile::write(const char * data, size_t data_len)
+{
+    while (data_len > 0)
+    {
+        DWORD write_len = 0;
+        const DWORD block_len = static_cast<DWORD>(data_len > 0x40000000 ? 0x40000000 : data_len);
+        if (INVALID_HANDLE_VALUE == m_file || !WriteFile(m_file, data, block_len, &write_len, nullptr) || 0 == write_len)
+        {
+            return false;
+        }
+        data += write_len;
+        data_len -= write_len;
+        m_size += write_len;
+    }
+    return true;
+}
+
+bool SaveFile::allocate(uint64_t file_size)
+{
+    LARGE_INTEGER end_offset;
+    end_offset.QuadPart = static_cast<LONGLONG>(file_size);
+    if (!truncate() || !SetFilePointerEx(m_file, end_offset, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+    {
+        return false;
+    }
+    m_size = file_size;
+    return true;
+}
+
+bool SaveFile::write_at(uint64_t offset, const char * data, size_t data_len)
+{
+    while (data_len > 0)
+    {
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0x00, sizeof(overlapped));
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD write_len = 0;
+        const DWORD block_len = static_cast<DWORD>(data_len > 0x40000000 ? 0x40000000 : data_len);
+        if (INVALID_HANDLE_VALUE == m_file || !WriteFile(m_file, data, block_len, &write_len, &overlapped) || 0 == write_len)
+        {
+            return false;
+        }
+        data += write_len;
+        data_len -= write_len;
+        offset += write_len;
+    }
+    return true;
+}
+#else
+SaveFile::SaveFile()
+    : m_file(-1)
+    , m_size(0)
+{
+
+}
+
+bool SaveFile::open(const char * pathname)
+{
+    close();
+
+    m_file = ::open(pathname, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (m_file < 0)
+    {
+        return false;
+    }
+
+    const off_t file_size = lseek(m_file, 0, SEEK_END);
+    if (file_size < 0)
+    {
+        close();
+        return false;
+    }
+    m_size = static_cast<uint64_t>(file_size);
+
+    return true;
+}
+
+void SaveFile::close()
+{
+    if (m_file >= 0)
+    {
+        ::close(m_file);
+        m_file = -1;
+    }
+    m_size = 0;
+}
+
+bool SaveFile::truncate()
+{
+    if (m_file < 0 || 0 != ftruncate(m_file, 0) || lseek(m_file, 0, SEEK_SET) < 0)
+    {
+        return false;
+    }
+    m_size = 0;
+    return true;
+}
+
+bool SaveFile::write(const char * data, size_t data_len)
+{
+    while (data_len > 0)
+    {
+        const ssize_t write_len = ::write(m_file, data, data_len);
+        if (write_len < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        if (write_len <= 0)
+        {
+            return false;
+        }
+        data += write_len;
+        data_len -= static_cast<size_t>(write_len);
+        m_size += static_cast<uint64_t>(write_len);
+    }
+    return true;
+}
+
+bool SaveFile::allocate(uint64_t file_size)
+{
+    if (!truncate())
+    {
+        return false;
+    }
+#ifdef __linux__
+    /* reserves the blocks up front, so concurrent ranges do not fragment the file */
+    if (0 != posix_fallocate(m_file, 0, static_cast<off_t>(file_size)) && 0 != ftruncate(m_file, static_cast<off_t>(file_size)))
+#else
+    if (0 != ftruncate(m_file, static_cast<off_t>(file_size)))
+#endif // __linux__
+    {
+        return false;
+    }
+    m_size = file_size;
+    return true;
+}
+
+bool SaveFile::write_at(uint64_t offset, const char * data, size_t data_len)
+{
+    while (data_len > 0)
+    {
+        const ssize_t write_len = pwrite(m_file, data, data_len, static_cast<off_t>(offset));
+        if (write_len < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        if (write_len <= 0)
+        {
+            return false;
+        }
+        data += write_len;
+        data_len -= static_cast<size_t>(write_len);
+        offset += static_cast<uint64_t>(write_len);
+    }
+    return true;
+}
+#endif // _MSC_VER
+
+SaveFile::~SaveFile()
+{
+    close();
+}
+
+uint64_t SaveFile::size() const
+{
+    return m_size;
+}
+
+/* validators of a partial temp file, kept in "<save_pathname>.http.meta" next to "<save_pathname>.http.temp" */
+struct download_resume_info_t
+{
+    download_resume_info_t();
+
+    std::string                 etag;
+    std::string                 last_modified;
+    uint64_t                    content_length; /* zero means unknown */
+};
+
+download_resume_info_t::download_resume_info_t()
+    : etag()
+    , last_modified()
+    , content_length(0)
+{
+
+}
+
+static bool load_resume_info(const std::string & resume_info_pathname, download_resume_info_t & resume_info)
+{
+    std::ifstream resume_info_file(resume_info_pathname.c_str(), std::ios::binary);
+    if (!resume_info_file.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(resume_info_file, line))
+    {
+        const std::string::size_type equal_pos = line.find('=');
+        if (std::string::npos == equal_pos)
+        {
+            continue;
+        }
+        const std::string key(line.substr(0, equal_pos));
+        const std::string value(line.substr(equal_pos + 1));
+        if ("etag" == key)
+        {
+            resume_info.etag = value;
+        }
+        else if ("last_modified" == key)
+        {
+            resume_info.last_modified = value;
+        }
+        else if ("content_length" == key)
+        {
+            resume_info.content_length = static_cast<uint64_t>(strtoull(value.c_str(), nullptr, 10));
+        }
+    }
+
+    return !resume_info.etag.empty() || !resume_info.last_modified.empty();
+}
+
+static bool save_resume_info(const std::string & resume_info_pathname, const download_resume_info_t & resume_info)
+{
+    std::ofstream resume_info_file(resume_info_pathname.c_str(), std::ios::binary | std::ios::trunc);
+    if (!resume_info_file.is_open())
+    {
+        return false;
+    }
+
+    resume_info_file << "etag=" << resume_info.etag << "\n";
+    resume_info_file << "last_modified=" << resume_info.last_modified << "\n";
+    resume_info_file << "content_length=" << static_cast<unsigned long long>(resume_info.content_length) << "\n";
+
+    return resume_info_file.good();
+}
+
+/* If-Range needs a strong validator, a weak etag falls back to last modified */
+static std::string get_resume_validator(const download_resume_info_t & resume_info)
+{
+    if (!resume_info.etag.empty() && 0 != resume_info.etag.compare(0, 2, "W/"))
+    {
+        return resume_info.etag;
+    }
+    return resume_info.last_modified;
+}
+
+struct download_response_t
+{
+    download_response_t();
+
+    long                        status_code;
+    bool                        accept_ranges;
+    bool                        has_content_length;
+    bool                        has_content_range;
+    uint64_t                    content_length;
+    uint64_t                    range_begin;
+    uint64_t                    range_total; /* zero means unknown */
+    download_resume_info_t      resume_info;
+};
+
+download_response_t::download_response_t()
+    : status_code(0)
+    , accept_ranges(false)
+    , has_content_length(false)
+    , has_content_range(false)
+    , content_length(0)
+    , range_begin(0)
+    , range_total(0)
+    , resume_info()
+{
+
+}
+
+struct download_userdata_t
+{
+    download_userdata_t(SaveFile & file, download_request_status_t & status);
+    ~download_userdata_t();
+
+    SaveFile                  & save_file;
+    download_request_status_t & download_request_status;
+    std::string                 temp_save_pathname;
+    std::string                 resume_info_pathname;
+    uint64_t                    resume_offset; /* bytes of temp file kept from a previous attempt */
+    struct curl_slist         * resume_header_list;
+    download_response_t         response;
+    bool                        body_started;
+    bool                        body_discarded;
+    bool                        write_failure;   /* the temp file could not be written, its tail is unknown */
+    bool                        unzip_in_write;  /* the write callback may unzip, it must not on an event loop thread */
+    std::string                 expected_digest; /* empty means the download is not verified */
+    MessageDigest               message_digest;  /* digest of temp file, updated while it is written */
+};
+
+download_userdata_t::download_userdata_t(SaveFile & file, download_request_status_t & status)
+    : save_file(file)
+    , download_request_status(status)
+    , temp_save_pathname()
+    , resume_info_pathname()
+    , resume_offset(0)
+    , resume_header_list(nullptr)
+    , response()
+    , body_started(false)
+    , body_discarded(false)
+    , write_failure(false)
+    , unzip_in_write(true)
+    , expected_digest()
+    , message_digest()
+{
+
+}
+
+download_userdata_t::~download_userdata_t()
+{
+    curl_slist_free_all(resume_header_list);
+}
+
+static void trim_header_value(std::string & value)
+{
+    const std::string::size_type value_begin = value.find_first_not_of(" \t\r\n");
+    if (std::string::npos == value_begin)
+    {
+        value.clear();
+        return;
+    }
+    const std::string::size_type value_end = value.find_last_not_of(" \t\r\n");
+    value = value.substr(value_begin, value_end - value_begin + 1);
+}
+
+static size_t libcurl_download_header_callback(char * buffer, size_t size, size_t nitems, void * user_data)
+{
+    const size_t header_len = size * nitems;
+    download_response_t * download_response = reinterpret_cast<download_response_t *>(user_data);
+    if (nullptr == download_response || nullptr == buffer)
+    {
+        return header_len;
+    }
+
+    download_response_t & response = *download_response;
+    const std::string header(buffer, header_len);
+
+    if (0 == header.compare(0, 5, "HTTP/"))
+    {
+        response = download_response_t(); /* a new response begins, after a redirect for example */
+        const std::string::size_type code_pos = header.find(' ');
+        if (std::string::npos != code_pos)
+        {
+            response.status_code = strtol(header.c_str() + code_pos + 1, nullptr, 10);
+        }
+        return header_len;
+    }
+
+    const std::string::size_type colon_pos = header.find(':');
+    if (std::string::npos == colon_pos)
+    {
+        return header_len;
+    }
+
+    std::string name(header.substr(0, colon_pos));
+    std::string value(header.substr(colon_pos + 1));
+    trim_header_value(name);
+    trim_header_value(value);
+    for (std::string::iterator iter = name.begin(); name.end() != iter; ++iter)
+    {
+        *iter = static_cast<char>(tolower(static_cast<unsigned char>(*iter)));
+    }
+
+    if ("etag" == name)
+    {
+        response.resume_info.etag = value;
+    }
+    else if ("last-modified" == name)
+    {
+        response.resume_info.last_modified = value;
+    }
+    else if ("content-length" == name)
+    {
+        response.has_content_length = true;
+        response.content_length = static_cast<uint64_t>(strtoull(value.c_str(), nullptr, 10));
+    }
+    else if ("accept-ranges" == name)
+    {
+        response.accept_ranges = ("bytes" == value);
+    }
+    else if ("content-range" == name && 0 == value.compare(0, 6, "bytes "))
+    {
+        /* "bytes <first>-<last>/<total or *>" */
+        response.has_content_range = true;
+        response.range_begin = static_cast<uint64_t>(strtoull(value.c_str() + 6, nullptr, 10));
+        const std::string::size_type slash_pos = value.find('/');
+        if (std::string::npos != slash_pos)
+        {
+            response.range_total = static_cast<uint64_t>(strtoull(value.c_str() + slash_pos + 1, nullptr, 10));
+        }
+    }
+
+    return header_len;
+}
+
+/* entries unzipped while downloading wait here until the whole zip is verified */
+static std::string get_unzip_stage_dirname(const http_download_request_t & download_request)
+{
+    return Stupid::Base::utf8_to_ansi(download_request.save_pathname) + std::string(".http.unzip/");
+}
+
+static void remove_empty_directory(const std::string & dirname)
+{
+#ifdef _MSC_VER
+    RemoveDirectoryA(dirname.c_str());
+#else
+    rmdir(dirname.c_str());
+#endif // _MSC_VER
+}
+
+/* removes what is left in the unzip stage */
+static void discard_unzip_stream(download_request_status_t & download_request_status)
+{
+    if (nullptr == download_request_status.unzip_stream)
+    {
+        return;
+    }
+
+    const std::string stage_dirname(get_unzip_stage_dirname(download_request_status.download_request));
+    std::set<std::string> entry_dirname_set;
+
+    ZIPENTRY zipentry = { 0 };
+    GetZipStreamItem(download_request_status.unzip_stream, -1, &zipentry);
+    const int count = zipentry.index;
+    for (int index = 0; index < count; ++index)
+    {
+        if (ZR_OK != GetZipStreamItem(download_request_status.unzip_stream, index, &zipentry))
+        {
+            continue;
+        }
+        const std::string entry_name(zipentry.name);
+        if (0 == (zipentry.attr & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            std::remove((stage_dirname + entry_name).c_str());
+        }
+        for (std::string::size_type slash_pos = entry_name.find_first_of("/\\"); std::string::npos != slash_pos; slash_pos = entry_name.find_first_of("/\\", slash_pos + 1))
+        {
+            entry_dirname_set.insert(entry_name.substr(0, slash_pos));
+        }
+    }
+
+    /* a directory sorts before the ones inside it */
+    for (std::set<std::string>::const_reverse_iterator iter = entry_dirname_set.rbegin(); entry_dirname_set.rend() != iter; ++iter)
+    {
+        remove_empty_directory(stage_dirname + *iter);
+    }
+    remove_empty_directory(stage_dirname.substr(0, stage_dirname.size() - 1));
+
+    CloseZipStream(download_request_status.unzip_stream);
+    download_request_status.unzip_stream = nullptr;
+}
+
+static void open_unzip_stream(download_request_status_t & download_request_status)
+{
+    discard_unzip_stream(download_request_status);
+
+    download_request_status.unzip_stream = OpenZipStream(get_unzip_stage_dirname(download_request_status.download_request).c_str());
+    if (nullptr == download_request_status.unzip_stream)
+    {
+        RUN_LOG_WAR("open zip stream failed, unzip after download, when get url (%s)", download_request_status.download_request.url_request);
+    }
+}
+
+/* decides on the first body bytes whether the partial temp file goes on, or the download restarts */
+static bool libcurl_download_begin_body(download_userdata_t & download_userdata)
+{
+    download_userdata.body_started = true;
+
+    http_download_request_t & download_request = download_userdata.download_request_status.download_request;
+    const download_response_t & response = download_userdata.response;
+
+    if (206L == response.status_code)
+    {
+        if (0 == download_userdata.resume_offset || !response.has_content_range || response.range_begin != download_userdata.resume_offset)
+        {
+            RUN_LOG_WAR("resume download at (%llu) failed, content range begins at (%llu), when get url (%s)", static_cast<unsigned long long>(download_userdata.resume_offset), static_cast<unsigned long long>(response.range_begin), download_request.url_request);
+            download_userdata.save_file.truncate();
+            Stupid::Base::stupid_unlink_safe(download_userdata.resume_info_pathname.c_str());
+            return false;
+        }
+    }
+    else if (0L == response.status_code || 2L == response.status_code / 100)
+    {
+        if (download_userdata.resume_offset > 0)
+        {
+            RUN_LOG_WAR("server sent the whole content instead of a range, restart download, when get url (%s)", download_request.url_request);
+            download_userdata.resume_offset = 0;
+            download_userdata.message_digest.init(MessageDigest::get_type_by_hex_size(download_userdata.expected_digest.size()));
+            if (!download_userdata.save_file.truncate())
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        download_userdata.body_discarded = true; /* error page, neither save it nor spoil the partial temp file */
+        return true;
+    }
+
+    download_resume_info_t resume_info(response.resume_info);
+    resume_info.content_length = (206L == response.status_code ? response.range_total : (response.has_content_length ? response.content_length : 0));
+    if ((200L == response.status_code || 206L == response.status_code) && !get_resume_validator(resume_info).empty())
+    {
+        save_resume_info(download_userdata.resume_info_pathname, resume_info);
+    }
+    else
+    {
+        Stupid::Base::stupid_unlink_safe(download_userdata.resume_info_pathname.c_str());
+    }
+
+    /* a zip can only be unzipped as it arrives when it arrives from its first byte */
+    if (download_request.need_unzip && download_userdata.unzip_in_write && 200L == response.status_code && 0 == download_userdata.resume_offset)
+    {
+        open_unzip_stream(download_userdata.download_request_status);
+    }
+
+    return true;
+}
+
+static size_t libcurl_download_callback(void * ptr, size_t size, size_t nmemb, void * user_data)
+{
+    download_userdata_t * download_userdata = reinterpret_cast<download_userdata_t *>(user_data);
+    if (nullptr == download_userdata)
+    {
+        return 0; /* tell libcurl to stop download */
+    }
+    if (download_userdata->download_request_status.been_stopped)
+    {
+        return 0; /* tell libcurl to stop download */
+    }
+    if (!download_userdata->body_started && !libcurl_download_begin_body(*download_userdata))
+    {
+        return 0; /* tell libcurl to stop download */
+    }
+    if (0 == download_userdata->download_request_status.first_byte_time)
+    {
+        download_userdata->download_request_status.first_byte_time = get_monotonic_us();
+    }
+    const size_t recv_len = size * nmemb;
+    if (download_userdata->body_discarded)
+    {
+        return recv_len;
+    }
+    const char * data = reinterpret_cast<char *>(ptr);
+    if (!download_userdata->save_file.write(data, recv_len))
+    {
+        download_userdata->write_failure = true;
+        return 0; /* tell libcurl to stop download, it fails with CURLE_WRITE_ERROR */
+    }
+    download_userdata->message_digest.update(data, recv_len);
+    download_request_status_t & download_request_status = download_userdata->download_request_status;
+    if (nullptr != download_request_status.unzip_stream)
+    {
+        ZRESULT zresult = WriteZipStream(download_request_status.unzip_stream, data, static_cast<unsigned int>(recv_len));
+        if (ZR_OK != zresult)
+        {
+            RUN_LOG_WAR("unzip while downloading failed(%u), unzip after download, when get url (%s)", zresult, download_request_status.download_request.url_request);
+            discard_unzip_stream(download_request_status);
+        }
+    }
+    return recv_len;
+}
+
+static bool libcurl_download_open(download_userdata_t & download_userdata, http_response_callback_info_t & callback_info)
+{
+    http_download_request_t & download_request = download_userdata.download_request_status.download_request;
+    SaveFile & file = download_userdata.save_file;
+
+    download_userdata.temp_save_pathname = download_request.save_pathname + std::string(".http.temp");
+    download_userdata.resume_info_pathname = download_request.save_pathname + std::string(".http.meta");
+    download_userdata.resume_offset = 0;
+    download_userdata.response = download_response_t();
+    download_userdata.body_started = false;
+    download_userdata.body_discarded = false;
+    download_userdata.write_failure = false;
+
+    discard_unzip_stream(download_userdata.download_request_status);
+
+    if (!file.open(download_userdata.temp_save_pathname.c_str()))
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_create_file_failure;
+        RUN_LOG_ERR("create file (%s) failed, when get url (%s)", download_userdata.temp_save_pathname.c_str(), download_request.url_request);
+        return false;
+    }
+
+    download_resume_info_t resume_info;
+    if (file.size() > 0 && load_resume_info(download_userdata.resume_info_pathname, resume_info) && (0 == resume_info.content_length || file.size() < resume_info.content_length) && !get_resume_validator(resume_info).empty())
+    {
+        download_userdata.resume_offset = file.size();
+        download_userdata.response.resume_info = resume_info;
+        RUN_LOG_DBG("resume download from (%llu) of (%llu), when get url (%s)", static_cast<unsigned long long>(file.size()), static_cast<unsigned long long>(resume_info.content_length), download_request.url_request);
+    }
+    else if (file.size() > 0 && !file.truncate())
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_create_file_failure;
+        RUN_LOG_ERR("truncate file (%s) failed, when get url (%s)", download_userdata.temp_save_pathname.c_str(), download_request.url_request);
+        return false;
+    }
+
+    MessageDigest & message_digest = download_userdata.message_digest;
+    if (message_digest.init(MessageDigest::get_type_by_hex_size(download_userdata.expected_digest.size())) && download_userdata.resume_offset > 0 && !update_file_message_digest(download_userdata.temp_save_pathname.c_str(), message_digest))
+    {
+        RUN_LOG_WAR("read file (%s) failed, restart download, when get url (%s)", download_userdata.temp_save_pathname.c_str(), download_request.url_request);
+        download_userdata.resume_offset = 0;
+        download_userdata.response = download_response_t();
+        message_digest.init(message_digest.type());
+        if (!file.truncate())
+        {
+            callback_info.status_code = 0;
+            callback_info.error_code = http_response_callback_error_t::callback_message_create_file_failure;
+            RUN_LOG_ERR("truncate file (%s) failed, when get url (%s)", download_userdata.temp_save_pathname.c_str(), download_request.url_request);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void libcurl_download_setopt(CURL * curl, CURLSH * share_handle, download_userdata_t & download_userdata)
+{
+    http_download_request_t & download_request = download_userdata.download_request_status.download_request;
+
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
+    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 5L);
+    curl_easy_setopt(curl, CURLOPT_URL, download_request.url_request);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, libcurl_download_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, reinterpret_cast<void *>(&download_userdata.response));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, libcurl_download_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, reinterpret_cast<void *>(&download_userdata));
+
+    curl_slist_free_all(download_userdata.resume_header_list);
+    download_userdata.resume_header_list = nullptr;
+
+    curl_easy_setopt(curl, CURLOPT_RANGE, nullptr);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
+
+    if (download_userdata.resume_offset > 0)
+    {
+        /* CURLOPT_RANGE rather than CURLOPT_RESUME_FROM_LARGE, libcurl fails the latter when server answers 200 */
+        char resume_range[32] = { 0 };
+        Stupid::Base::stupid_snprintf(resume_range, sizeof(resume_range), "%llu-", static_cast<unsigned long long>(download_userdata.resume_offset));
+        const std::string if_range_header("If-Range: " + get_resume_validator(download_userdata.response.resume_info));
+        download_userdata.resume_header_list = curl_slist_append(nullptr, if_range_header.c_str());
+        curl_easy_setopt(curl, CURLOPT_RANGE, resume_range);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, download_userdata.resume_header_list);
+    }
+}
+
+static bool libcurl_download_result(CURL * curl, CURLcode curl_code, download_userdata_t & download_userdata, http_response_callback_info_t & callback_info)
+{
+    http_download_request_t & download_request = download_userdata.download_request_status.download_request;
+    SaveFile & file = download_userdata.save_file;
+    const std::string & temp_save_pathname = download_userdata.temp_save_pathname;
+
+    if (download_userdata.write_failure)
+    {
+        file.close();
+        Stupid::Base::stupid_unlink_safe(temp_save_pathname.c_str()); /* a part of the last block may be on disk, so it can not be resumed */
+        Stupid::Base::stupid_unlink_safe(download_userdata.resume_info_pathname.c_str());
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_create_file_failure;
+        RUN_LOG_ERR("write file (%s) failed, when get url (%s)", temp_save_pathname.c_str(), download_request.url_request);
+        return false;
+    }
+
+    if (CURLE_OK != curl_code)
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_perform failed (%s), keep (%llu) bytes to resume, when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), static_cast<unsigned long long>(file.size()), download_request.url_request);
+        file.close();
+        return false;
+    }
+
+    long status_code = 0;
+
+    curl_code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+    if (CURLE_OK != curl_code)
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_getinfo_failure;
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_getinfo(status_code) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), download_request.url_request);
+        file.close();
+        return false;
+    }
+
+    /* an empty body never reached the write callback */
+    const bool body_accepted = (download_userdata.body_started || libcurl_download_begin_body(download_userdata));
+    const bool download_complete = body_accepted && (200L == status_code || (206L == status_code && download_userdata.resume_offset > 0));
+
+    file.close();
+
+    if (download_complete && MessageDigest::digest_none != download_userdata.message_digest.type())
+    {
+        const std::string download_digest(download_userdata.message_digest.final());
+        if (0 != Stupid::Base::stupid_strncmp_ignore_case(download_digest.c_str(), download_userdata.expected_digest.c_str(), download_userdata.expected_digest.size()))
+        {
+            Stupid::Base::stupid_unlink_safe(temp_save_pathname.c_str());
+            Stupid::Base::stupid_unlink_safe(download_userdata.resume_info_pathname.c_str());
+            callback_info.status_code = status_code;
+            callback_info.error_code = http_response_callback_error_t::callback_message_verify_message_digest_failure;
+            RUN_LOG_ERR("verify message digest failed, (%s) is expected but (%s) is downloaded, when get url (%s)", download_userdata.expected_digest.c_str(), download_digest.c_str(), download_request.url_request);
+            return false;
+        }
+    }
+
+    if (download_complete)
+    {
+        Stupid::Base::stupid_unlink_safe(download_userdata.resume_info_pathname.c_str());
+        Stupid::Base::stupid_unlink_safe(download_request.save_pathname);
+        if (!Stupid::Base::stupid_rename_safe(temp_save_pathname.c_str(), download_request.save_pathname))
+        {
+            callback_info.status_code = 0;
+            callback_info.error_code = http_response_callback_error_t::callback_message_rename_file_failure;
+            RUN_LOG_ERR("rename file (%s) -> (%s) failed, when get url (%s)", temp_save_pathname.c_str(), download_request.save_pathname, download_request.url_request);
+            return false;
+        }
+    }
+    else if (!download_userdata.body_discarded && (0L == status_code || 2L == status_code / 100))
+    {
+        /* a 2xx that can not be resumed, such as a 206 of another range, or a protocol without status */
+        Stupid::Base::stupid_unlink_safe(temp_save_pathname.c_str());
+        Stupid::Base::stupid_unlink_safe(download_userdata.resume_info_pathname.c_str());
+    }
+    else
+    {
+        RUN_LOG_WAR("response status code (%ld), keep (%s) to resume, when get url (%s)", status_code, temp_save_pathname.c_str(), download_request.url_request);
+    }
+
+    callback_info.status_code = status_code;
+
+    if (download_complete)
+    {
+        callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
+        RUN_LOG_DBG("url_download_with_libcurl success, when get url (%s)", download_request.url_request);
+        return true;
+    }
+
+    switch (status_code / 100)
+    {
+        case 2:
+        {
+            callback_info.error_code = http_response_callback_error_t::callback_message_response_2xx_failure;
+            break;
+        }
+        case 3:
+        {
+            callback_info.error_code = http_response_callback_error_t::callback_message_response_3xx_failure;
+            break;
+        }
+        case 4:
+        {
+            callback_info.error_code = http_response_callback_error_t::callback_message_response_4xx_failure;
+            break;
+        }
+        case 5:
+        {
+            callback_info.error_code = http_response_callback_error_t::callback_message_response_5xx_failure;
+            break;
+        }
+        default:
+        {
+            callback_info.error_code = http_response_callback_error_t::callback_message_response_xxx_failure;
+            break;
+        }
+    }
+
+    RUN_LOG_ERR("curl_easy_getinfo status code (%d), when get url (%s)", status_code, download_request.url_request);
+
+    return false;
+}
+
+static bool libcurl_download(CURL * curl, CURLSH * share_handle, download_request_status_t & download_request_status, const std::string & expected_digest, http_response_callback_info_t & callback_info)
+{
+    SaveFile file;
+    download_userdata_t download_userdata(file, download_request_status);
+    download_userdata.expected_digest = expected_digest;
+
+    if (!libcurl_download_open(download_userdata, callback_info))
+    {
+        return false;
+    }
+
+    libcurl_download_setopt(curl, share_handle, download_userdata);
+
+    return libcurl_download_result(curl, curl_easy_perform(curl), download_userdata, callback_info);
+}
+
+static void init_callback_info(const http_download_request_t & download_request, http_response_callback_info_t & callback_info)
+{
+    callback_info.status_code = 0;
+    callback_info.error_code = http_response_callback_error_t::callback_message_response_xxx_failure;
+    callback_info.user_data = download_request.user_data;
+    strncpy(callback_info.url_request, download_request.url_request, sizeof(callback_info.url_request));
+    strncpy(callback_info.save_pathname, download_request.save_pathname, sizeof(callback_info.save_pathname));
+    callback_info.transfer_timing = http_transfer_timing_t();
+}
+
+/* answers at once on the posting thread, without a download worker, if the digest index says local file still matches message_digest */
+bool HttpClient::skip_unchanged_download(const http_download_request_t & download_request)
+{
+    if (download_request.need_unzip || !need_check_local_message_digest(download_request))
+    {
+        return false;
+    }
+
+    std::string local_digest;
+    if (!m_digest_index.find(download_request.save_pathname, local_digest) || !match_message_digest(local_digest, download_request))
+    {
+        return false;
+    }
+
+    http_response_callback_info_t callback_info;
+    init_callback_info(download_request, callback_info);
+    callback_info.status_code = 200;
+    callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
+
+    RUN_LOG_DBG("post download request[url request:%s, save pathname:%s] success (need not update)", download_request.url_request, download_request.save_pathname);
+
+    if (nullptr != download_request.response_sink)
+    {
+        download_request.response_sink->on_response(callback_info);
+    }
+
+    return true;
+}
+
+bool HttpClient::url_download_with_libcurl(download_request_status_t & download_request_status, http_response_callback_info_t & callback_info)
+{
+    http_download_request_t & download_request = download_request_status.download_request;
+
+    init_callback_info(download_request, callback_info);
+
+    CURL * curl = m_handle_pool.acquire(download_request.url_request);
+    if (nullptr == curl)
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
+        RUN_LOG_ERR("curl_easy_init failed, when get url (%s)", download_request.url_request);
+        return false;
+    }
+
+    m_connection_stats.attach(curl);
+
+    if (!download_request_status.been_stopped)
+    {
+        std::string expected_digest;
+        const bool need_download = libcurl_check_need_download(curl, m_share_handle, m_digest_index, download_request_status, expected_digest, callback_info);
+        if (need_check_message_digest(download_request))
+        {
+            m_connection_stats.record(curl);
+            m_transfer_metrics.record(curl, nullptr);
+        }
+        if (need_download && !download_request_status.been_stopped && !url_segmented_download(curl, download_request_status, expected_digest, callback_info))
+        {
+            libcurl_download(curl, m_share_handle, download_request_status, expected_digest, callback_info);
+            m_connection_stats.record(curl);
+            m_transfer_metrics.record(curl, &callback_info.transfer_timing);
+        }
+    }
+
+    m_handle_pool.release(download_request.url_request, curl);
+
+    return http_response_callback_error_t::callback_message_response_success == callback_info.error_code;
+}
+
+static bool libcurl_probe_download(CURL * curl, CURLSH * share_handle, const char * url_request, download_response_t & download_response)
+{
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
+    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_URL, url_request);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, libcurl_download_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, reinterpret_cast<void *>(&download_response));
+
+    const CURLcode curl_code = curl_easy_perform(curl);
+    if (CURLE_OK != curl_code)
+    {
+        const char * curl_error = curl_easy_strerror(curl_code);
+        RUN_LOG_ERR("curl_easy_perform(probe) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
+        return false;
+    }
+
+    return 200L == download_response.status_code;
+}
+
+struct segment_transfer_t
+{
+    segment_transfer_t(SaveFile & file, download_request_status_t & status, CURL * handle);
+
+    SaveFile                  & save_file;
+    download_request_status_t & download_request_status;
+    CURL                      * curl;
+    uint64_t                    range_begin;  /* first byte requested */
+    uint64_t                    range_offset; /* next byte to write */
+    uint64_t                    range_end;    /* one past the last byte, moves down when the tail is stolen */
+    download_response_t         response;
+    bool                        body_started;
+    bool                        range_mismatch;
+    bool                        write_failure;
+};
+
+segment_transfer_t::segment_transfer_t(SaveFile & file, download_request_status_t & status, CURL * handle)
+    : save_file(file)
+    , download_request_status(status)
+    , curl(handle)
+    , range_begin(0)
+    , range_offset(0)
+    , range_end(0)
+    , response()
+    , body_started(false)
+    , range_mismatch(false)
+    , write_failure(false)
+{
+
+}
+
+static size_t libcurl_segment_callback(void * ptr, size_t size, size_t nmemb, void * user_data)
+{
+    segment_transfer_t * segment_transfer = reinterpret_cast<segment_transfer_t *>(user_data);
+    if (nullptr == segment_transfer)
+    {
+        return 0; /* tell libcurl to stop download */
+    }
+    if (segment_transfer->download_request_status.been_stopped)
+    {
+        return 0; /* tell libcurl to stop download */
+    }
+    if (0 == segment_transfer->download_request_status.first_byte_time)
+    {
+        segment_transfer->download_request_status.first_byte_time = get_monotonic_us();
+    }
+    if (!segment_transfer->body_started)
+    {
+        segment_transfer->body_started = true;
+        const download_response_t & response = segment_transfer->response;
+        if (206L != response.status_code || !response.has_content_range || response.range_begin != segment_transfer->range_begin)
+        {
+            segment_transfer->range_mismatch = true; /* the content changed, or the server ignored the range */
+            return 0; /* tell libcurl to stop download */
+        }
+    }
+    const size_t recv_len = size * nmemb;
+    const uint64_t range_left = segment_transfer->range_end - segment_transfer->range_offset;
+    const size_t write_len = (range_left < recv_len ? static_cast<size_t>(range_left) : recv_len);
+    if (write_len > 0 && !segment_transfer->save_file.write_at(segment_transfer->range_offset, reinterpret_cast<char *>(ptr), write_len))
+    {
+        segment_transfer->write_failure = true;
+        return 0; /* tell libcurl to stop download */
+    }
+    segment_transfer->range_offset += write_len;
+    return write_len; /* less than recv_len stops the transfer when its tail has been stolen */
+}
+
+static void libcurl_segment_setopt(CURL * curl, CURLSH * share_handle, const char * url_request, struct curl_slist * header_list, segment_transfer_t & segment_transfer)
+{
+    char segment_range[64] = { 0 };
+    Stupid::Base::stupid_snprintf(segment_range, sizeof(segment_range), "%llu-%llu", static_cast<unsigned long long>(segment_transfer.range_begin), static_cast<unsigned long long>(segment_transfer.range_end - 1));
+
+    segment_transfer.response = download_response_t();
+    segment_transfer.body_started = false;
+
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
+    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 5L);
+    curl_easy_setopt(curl, CURLOPT_URL, url_request);
+    curl_easy_setopt(curl, CURLOPT_RANGE, segment_range);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, libcurl_download_header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, reinterpret_cast<void *>(&segment_transfer.response));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, libcurl_segment_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, reinterpret_cast<void *>(&segment_transfer));
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, reinterpret_cast<void *>(&segment_transfer));
+}
+
+/*
+ * fetches a large file over several byte ranges at once, every range writes to its own place of a preallocated temp file,
+ * a range which finished early takes over the second half of the largest range left, so a slow stream can not hold up the end,
+ * returns false if the file does not suit (or the server does not support) ranges, then the caller downloads it in one stream
+ */
+bool HttpClient::url_segmented_download(CURL * curl, download_request_status_t & download_request_status, const std::string & expected_digest, http_response_callback_info_t & callback_info)
+{
+    http_download_request_t & download_request = download_request_status.download_request;
+
+    if (m_max_segment_count < 2)
+    {
+        return false;
+    }
+
+    const std::string temp_save_pathname(download_request.save_pathname + std::string(".http.temp"));
+    const std::string resume_info_pathname(download_request.save_pathname + std::string(".http.meta"));
+
+    download_resume_info_t resume_info;
+    if (load_resume_info(resume_info_pathname, resume_info))
+    {
+        return false; /* keeps the partial temp file of a single stream, resumes it instead */
+    }
+
+    const std::chrono::steady_clock::time_point begin_time = std::chrono::steady_clock::now();
+
+    download_response_t probe_response;
+    const bool probe_success = libcurl_probe_download(curl, m_share_handle, download_request.url_request, probe_response);
+    m_connection_stats.record(curl);
+    m_transfer_metrics.record(curl, &callback_info.transfer_timing); /* the phases up to the first byte are the probe's */
+    if (!probe_success || !probe_response.accept_ranges || !probe_response.has_content_length)
+    {
+        return false;
+    }
+
+    const uint64_t content_length = probe_response.content_length;
+    const uint64_t min_segment_size = (m_min_segment_size > 0 ? static_cast<uint64_t>(m_min_segment_size) : 1);
+    const uint64_t max_segment_count = content_length / min_segment_size;
+    const size_t segment_count = static_cast<size_t>(max_segment_count < m_max_segment_count ? max_segment_count : m_max_segment_count);
+    if (segment_count < 2)
+    {
+        return false;
+    }
+
+    SaveFile file;
+    if (!file.open(temp_save_pathname.c_str()) || !file.allocate(content_length))
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_create_file_failure;
+        RUN_LOG_ERR("create file (%s) failed, when get url (%s)", temp_save_pathname.c_str(), download_request.url_request);
+        return true;
+    }
+
+    struct curl_slist * header_list = nullptr;
+    const std::string validator(get_resume_validator(probe_response.resume_info));
+    if (!validator.empty())
+    {
+        header_list = curl_slist_append(header_list, ("If-Range: " + validator).c_str());
+    }
+
+    CURLM * multi_handle = curl_multi_init();
+
+    std::list<segment_transfer_t> segment_transfer_list;
+    bool segment_init_success = (nullptr != multi_handle);
+    for (size_t index = 0; segment_init_success && index < segment_count; ++index)
+    {
+        CURL * segment_curl = (0 == index ? curl : m_handle_pool.acquire(download_request.url_request));
+        if (nullptr == segment_curl)
+        {
+            segment_init_success = false;
+            break;
+        }
+        segment_transfer_list.push_back(segment_transfer_t(file, download_request_status, segment_curl));
+        segment_transfer_t & segment_transfer = segment_transfer_list.back();
+        segment_transfer.range_begin = content_length / segment_count * index;
+        segment_transfer.range_offset = segment_transfer.range_begin;
+        segment_transfer.range_end = (segment_count == index + 1 ? content_length : content_length / segment_count * (index + 1));
+        m_connection_stats.attach(segment_curl);
+        libcurl_segment_setopt(segment_curl, m_share_handle, download_request.url_request, header_list, segment_transfer);
+        if (CURLM_OK != curl_multi_add_handle(multi_handle, segment_curl))
+        {
+            segment_init_success = false;
+            break;
+        }
+    }
+
+    RUN_LOG_DBG("segmented download (%llu) bytes over (%u) ranges, when get url (%s)", static_cast<unsigned long long>(content_length), segment_count, download_request.url_request);
+
+    const size_t max_retry_count = 3;
+    size_t retry_count = 0;
+    size_t steal_count = 0;
+    bool range_mismatch = false;
+    bool segment_failure = !segment_init_success;
+    int running_count = (segment_init_success ? static_cast<int>(segment_count) : 0);
+
+    while (!segment_failure && running_count > 0 && !download_request_status.been_stopped)
+    {
+        curl_multi_perform(multi_handle, &running_count);
+
+        int message_count = 0;
+        CURLMsg * message = nullptr;
+        while (!segment_failure && nullptr != (message = curl_multi_info_read(multi_handle, &message_count)))
+        {
+            if (CURLMSG_DONE != message->msg)
+            {
+                continue;
+            }
+
+            segment_transfer_t * segment_transfer = nullptr;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char **>(&segment_transfer));
+            curl_multi_remove_handle(multi_handle, message->easy_handle);
+            m_connection_stats.record(message->easy_handle);
+            m_transfer_metrics.record(message->easy_handle, nullptr);
+            if (nullptr == segment_transfer)
+            {
+                continue;
+            }
+
+            if (segment_transfer->range_offset < segment_transfer->range_end)
+            {
+                if (segment_transfer->range_mismatch || segment_transfer->write_failure || download_request_status.been_stopped || ++retry_count > max_retry_count)
+                {
+                    const char * curl_error = curl_easy_strerror(message->data.result);
+                    RUN_LOG_ERR("segmented download range (%llu-%llu) failed (%s), when get url (%s)", static_cast<unsigned long long>(segment_transfer->range_begin), static_cast<unsigned long long>(segment_transfer->range_end), (nullptr == curl_error ? "unknown" : curl_error), download_request.url_request);
+                    range_mismatch = segment_transfer->range_mismatch;
+                    segment_failure = true;
+                    break;
+                }
+                segment_transfer->range_begin = segment_transfer->range_offset; /* retry what is left of the range */
+            }
+            else
+            {
+                segment_transfer_t * slowest_transfer = nullptr;
+                for (std::list<segment_transfer_t>::iterator iter = segment_transfer_list.begin(); segment_transfer_list.end() != iter; ++iter)
+                {
+                    if (&*iter != segment_transfer && (nullptr == slowest_transfer || iter->range_end - iter->range_offset > slowest_transfer->range_end - slowest_transfer->range_offset))
+                    {
+                        slowest_transfer = &*iter;
+                    }
+                }
+                if (nullptr == slowest_transfer || slowest_transfer->range_end - slowest_transfer->range_offset < min_segment_size)
+                {
+                    continue; /* too little left to be worth another request */
+                }
+                const uint64_t steal_offset = slowest_transfer->range_offset + (slowest_transfer->range_end - slowest_transfer->range_offset) / 2;
+                segment_transfer->range_begin = steal_offset;
+                segment_transfer->range_offset = steal_offset;
+                segment_transfer->range_end = slowest_transfer->range_end;
+                slowest_transfer->range_end = steal_offset;
+                ++steal_count;
+            }
+
+            libcurl_segment_setopt(segment_transfer->curl, m_share_handle, download_request.url_request, header_list, *segment_transfer);
+            if (CURLM_OK != curl_multi_add_handle(multi_handle, segment_transfer->curl))
+            {
+                segment_failure = true;
                 break;
             }
-            if (!m_download_thread_group.acquire_thread(download_thread_run, thread_param))
+            ++running_count;
+        }
+
+        if (!segment_failure && running_count > 0)
+        {
+            curl_multi_wait(multi_handle, nullptr, 0, 100, nullptr);
+        }
+    }
+
+    bool segment_complete = !segment_failure && !download_request_status.been_stopped;
+    for (std::list<segment_transfer_t>::iterator iter = segment_transfer_list.begin(); segment_transfer_list.end() != iter; ++iter)
+    {
+        segment_complete = segment_complete && iter->range_offset >= iter->range_end;
+        if (nullptr != iter->curl)
+        {
+            curl_multi_remove_handle(multi_handle, iter->curl);
+            if (curl != iter->curl)
+            {
+                m_handle_pool.release(download_request.url_request, iter->curl);
+            }
+        }
+    }
+
+    curl_multi_cleanup(multi_handle);
+    curl_slist_free_all(header_list);
+    file.close();
+
+    if (!segment_complete)
+    {
+        Stupid::Base::stupid_unlink_safe(temp_save_pathname.c_str());
+        if (range_mismatch && !download_request_status.been_stopped)
+        {
+            RUN_LOG_WAR("segmented download falls back to one stream, when get url (%s)", download_request.url_request);
+            return false;
+        }
+        callback_info.status_code = 0;
+        callback_info.error_code = (segment_init_success ? http_response_callback_error_t::callback_message_libcurl_perform_failure : http_response_callback_error_t::callback_message_libcurl_init_failure);
+        return true;
+    }
+
+    /* ranges are written out of order, so the digest is taken over the whole temp file once it is complete */
+    const MessageDigest::digest_type_t digest_type = MessageDigest::get_type_by_hex_size(expected_digest.size());
+    std::string download_digest;
+    if (MessageDigest::digest_none != digest_type && (!get_file_message_digest(temp_save_pathname.c_str(), digest_type, download_digest) || 0 != Stupid::Base::stupid_strncmp_ignore_case(download_digest.c_str(), expected_digest.c_str(), expected_digest.size())))
+    {
+        Stupid::Base::stupid_unlink_safe(temp_save_pathname.c_str());
+        callback_info.status_code = 200;
+        callback_info.error_code = http_response_callback_error_t::callback_message_verify_message_digest_failure;
+        RUN_LOG_ERR("verify message digest failed, (%s) is expected but (%s) is downloaded, when get url (%s)", expected_digest.c_str(), download_digest.c_str(), download_request.url_request);
+        return true;
+    }
+
+    Stupid::Base::stupid_unlink_safe(download_request.save_pathname);
+    if (!Stupid::Base::stupid_rename_safe(temp_save_pathname.c_str(), download_request.save_pathname))
+    {
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_rename_file_failure;
+        RUN_LOG_ERR("rename file (%s) -> (%s) failed, when get url (%s)", temp_save_pathname.c_str(), download_request.save_pathname, download_request.url_request);
+        return true;
+    }
+
+    /* the ranges overlap, so the download is timed as a whole from the probe on */
+    const uint64_t total_time = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin_time).count());
+    callback_info.transfer_timing.total_time = static_cast<size_t>(total_time);
+    callback_info.transfer_timing.download_size = static_cast<size_t>(content_length);
+    callback_info.transfer_timing.download_speed = static_cast<size_t>(total_time > 0 ? content_length * 1000000 / total_time : 0);
+
+    callback_info.status_code = 200;
+    callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
+    RUN_LOG_DBG("url_segmented_download success (%u ranges stolen, %u retries), when get url (%s)", steal_count, retry_count, download_request.url_request);
+
+    return true;
+}
+
+struct unzip_entry_t
+{
+    int                                 index;
+    std::string                         pathname;
+};
+
+struct unzip_task_t
+{
+    unzip_task_t(const std::string & zip, const std::vector<unzip_entry_t> & entries, bool & stopped);
+
+    const std::string                 & zip_filename;
+    const std::vector<unzip_entry_t>  & unzip_entry_vector;
+    std::atomic<size_t>                 next_entry_index;
+    std::atomic<bool>                   unzip_failure; /* set by the thread whose entry failed */
+    bool                              & been_stopped;
+};
+
+unzip_task_t::unzip_task_t(const std::string & zip, const std::vector<unzip_entry_t> & entries, bool & stopped)
+    : zip_filename(zip)
+    , unzip_entry_vector(entries)
+    , next_entry_index(0)
+    , unzip_failure(false)
+    , been_stopped(stopped)
+{
+
+}
+
+struct unzip_thread_param_t
+{
+    unzip_thread_param_t(unzip_task_t & task, HZIP zip)
+        : unzip_task(task)
+        , hzip(zip)
+    {
+
+    }
+    unzip_task_t  & unzip_task;
+    HZIP            hzip; /* a clone of its own */
+};
+
+static ZRESULT unzip_entry(HZIP hzip, const unzip_entry_t & unzip_entry)
+{
+    /* the file is opened here, its directory exists already, so UnzipItem need not ensure it */
+#ifdef _MSC_VER
+    HANDLE file = CreateFileA(unzip_entry.pathname.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return ZR_NOFILE;
+    }
+    ZRESULT zresult = UnzipItem(hzip, unzip_entry.index, file, 0, ZIP_HANDLE);
+    CloseHandle(file);
+#else
+    const int file = open(unzip_entry.pathname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (file < 0)
+    {
+        return ZR_NOFILE;
+    }
+    ZRESULT zresult = UnzipItem(hzip, unzip_entry.index, reinterpret_cast<HANDLE>(static_cast<intptr_t>(file)), 0, ZIP_HANDLE);
+    close(file);
+#endif // _MSC_VER
+    return zresult;
+}
+
+/* threads take the entries a batch at a time, so each one reads on in the order of the central directory */
+static void unzip_entries(HZIP hzip, unzip_task_t & unzip_task)
+{
+    const size_t unzip_entry_batch = 16;
+    const size_t entry_count = unzip_task.unzip_entry_vector.size();
+    while (!unzip_task.been_stopped)
+    {
+        const size_t entry_begin = unzip_task.next_entry_index.fetch_add(unzip_entry_batch);
+        if (entry_begin >= entry_count)
+        {
+            break;
+        }
+        const size_t entry_end = (entry_begin + unzip_entry_batch < entry_count ? entry_begin + unzip_entry_batch : entry_count);
+        for (size_t entry_index = entry_begin; entry_index < entry_end && !unzip_task.been_stopped; ++entry_index)
+        {
+            const unzip_entry_t & unzip_entry_info = unzip_task.unzip_entry_vector[entry_index];
+            ZRESULT zresult_unzip = unzip_entry(hzip, unzip_entry_info);
+            if (ZR_OK != zresult_unzip)
             {
-                RUN_LOG("[http_client] init failure: acquire download thread %u failure", index);
-                delete thread_param;
-                break;
+                unzip_task.unzip_failure = true;
+                RUN_LOG_ERR("unzipitem(%s) failed(index=%d, unzip_ret=%u)", unzip_task.zip_filename.c_str(), unzip_entry_info.index, zresult_unzip);
             }
         }
-        if (m_download_thread_group.size() != max_downloader_count)
+    }
+}
+
+thread_return_t STUPID_STDCALL unzip_thread_run(thread_argument_t argument)
+{
+    unzip_thread_param_t * thread_param = reinterpret_cast<unzip_thread_param_t *>(argument);
+    if (nullptr != thread_param)
+    {
+        unzip_entries(thread_param->hzip, thread_param->unzip_task);
+        CloseZip(thread_param->hzip);
+        delete thread_param;
+    }
+    return THREAD_DEFAULT_RET;
+}
+
+/* an entry may only name a place under the unzip directory: not absolute, no drive, no ".." */
+static bool is_safe_entry_name(const std::string & entry_name)
+{
+    if (entry_name.empty() || '/' == entry_name[0] || '\\' == entry_name[0] || (entry_name.size() > 1 && ':' == entry_name[1]))
+    {
+        return false;
+    }
+    for (std::string::size_type name_begin = 0; name_begin < entry_name.size(); )
+    {
+        std::string::size_type name_end = entry_name.find_first_of("/\\", name_begin);
+        if (std::string::npos == name_end)
+        {
+            name_end = entry_name.size();
+        }
+        if (2 == name_end - name_begin && 0 == entry_name.compare(name_begin, 2, ".."))
+        {
+            return false;
+        }
+        name_begin = name_end + 1;
+    }
+    return true;
+}
+
+/*
+ * reads the central directory once, creates every directory the entries need up front,
+ * then unzips the files on up to max_thread_count threads, each through its own clone of the zip
+ */
+static bool unzip_file(const std::string & unzip_dirname, const std::string & zip_filename, size_t max_thread_count, bool & been_stopped)
+{
+    HZIP hzip = OpenZip(const_cast<char *>(zip_filename.c_str()), 0, ZIP_FILENAME);
+    if (nullptr == hzip)
+    {
+        RUN_LOG_ERR("openzip(%s) failed", zip_filename.c_str());
+        return false;
+    }
+
+    ZIPENTRY zipentry = { 0 };
+    ZRESULT zresult = GetZipItem(hzip, -1, &zipentry);
+    if (ZR_OK != zresult)
+    {
+        RUN_LOG_ERR("getzipitem(%s) failed(%u)", zip_filename.c_str(), zresult);
+    }
+    const int count = zipentry.index;
+
+    bool entry_failure = false;
+    std::vector<unzip_entry_t> unzip_entry_vector;
+    std::set<std::string> unzip_dirname_set;
+    unzip_entry_vector.reserve(count > 0 ? static_cast<size_t>(count) : 0);
+    for (int index = 0; index < count && !been_stopped; ++index)
+    {
+        ZRESULT zresult_get = GetZipItem(hzip, index, &zipentry);
+        if (ZR_OK != zresult_get)
+        {
+            entry_failure = true;
+            RUN_LOG_ERR("getzipitem(%s) failed(index=%d, get_ret=%u)", zip_filename.c_str(), index, zresult_get);
+            continue;
+        }
+        if (!is_safe_entry_name(zipentry.name))
+        {
+            RUN_LOG_WAR("unzip(%s) skips entry (%s) which would land outside (%s)", zip_filename.c_str(), zipentry.name, unzip_dirname.c_str());
+            continue;
+        }
+        unzip_entry_t unzip_entry_info;
+        unzip_entry_info.index = index;
+        unzip_entry_info.pathname = unzip_dirname + zipentry.name;
+        if (0 != (zipentry.attr & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            unzip_dirname_set.insert(unzip_entry_info.pathname);
+            continue;
+        }
+        std::string entry_dirname;
+        Stupid::Base::stupid_extract_directory(unzip_entry_info.pathname.c_str(), entry_dirname, true);
+        unzip_dirname_set.insert(entry_dirname);
+        unzip_entry_vector.push_back(unzip_entry_info);
+    }
+
+    for (std::set<std::string>::const_iterator iter = unzip_dirname_set.begin(); unzip_dirname_set.end() != iter && !been_stopped; ++iter)
+    {
+        Stupid::Base::stupid_create_directory_recursive(Stupid::Base::ansi_to_utf8(*iter));
+    }
+
+    /* a thread is only worth starting for a good number of entries */
+    const size_t min_thread_entry_count = 64;
+    size_t thread_count = unzip_entry_vector.size() / min_thread_entry_count;
+    if (thread_count > max_thread_count)
+    {
+        thread_count = max_thread_count;
+    }
+    const size_t hardware_thread_count = std::thread::hardware_concurrency();
+    if (hardware_thread_count > 0 && thread_count > hardware_thread_count)
+    {
+        thread_count = hardware_thread_count;
+    }
+
+    unzip_task_t unzip_task(zip_filename, unzip_entry_vector, been_stopped);
+    Stupid::Base::ThreadGroup unzip_thread_group;
+    for (size_t thread_index = 1; thread_index < thread_count && !been_stopped; ++thread_index)
+    {
+        HZIP hzip_clone = CloneZip(hzip);
+        if (nullptr == hzip_clone)
+        {
+            RUN_LOG_ERR("clonezip(%s) failed", zip_filename.c_str());
+            break;
+        }
+        unzip_thread_param_t * thread_param = new unzip_thread_param_t(unzip_task, hzip_clone);
+        if (!unzip_thread_group.acquire_thread(unzip_thread_run, thread_param))
         {
+            RUN_LOG_ERR("acquire unzip thread %u failure", thread_index);
+            CloseZip(hzip_clone);
+            delete thread_param;
             break;
         }
+    }
 
-        RUN_LOG("[http_client] init success");
+    unzip_entries(hzip, unzip_task);
+    unzip_thread_group.release_threads();
 
-        return true;
-    } while (false);
+    CloseZip(hzip);
 
-    exit();
+    return !been_stopped && !entry_failure && !unzip_task.unzip_failure;
+}
 
-    return false;
+/* moves the entries unzipped while downloading into place, once the central directory has confirmed them */
+static bool finish_unzip_stream(const std::string & unzip_dirname, download_request_status_t & download_request_status)
+{
+    HZIPSTREAM unzip_stream = download_request_status.unzip_stream;
+    if (nullptr == unzip_stream)
+    {
+        return false;
+    }
+
+    const http_download_request_t & download_request = download_request_status.download_request;
+
+    ZRESULT zresult = EndZipStream(unzip_stream);
+    if (ZR_OK != zresult)
+    {
+        RUN_LOG_WAR("end zip stream failed(%u), unzip after download, when get url (%s)", zresult, download_request.url_request);
+        return false;
+    }
+
+    const std::string stage_dirname(get_unzip_stage_dirname(download_request));
+    std::string created_dirname;
+
+    ZIPENTRY zipentry = { 0 };
+    zresult = GetZipStreamItem(unzip_stream, -1, &zipentry);
+    if (ZR_OK != zresult)
+    {
+        RUN_LOG_WAR("get zip stream entry count failed(%u), unzip after download, when get url (%s)", zresult, download_request.url_request);
+        return false;
+    }
+
+    /* once the first entry is moved the rest follow, a stop must not leave a half updated directory */
+    if (download_request_status.been_stopped)
+    {
+        return false;
+    }
+
+    const int count = zipentry.index;
+    for (int index = 0; index < count; ++index)
+    {
+        zresult = GetZipStreamItem(unzip_stream, index, &zipentry);
+        if (ZR_OK != zresult)
+        {
+            RUN_LOG_WAR("get zip stream entry (%d) failed(%u), unzip after download, when get url (%s)", index, zresult, download_request.url_request);
+            return false;
+        }
+        const std::string unzip_pathname(unzip_dirname + zipentry.name);
+        std::string entry_dirname;
+        Stupid::Base::stupid_extract_directory(unzip_pathname.c_str(), entry_dirname, true);
+        if (entry_dirname != created_dirname)
+        {
+            Stupid::Base::stupid_create_directory_recursive(Stupid::Base::ansi_to_utf8(entry_dirname));
+            created_dirname = entry_dirname;
+        }
+        if (0 != (zipentry.attr & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            continue;
+        }
+        const std::string stage_pathname(stage_dirname + zipentry.name);
+        std::remove(unzip_pathname.c_str());
+        if (0 != std::rename(stage_pathname.c_str(), unzip_pathname.c_str()))
+        {
+            RUN_LOG_WAR("rename file (%s) -> (%s) failed, unzip after download, when get url (%s)", stage_pathname.c_str(), unzip_pathname.c_str(), download_request.url_request);
+            return false;
+        }
+    }
+
+    RUN_LOG_DBG("unzip (%d entries) while downloading success, when get url (%s)", count, download_request.url_request);
+
+    return true;
 }
 
-void HttpClient::exit()
+bool HttpClient::acquire_download_request(download_request_status_t & download_request_status, bool wait)
 {
-    if (m_is_running)
+    while (m_is_running)
     {
-        RUN_LOG("[http_client] exit begin");
-        clear();
-        RUN_LOG("[http_client] exit end");
+        if (!m_download_request_queue.pop(download_request_status, wait))
+        {
+            return false;
+        }
+        download_request_status.been_stopped = false;
+
+        if (!m_is_running)
+        {
+            if (download_request_status.is_data_request)
+            {
+                answer_stopped_data_request(download_request_status.data_request);
+            }
+            break;
+        }
+
+        if (download_request_status.is_data_request)
+        {
+            download_request_status.dispatch_time = get_monotonic_us();
+            download_request_status.first_byte_time = 0;
+            m_scheduler_metrics.begin_request(download_request_status);
+            return true; /* data requests are not deduplicated, nor stopped */
+        }
+
+        {
+            thread_locker_guard_t map_guard(m_download_request_map_locker);
+            download_request_map_t::iterator iter = m_download_request_map.find(get_download_request_key(download_request_status.download_request));
+            if (m_download_request_map.end() != iter && no_slot_index == iter->second)
+            {
+                iter->second = download_request_status.slot_index;
+                download_request_status.dispatch_time = get_monotonic_us();
+                download_request_status.first_byte_time = 0;
+                m_scheduler_metrics.begin_request(download_request_status);
+                return true;
+            }
+        }
+
+        /* has been stopped and removed, try next one */
     }
+
+    return false;
 }
 
-void HttpClient::clear()
+void HttpClient::handle_download_response(download_request_status_t & download_request_status, http_response_callback_info_t & callback_info, bool download_success)
 {
-    m_is_running = false;
+    http_download_request_t & download_request = download_request_status.download_request;
 
-    for (download_request_status_vector_t::iterator iter = m_download_request_status_vector.begin(); m_download_request_status_vector.end() != iter; ++iter)
+    if (download_success && need_check_local_message_digest(download_request))
     {
-        iter->been_stopped = true;
+        m_digest_index.update(download_request.save_pathname, download_request.message_digest);
     }
 
-    m_download_thread_group.release_threads();
+    if (download_success && download_request.need_unzip)
+    {
+        std::string save_dirname;
+        Stupid::Base::stupid_extract_directory(download_request.save_pathname, save_dirname, true);
+        if (!finish_unzip_stream(Stupid::Base::utf8_to_ansi(save_dirname), download_request_status) && !unzip_file(Stupid::Base::utf8_to_ansi(save_dirname), Stupid::Base::utf8_to_ansi(download_request.save_pathname), m_max_unzip_thread_count, download_request_status.been_stopped))
+        {
+            callback_info.status_code = 0;
+            callback_info.error_code = http_response_callback_error_t::callback_message_unzip_file_failure;
+            RUN_LOG_ERR("unzip file (%s) failure", download_request.save_pathname);
+        }
+    }
 
-    curl_share_cleanup(m_share_handle);
-    m_share_handle = nullptr;
+    discard_unzip_stream(download_request_status);
 
-    curl_global_cleanup();
+    if (http_response_callback_error_t::callback_message_response_success == callback_info.error_code)
+    {
+        RUN_LOG_DBG("handle download request [%s, %s] success", download_request.url_request, download_request.save_pathname);
+    }
+    else if (download_request_status.been_stopped)
+    {
+        callback_info.error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+        RUN_LOG_INF("handle download request [%s, %s] been stopped", download_request.url_request, download_request.save_pathname);
+    }
+    else
+    {
+        RUN_LOG_ERR("handle download request [%s, %s] failure", download_request.url_request, download_request.save_pathname);
+    }
 
-    m_download_request_status_vector.clear();
+    m_scheduler_metrics.end_request(download_request_status);
 
+    if (nullptr != download_request.response_sink)
     {
-        thread_locker_guard_t list_guard(m_download_request_list_locker);
-        m_download_request_list.clear();
+        download_request.response_sink->on_response(callback_info);
     }
 
     {
-        thread_locker_guard_t set_guard(m_download_request_set_locker);
-        m_download_request_set.clear();
+        thread_locker_guard_t map_guard(m_download_request_map_locker);
+        download_request_map_t::iterator iter = m_download_request_map.find(get_download_request_key(download_request));
+        if (m_download_request_map.end() != iter && download_request_status.slot_index == iter->second)
+        {
+            m_download_request_map.erase(iter); /* not a post of the same url made after this one was stopped */
+        }
     }
 }
 
-void HttpClient::post_download_request(const http_download_request_t & download_request)
+void HttpClient::fetch_data(download_request_status_t & download_request_status, http_data_callback_info_t & callback_info, std::string & data_buffer)
 {
-    if (!m_is_running)
+    const http_data_request_t & data_request = download_request_status.data_request;
+
+    init_data_callback_info(data_request, callback_info);
+
+    CURL * curl = m_handle_pool.acquire(data_request.url_request);
+    if (nullptr == curl)
     {
-        RUN_LOG("post_download_request failed, http_client is exit");
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
+        RUN_LOG_ERR("curl_easy_init(data request) failed, when get url (%s)", data_request.url_request);
         return;
     }
 
-    if (0 == m_download_thread_group.size())
+    m_connection_stats.attach(curl);
+
+    if (http_data_request_type_t::request_get_file_size == data_request.request_type)
     {
-        RUN_LOG("post_download_request failed, can not download asynchronously");
-        return;
+        libcurl_get_file_size(curl, m_share_handle, data_request.url_request, callback_info.file_size, callback_info.status_code, callback_info.error_code);
+    }
+    else if (nullptr != data_request.storage_callback)
+    {
+        libcurl_get_data(curl, m_share_handle, data_request.url_request, data_request.storage_callback, data_request.storage_buffer, callback_info.status_code, callback_info.error_code);
+    }
+    else
+    {
+        libcurl_get_data(curl, m_share_handle, data_request.url_request, get_data_storage, reinterpret_cast<void *>(&data_buffer), callback_info.status_code, callback_info.error_code);
     }
 
+    m_connection_stats.record(curl);
+    m_transfer_metrics.record(curl, &callback_info.transfer_timing);
+
+    m_handle_pool.release(data_request.url_request, curl);
+}
+
+void HttpClient::handle_data_response(download_request_status_t & download_request_status, http_data_callback_info_t & callback_info, const std::string & data_buffer)
+{
+    const http_data_request_t & data_request = download_request_status.data_request;
+
+    if (http_response_callback_error_t::callback_message_response_success == callback_info.error_code)
     {
-        thread_locker_guard_t set_guard(m_download_request_set_locker);
-        if (m_download_request_set.end() != m_download_request_set.find(download_request))
+        if (http_data_request_type_t::request_get_data == data_request.request_type && nullptr == data_request.storage_callback)
         {
-            RUN_LOG("post download request[url request:%s, save pathname:%s] failure", download_request.url_request, download_request.save_pathname);
-            return;
+            callback_info.data = data_buffer.data();
+            callback_info.data_len = data_buffer.size();
+        }
+        RUN_LOG_DBG("handle data request [%s] success", data_request.url_request);
+    }
+    else if (download_request_status.been_stopped)
+    {
+        callback_info.error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+        RUN_LOG_INF("handle data request [%s] been stopped", data_request.url_request);
+    }
+    else
+    {
+        RUN_LOG_ERR("handle data request [%s] failure", data_request.url_request);
+    }
+
+    m_scheduler_metrics.end_request(download_request_status);
+
+    data_request.data_sink->on_data(callback_info);
+}
+
+/* a queued data request still gets its on_data when http client exits before running it */
+void HttpClient::answer_stopped_data_request(const http_data_request_t & data_request)
+{
+    http_data_callback_info_t callback_info;
+    init_data_callback_info(data_request, callback_info);
+    callback_info.status_code = 0;
+    callback_info.error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+
+    RUN_LOG_INF("handle data request [%s] been stopped", data_request.url_request);
+
+    data_request.data_sink->on_data(callback_info);
+}
+
+void HttpClient::do_download(size_t thread_index)
+{
+    assert(thread_index < m_download_request_status_vector.size());
+
+    RUN_LOG_INF("do download thread - %u begin", thread_index);
+
+    download_request_status_t & download_request_status = m_download_request_status_vector[thread_index];
+
+    while (m_is_running)
+    {
+        if (!acquire_download_request(download_request_status, true))
+        {
+            continue; /* http client is exiting */
+        }
+
+        if (download_request_status.is_data_request)
+        {
+            http_data_callback_info_t data_callback_info;
+            std::string data_buffer;
+            fetch_data(download_request_status, data_callback_info, data_buffer);
+            handle_data_response(download_request_status, data_callback_info, data_buffer);
+            continue;
         }
-        m_download_request_set.insert(download_request);
+
+        http_download_request_t & download_request = download_request_status.download_request;
+
+        std::string save_dirname;
+        Stupid::Base::stupid_extract_directory(download_request.save_pathname, save_dirname, true);
+        Stupid::Base::stupid_create_directory_recursive(save_dirname);
+
+        http_response_callback_info_t callback_info;
+        const bool download_success = url_download_with_libcurl(download_request_status, callback_info);
+        handle_download_response(download_request_status, callback_info, download_success);
     }
 
+    RUN_LOG_INF("do download thread - %u end", thread_index);
+}
+
+struct event_transfer_t
+{
+    enum stage_t
     {
-        thread_locker_guard_t list_guard(m_download_request_list_locker);
-        m_download_request_list.push_back(download_request);
-    }
+        stage_open,                     /* a completion thread checks the local file and opens the download file */
+        stage_done,                     /* curl is done with it, a completion thread checks the result */
+        stage_finish                    /* failed or stopped, a completion thread only answers it */
+    };
+
+    event_transfer_t(size_t index, download_request_status_t & status, event_loop_t & loop);
+
+    size_t                              slot_index;
+    download_request_status_t         & download_request_status;
+    event_loop_t                      & event_loop;
+    stage_t                             stage;
+    CURL                              * curl;
+    CURLcode                            curl_code;
+    bool                                check_digest;
+    std::string                         digest_buffer;
+    get_data_userdata_t                 get_data_userdata;
+    SaveFile                            save_file;
+    download_userdata_t                 download_userdata;
+    http_response_callback_info_t       callback_info;
+    std::string                         data_buffer;        /* of a data request without storage callback */
+    http_data_callback_info_t           data_callback_info; /* of a data request */
+};
 
-    RUN_LOG("post download request[url request:%s, save pathname:%s] success", download_request.url_request, download_request.save_pathname);
+event_transfer_t::event_transfer_t(size_t index, download_request_status_t & status, event_loop_t & loop)
+    : slot_index(index)
+    , download_request_status(status)
+    , event_loop(loop)
+    , stage(stage_open)
+    , curl(nullptr)
+    , curl_code(CURLE_OK)
+    , check_digest(false)
+    , digest_buffer()
+    , get_data_userdata(get_data_storage, reinterpret_cast<void *>(&digest_buffer))
+    , save_file()
+    , download_userdata(save_file, status)
+    , callback_info()
+    , data_buffer()
+    , data_callback_info()
+{
+    download_userdata.unzip_in_write = false; /* the zip is unzipped by a completion thread once it is downloaded */
 }
 
-void HttpClient::stop_download_request(const http_download_request_t & download_request)
+/*
+ * the loop thread only adds transfers to curl multi and drives them, a transfer which needs file work
+ * or a callback goes to the completion threads, which give it back here (ready) or free its slot (returned)
+ */
+struct event_loop_t
 {
-    if (!m_is_running)
-    {
-        RUN_LOG("stop_download_request failed, http_client is exit");
-        return;
-    }
+    event_loop_t();
+
+    CURLM                             * multi_handle;
+    int                                 epoll_fd;
+    int                                 wakeup_fd;
+    bool                                has_timer;
+    int64_t                             timer_deadline;
+    std::vector<size_t>                 free_slot_vector;
+    std::list<event_transfer_t *>       transfer_list;          /* owned by the loop thread */
+    size_t                              handoff_count;          /* held by the completion threads, the loop does not exit before they come back */
+    std::mutex                          handoff_mutex;
+    std::condition_variable             handoff_condition;      /* where the loop waits for the completion threads if it has no eventfd */
+    std::list<event_transfer_t *>       ready_transfer_list;
+    std::vector<size_t>                 returned_slot_vector;
+};
 
-    if (0 == m_download_thread_group.size())
-    {
-        RUN_LOG("stop_download_request failed, can not download asynchronously");
-        return;
-    }
+event_loop_t::event_loop_t()
+    : multi_handle(nullptr)
+    , epoll_fd(-1)
+    , wakeup_fd(-1)
+    , has_timer(false)
+    , timer_deadline(0)
+    , free_slot_vector()
+    , transfer_list()
+    , handoff_count(0)
+    , handoff_mutex()
+    , handoff_condition()
+    , ready_transfer_list()
+    , returned_slot_vector()
+{
 
-    RUN_LOG("stop download request[url request:%s, save pathname:%s] begin", download_request.url_request, download_request.save_pathname);
+}
 
+#ifdef __linux__
+static int libcurl_socket_callback(CURL * curl, curl_socket_t sockfd, int what, void * user_data, void * socket_data)
+{
+    event_loop_t * event_loop = reinterpret_cast<event_loop_t *>(user_data);
+    if (nullptr == event_loop)
     {
-        thread_locker_guard_t list_guard(m_download_request_list_locker);
-        m_download_request_list.remove(download_request);
+        return -1;
     }
 
+    if (CURL_POLL_REMOVE == what)
     {
-        thread_locker_guard_t set_guard(m_download_request_set_locker);
-        m_download_request_set.erase(download_request);
+        epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_DEL, sockfd, nullptr);
+        return 0;
     }
 
-    for (download_request_status_vector_t::iterator iter = m_download_request_status_vector.begin(); m_download_request_status_vector.end() != iter; ++iter)
+    struct epoll_event event;
+    memset(&event, 0x00, sizeof(event));
+    event.events = ((0 != (what & CURL_POLL_IN)) ? EPOLLIN : 0) | ((0 != (what & CURL_POLL_OUT)) ? EPOLLOUT : 0);
+    event.data.fd = sockfd;
+
+    if (0 != epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_MOD, sockfd, &event) && ENOENT == errno)
     {
-        download_request_status_t & download_request_status = *iter;
-        if (download_request == download_request_status.download_request)
+        if (0 != epoll_ctl(event_loop->epoll_fd, EPOLL_CTL_ADD, sockfd, &event))
         {
-            download_request_status.been_stopped = true;
-            break;
+            RUN_LOG_ERR("epoll_ctl add socket (%d) failed (%d)", sockfd, errno);
         }
     }
 
-    RUN_LOG("stop download request[url request:%s, save pathname:%s] end", download_request.url_request, download_request.save_pathname);
+    return 0;
 }
 
-static bool libcurl_get_file_size(CURL * curl, CURLSH * share_handle, const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code)
+static int libcurl_timer_callback(CURLM * multi_handle, long timeout_ms, void * user_data)
 {
-    file_size = 0;
-
-    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
-    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
-    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(curl, CURLOPT_HEADER, 1L);
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-    curl_easy_setopt(curl, CURLOPT_URL, url_request);
-
-    CURLcode curl_code = CURLE_OK;
-
-    curl_code = curl_easy_perform(curl);
-    if (CURLE_OK != curl_code)
+    event_loop_t * event_loop = reinterpret_cast<event_loop_t *>(user_data);
+    if (nullptr == event_loop)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
-        const char * curl_error = curl_easy_strerror(curl_code);
-        RUN_LOG("curl_easy_perform(get_file_size) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
-        return false;
+        return -1;
     }
 
-    double content_length = 0.0;
-    curl_code = curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &content_length);
-    if (CURLE_OK != curl_code)
+    if (timeout_ms < 0)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_libcurl_getinfo_failure;
-        const char * curl_error = curl_easy_strerror(curl_code);
-        RUN_LOG("curl_easy_getinfo(get_file_size) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
-        return false;
+        event_loop->has_timer = false;
+    }
+    else
+    {
+        event_loop->has_timer = true;
+        event_loop->timer_deadline = get_monotonic_ms() + timeout_ms;
     }
 
-    url_status_code = 200;
-    url_error_code = http_response_callback_error_t::callback_message_response_success;
-    file_size = static_cast<size_t>(content_length);
-    return true;
+    return 0;
 }
+#endif // __linux__
 
-bool HttpClient::get_file_size(const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code)
+static bool init_event_loop(event_loop_t & event_loop)
 {
-    if (!m_is_running)
+    event_loop.multi_handle = curl_multi_init();
+    if (nullptr == event_loop.multi_handle)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_download_been_stopped;
-        RUN_LOG("get_file_size failed, http_client is exit");
+        RUN_LOG_ERR("curl_multi_init failed");
         return false;
     }
 
-    if (nullptr == url_request)
+#ifdef __linux__
+    event_loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (event_loop.epoll_fd < 0)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
-        RUN_LOG("get_file_size failed, url_request is nullptr");
+        RUN_LOG_ERR("epoll_create1 failed (%d)", errno);
         return false;
     }
 
-    CURL * curl = curl_easy_init();
-    if (nullptr == curl)
+    struct epoll_event wakeup_event;
+    memset(&wakeup_event, 0x00, sizeof(wakeup_event));
+    wakeup_event.events = EPOLLIN;
+    wakeup_event.data.fd = event_loop.wakeup_fd;
+    if (0 != epoll_ctl(event_loop.epoll_fd, EPOLL_CTL_ADD, event_loop.wakeup_fd, &wakeup_event))
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
-        RUN_LOG("curl_easy_init(get_file_size) failed, when get url (%s)", url_request);
+        RUN_LOG_ERR("epoll_ctl add wakeup eventfd (%d) failed (%d)", event_loop.wakeup_fd, errno);
         return false;
     }
 
-    libcurl_get_file_size(curl, m_share_handle, url_request, file_size, url_status_code, url_error_code);
-
-    curl_easy_cleanup(curl);
-
-    return http_response_callback_error_t::callback_message_response_success == url_error_code;
-}
-
-struct get_data_userdata_t
-{
-    get_data_userdata_t(storage_callback_t callback, void * buffer);
-
-    storage_callback_t      storage_callback;
-    void                  * storage_buffer;
-};
-
-get_data_userdata_t::get_data_userdata_t(storage_callback_t callback, void * buffer)
-    : storage_callback(callback)
-    , storage_buffer(buffer)
-{
+    curl_multi_setopt(event_loop.multi_handle, CURLMOPT_SOCKETFUNCTION, libcurl_socket_callback);
+    curl_multi_setopt(event_loop.multi_handle, CURLMOPT_SOCKETDATA, reinterpret_cast<void *>(&event_loop));
+    curl_multi_setopt(event_loop.multi_handle, CURLMOPT_TIMERFUNCTION, libcurl_timer_callback);
+    curl_multi_setopt(event_loop.multi_handle, CURLMOPT_TIMERDATA, reinterpret_cast<void *>(&event_loop));
+#endif // __linux__
 
+    return true;
 }
 
-static size_t libcurl_get_data_callback(void * ptr, size_t size, size_t nmemb, void * user_data)
+static void exit_event_loop(event_loop_t & event_loop)
 {
-    get_data_userdata_t * get_data_userdata = reinterpret_cast<get_data_userdata_t *>(user_data);
-    if (nullptr == get_data_userdata || nullptr == get_data_userdata->storage_callback || nullptr == get_data_userdata->storage_buffer)
+    if (nullptr != event_loop.multi_handle)
     {
-        return 0; /* tell libcurl to stop get_data */
+        curl_multi_cleanup(event_loop.multi_handle);
+        event_loop.multi_handle = nullptr;
     }
-    const size_t recv_len = size * nmemb;
-    const char * data = reinterpret_cast<char *>(ptr);
-    if (!get_data_userdata->storage_callback(data, recv_len, get_data_userdata->storage_buffer))
+
+#ifdef __linux__
+    if (event_loop.epoll_fd >= 0)
     {
-        return 0; /* tell libcurl to stop get_data */
+        close(event_loop.epoll_fd);
+        event_loop.epoll_fd = -1;
     }
-    return recv_len;
+#endif // __linux__
 }
 
-static bool libcurl_get_data(CURL * curl, CURLSH * share_handle, const char * url_request, storage_callback_t storage_callback, void * storage_buffer, size_t & url_status_code, size_t & url_error_code)
+static void drive_event_loop(event_loop_t & event_loop)
 {
-    get_data_userdata_t get_data_userdata(storage_callback, storage_buffer);
-
-    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
-    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
-    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 5L);
-    curl_easy_setopt(curl, CURLOPT_URL, url_request);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, libcurl_get_data_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, reinterpret_cast<void *>(&get_data_userdata));
-
-    CURLcode curl_code = CURLE_OK;
-
-    curl_code = curl_easy_perform(curl);
-    if (CURLE_OK != curl_code)
-    {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
-        const char * curl_error = curl_easy_strerror(curl_code);
-        RUN_LOG("curl_easy_perform(get_data) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
-        return false;
-    }
-
-    long status_code = 0;
-
-    curl_code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
-    if (CURLE_OK != curl_code)
-    {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_libcurl_getinfo_failure;
-        const char * curl_error = curl_easy_strerror(curl_code);
-        RUN_LOG("curl_easy_getinfo(get_data) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), url_request);
-        return false;
-    }
+    int running_count = 0;
 
-    url_status_code = status_code;
-
-    if (200L == status_code)
+#ifdef __linux__
+    int wait_ms = -1; /* block until socket activity, curl timer or wakeup */
+    if (event_loop.has_timer)
     {
-        url_error_code = http_response_callback_error_t::callback_message_response_success;
-        RUN_LOG("libcurl_get_data success, when get url (%s)", url_request);
-        return true;
+        const int64_t timer_remain = event_loop.timer_deadline - get_monotonic_ms();
+        wait_ms = (timer_remain > 0 ? static_cast<int>(timer_remain) : 0);
     }
 
-    switch (status_code / 100)
+    struct epoll_event events[64];
+    const int event_count = epoll_wait(event_loop.epoll_fd, events, sizeof(events) / sizeof(events[0]), wait_ms);
+    for (int index = 0; index < event_count; ++index)
     {
-        case 2:
+        if (events[index].data.fd == event_loop.wakeup_fd)
         {
-            url_error_code = http_response_callback_error_t::callback_message_response_2xx_failure;
-            break;
+            uint64_t wakeup_count = 0;
+            while (sizeof(wakeup_count) == read(event_loop.wakeup_fd, &wakeup_count, sizeof(wakeup_count)))
+            {
+                /* drain */
+            }
+            continue;
         }
-        case 3:
+
+        int action = 0;
+        if (0 != (events[index].events & EPOLLIN))
         {
-            url_error_code = http_response_callback_error_t::callback_message_response_3xx_failure;
-            break;
+            action |= CURL_CSELECT_IN;
         }
-        case 4:
+        if (0 != (events[index].events & EPOLLOUT))
         {
-            url_error_code = http_response_callback_error_t::callback_message_response_4xx_failure;
-            break;
+            action |= CURL_CSELECT_OUT;
         }
-        case 5:
+        if (0 != (events[index].events & (EPOLLERR | EPOLLHUP)))
         {
-            url_error_code = http_response_callback_error_t::callback_message_response_5xx_failure;
-            break;
+            action |= CURL_CSELECT_ERR;
         }
-        default:
+        curl_multi_socket_action(event_loop.multi_handle, events[index].data.fd, action, &running_count);
+    }
+
+    if (event_loop.has_timer && event_loop.timer_deadline <= get_monotonic_ms())
+    {
+        event_loop.has_timer = false;
+        curl_multi_socket_action(event_loop.multi_handle, CURL_SOCKET_TIMEOUT, 0, &running_count);
+    }
+#else
+    if (event_loop.transfer_list.empty())
+    {
+        if (event_loop.handoff_count > 0)
         {
-            url_error_code = http_response_callback_error_t::callback_message_response_xxx_failure;
-            break;
+            std::unique_lock<std::mutex> handoff_lock(event_loop.handoff_mutex);
+            if (event_loop.ready_transfer_list.empty() && event_loop.returned_slot_vector.empty())
+            {
+                event_loop.handoff_condition.wait_for(handoff_lock, std::chrono::milliseconds(50));
+            }
         }
+        return; /* idle event loop has been blocked on the request queue */
     }
 
-    RUN_LOG("curl_easy_getinfo(get_data) status code (%d), when get url (%s)", status_code, url_request);
-
-    return false;
+    curl_multi_wait(event_loop.multi_handle, nullptr, 0, 50, nullptr);
+    curl_multi_perform(event_loop.multi_handle, &running_count);
+#endif // __linux__
 }
 
-bool HttpClient::get_data(const char * url_request, storage_callback_t storage_callback, void * storage_buffer, size_t & url_status_code, size_t & url_error_code)
+/* called by a completion thread with handoff mutex locked */
+static void wake_event_loop(event_loop_t & event_loop)
 {
-    if (!m_is_running)
+#ifdef __linux__
+    const uint64_t wakeup_count = 1;
+    if (sizeof(wakeup_count) != write(event_loop.wakeup_fd, &wakeup_count, sizeof(wakeup_count)) && EAGAIN != errno)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_download_been_stopped;
-        RUN_LOG("get_data failed, http_client is exit");
-        return false;
+        RUN_LOG_ERR("wake event loop (%d) failed (%d)", event_loop.wakeup_fd, errno);
     }
+#else
+    event_loop.handoff_condition.notify_one();
+#endif // __linux__
+}
 
-    if (nullptr == url_request)
+/* the loop may exit as soon as it sees the last one come back, so event_loop is not touched after the unlock */
+static void give_back_event_transfer(event_loop_t & event_loop, event_transfer_t * event_transfer)
+{
+    std::lock_guard<std::mutex> handoff_guard(event_loop.handoff_mutex);
+    event_loop.ready_transfer_list.push_back(event_transfer);
+    wake_event_loop(event_loop);
+}
+
+static void give_back_event_slot(event_loop_t & event_loop, size_t slot_index)
+{
+    std::lock_guard<std::mutex> handoff_guard(event_loop.handoff_mutex);
+    event_loop.returned_slot_vector.push_back(slot_index);
+    wake_event_loop(event_loop);
+}
+
+static void mark_event_transfer_stopped(event_transfer_t & event_transfer)
+{
+    event_transfer.download_request_status.been_stopped = true;
+    event_transfer.callback_info.status_code = 0;
+    event_transfer.callback_info.error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+    event_transfer.data_callback_info.status_code = 0;
+    event_transfer.data_callback_info.error_code = http_response_callback_error_t::callback_message_download_been_stopped;
+}
+
+void HttpClient::start_event_transfers(event_loop_t & event_loop)
+{
+    while (m_is_running && !event_loop.free_slot_vector.empty())
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
-        RUN_LOG("get_data failed, url_request is nullptr");
-        return false;
+        const size_t slot_index = event_loop.free_slot_vector.back();
+        download_request_status_t & download_request_status = m_download_request_status_vector[slot_index];
+#ifdef __linux__
+        const bool wait = false; /* wakeup eventfd interrupts epoll_wait when a request is posted */
+#else
+        const bool wait = event_loop.transfer_list.empty() && 0 == event_loop.handoff_count;
+#endif // __linux__
+        if (!acquire_download_request(download_request_status, wait))
+        {
+            break;
+        }
+        event_loop.free_slot_vector.pop_back();
+
+        event_transfer_t * event_transfer = new event_transfer_t(slot_index, download_request_status, event_loop);
+        event_loop.transfer_list.push_back(event_transfer);
+
+        if (!begin_event_transfer(event_loop, *event_transfer))
+        {
+            post_event_transfer(event_loop, event_transfer, event_transfer_t::stage_finish);
+        }
     }
+}
 
-    if (nullptr == storage_callback)
+bool HttpClient::begin_event_transfer(event_loop_t & event_loop, event_transfer_t & event_transfer)
+{
+    if (event_transfer.download_request_status.is_data_request)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
-        RUN_LOG("get_data failed, storage_callback is nullptr");
-        return false;
+        return (begin_event_data(event_loop, event_transfer));
     }
 
-    if (nullptr == storage_buffer)
+    http_download_request_t & download_request = event_transfer.download_request_status.download_request;
+
+    init_callback_info(download_request, event_transfer.callback_info);
+
+    event_transfer.curl = m_handle_pool.acquire(download_request.url_request);
+    if (nullptr == event_transfer.curl)
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_argument_invalid;
-        RUN_LOG("get_data failed, storage_buffer is nullptr");
+        event_transfer.callback_info.status_code = 0;
+        event_transfer.callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
+        RUN_LOG_ERR("curl_easy_init failed, when get url (%s)", download_request.url_request);
         return false;
     }
 
-    CURL * curl = curl_easy_init();
-    if (nullptr == curl)
+    m_connection_stats.attach(event_transfer.curl);
+
+    if (!need_check_message_digest(download_request))
     {
-        url_status_code = 0;
-        url_error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
-        RUN_LOG("curl_easy_init(get_data) failed, when get url (%s)", url_request);
-        return false;
+        post_event_transfer(event_loop, &event_transfer, event_transfer_t::stage_open); /* local digest and resume prefix are hashed off the loop */
+        return true;
     }
 
-    libcurl_get_data(curl, m_share_handle, url_request, storage_callback, storage_buffer, url_status_code, url_error_code);
-
-    curl_easy_cleanup(curl);
+    event_transfer.check_digest = true;
 
-    return http_response_callback_error_t::callback_message_response_success == url_error_code;
-}
+    libcurl_get_data_setopt(event_transfer.curl, m_share_handle, download_request.hash_request, event_transfer.get_data_userdata);
 
-static bool get_data_storage(const char * data, size_t data_len, void * storage)
-{
-    std::string * buffer = reinterpret_cast<std::string *>(storage);
-    if (nullptr == buffer)
-    {
-        return false;
-    }
-    buffer->append(data, data_len);
-    return true;
+    return (add_event_transfer(event_loop, event_transfer));
 }
 
-static bool libcurl_check_need_download(CURL * curl, CURLSH * share_handle, download_request_status_t & download_request_status, http_response_callback_info_t & callback_info)
+bool HttpClient::begin_event_data(event_loop_t & event_loop, event_transfer_t & event_transfer)
 {
-    http_download_request_t & download_request = download_request_status.download_request;
+    const http_data_request_t & data_request = event_transfer.download_request_status.data_request;
+    http_data_callback_info_t & callback_info = event_transfer.data_callback_info;
 
-    if ('\0' == download_request.hash_request[0] || '\0' == download_request.message_digest[0])
-    {
-        return true;
-    }
+    init_data_callback_info(data_request, callback_info);
 
-    std::string storage_buffer;
-    if (!libcurl_get_data(curl, share_handle, download_request.hash_request, get_data_storage, reinterpret_cast<void *>(&storage_buffer), callback_info.status_code, callback_info.error_code))
+    event_transfer.curl = m_handle_pool.acquire(data_request.url_request);
+    if (nullptr == event_transfer.curl)
     {
         callback_info.status_code = 0;
-        callback_info.error_code = http_response_callback_error_t::callback_message_get_message_digest_failure;
-        RUN_LOG("get_data(message_digest) failure, when get url (%s)", download_request.hash_request);
+        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
+        RUN_LOG_ERR("curl_easy_init(data request) failed, when get url (%s)", data_request.url_request);
         return false;
     }
 
-    const size_t digest_size = strlen(download_request.message_digest);
-    if (storage_buffer.size() < digest_size || std::string::npos != storage_buffer.substr(0, digest_size).find('<'))
+    m_connection_stats.attach(event_transfer.curl);
+
+    if (http_data_request_type_t::request_get_file_size == data_request.request_type)
     {
-        callback_info.status_code = 0;
-        callback_info.error_code = http_response_callback_error_t::callback_message_response_4xx_failure;
-        RUN_LOG("get_data(message_digest) failure, message_digest is invalid, when get url (%s)", download_request.hash_request);
-        return false;
+        libcurl_get_file_size_setopt(event_transfer.curl, m_share_handle, data_request.url_request);
     }
-    else if (0 == Stupid::Base::stupid_strncmp_ignore_case(storage_buffer.c_str(), download_request.message_digest, digest_size))
+    else
     {
-        callback_info.status_code = 200;
-        callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
-        RUN_LOG("get_data(message_digest) success (need not update), when get url (%s)", download_request.hash_request);
-        return false;
+        if (nullptr != data_request.storage_callback)
+        {
+            event_transfer.get_data_userdata.storage_callback = data_request.storage_callback;
+            event_transfer.get_data_userdata.storage_buffer = data_request.storage_buffer;
+        }
+        else
+        {
+            event_transfer.get_data_userdata.storage_callback = get_data_storage;
+            event_transfer.get_data_userdata.storage_buffer = reinterpret_cast<void *>(&event_transfer.data_buffer);
+        }
+        libcurl_get_data_setopt(event_transfer.curl, m_share_handle, data_request.url_request, event_transfer.get_data_userdata);
     }
 
-    return true;
+    return (add_event_transfer(event_loop, event_transfer));
 }
 
-struct download_userdata_t
+bool HttpClient::add_event_transfer(event_loop_t & event_loop, event_transfer_t & event_transfer)
 {
-    download_userdata_t(Stupid::Base::File & file, download_request_status_t & status);
+    curl_easy_setopt(event_transfer.curl, CURLOPT_PRIVATE, reinterpret_cast<void *>(&event_transfer));
 
-    Stupid::Base::File        & save_file;
-    download_request_status_t & download_request_status;
-};
+    if (CURLM_OK == curl_multi_add_handle(event_loop.multi_handle, event_transfer.curl))
+    {
+        return true;
+    }
 
-download_userdata_t::download_userdata_t(Stupid::Base::File & file, download_request_status_t & status)
-    : save_file(file)
-    , download_request_status(status)
-{
+    const download_request_status_t & download_request_status = event_transfer.download_request_status;
+    if (download_request_status.is_data_request)
+    {
+        event_transfer.data_callback_info.status_code = 0;
+        event_transfer.data_callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
+        RUN_LOG_ERR("curl_multi_add_handle(data request) failed, when get url (%s)", download_request_status.data_request.url_request);
+    }
+    else if (event_transfer.check_digest)
+    {
+        event_transfer.callback_info.status_code = 0;
+        event_transfer.callback_info.error_code = http_response_callback_error_t::callback_message_get_message_digest_failure;
+        RUN_LOG_ERR("curl_multi_add_handle(message_digest) failed, when get url (%s)", download_request_status.download_request.hash_request);
+    }
+    else
+    {
+        event_transfer.callback_info.status_code = 0;
+        event_transfer.callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
+        RUN_LOG_ERR("curl_multi_add_handle failed, when get url (%s)", download_request_status.download_request.url_request);
+    }
 
+    return false;
 }
 
-static size_t libcurl_download_callback(void * ptr, size_t size, size_t nmemb, void * user_data)
+void HttpClient::complete_event_transfer(event_loop_t & event_loop, event_transfer_t * event_transfer, CURLcode curl_code)
 {
-    download_userdata_t * download_userdata = reinterpret_cast<download_userdata_t *>(user_data);
-    if (nullptr == download_userdata)
+    m_connection_stats.record(event_transfer->curl);
+
+    if (event_transfer->download_request_status.is_data_request)
     {
-        return 0; /* tell libcurl to stop download */
+        m_transfer_metrics.record(event_transfer->curl, &event_transfer->data_callback_info.transfer_timing);
     }
-    if (download_userdata->download_request_status.been_stopped)
+    else
     {
-        return 0; /* tell libcurl to stop download */
+        m_transfer_metrics.record(event_transfer->curl, (event_transfer->check_digest ? nullptr : &event_transfer->callback_info.transfer_timing));
     }
-    const size_t recv_len = size * nmemb;
-    const char * data = reinterpret_cast<char *>(ptr);
-    download_userdata->save_file.write(data, recv_len);
-    return recv_len;
+
+    event_transfer->curl_code = curl_code;
+
+    post_event_transfer(event_loop, event_transfer, event_transfer_t::stage_done);
 }
 
-static bool libcurl_download(CURL * curl, CURLSH * share_handle, download_request_status_t & download_request_status, http_response_callback_info_t & callback_info)
+void HttpClient::post_event_transfer(event_loop_t & event_loop, event_transfer_t * event_transfer, size_t stage)
 {
-    http_download_request_t & download_request = download_request_status.download_request;
-
-    const std::string temp_save_pathname(download_request.save_pathname + std::string(".http.temp"));
-    Stupid::Base::File file;
-    if (!file.open(temp_save_pathname.c_str(), true, true))
+    if (nullptr != event_transfer->curl)
     {
-        callback_info.status_code = 0;
-        callback_info.error_code = http_response_callback_error_t::callback_message_create_file_failure;
-        RUN_LOG("create file (%s) failed, when get url (%s)", temp_save_pathname.c_str(), download_request.url_request);
-        return false;
+        curl_multi_remove_handle(event_loop.multi_handle, event_transfer->curl);
     }
 
-    download_userdata_t download_userdata(file, download_request_status);
+    event_loop.transfer_list.remove(event_transfer);
+    ++event_loop.handoff_count;
 
-    curl_easy_setopt(curl, CURLOPT_SHARE, share_handle);
-    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 0L);
-    curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L); /* zero means blocking, do not use other values */
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 5L);
-    curl_easy_setopt(curl, CURLOPT_URL, download_request.url_request);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, libcurl_download_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, reinterpret_cast<void *>(&download_userdata));
+    event_transfer->stage = static_cast<event_transfer_t::stage_t>(stage);
+    m_event_transfer_queue.push(event_transfer);
+}
 
-    CURLcode curl_code = CURLE_OK;
+void HttpClient::collect_event_transfers(event_loop_t & event_loop)
+{
+    std::list<event_transfer_t *> ready_transfer_list;
+    {
+        std::lock_guard<std::mutex> handoff_guard(event_loop.handoff_mutex);
+        ready_transfer_list.swap(event_loop.ready_transfer_list);
+        event_loop.handoff_count -= ready_transfer_list.size() + event_loop.returned_slot_vector.size();
+        event_loop.free_slot_vector.insert(event_loop.free_slot_vector.end(), event_loop.returned_slot_vector.begin(), event_loop.returned_slot_vector.end());
+        event_loop.returned_slot_vector.clear();
+    }
 
-    curl_code = curl_easy_perform(curl);
-    if (CURLE_OK != curl_code)
+    for (std::list<event_transfer_t *>::iterator iter = ready_transfer_list.begin(); ready_transfer_list.end() != iter; ++iter)
     {
-        callback_info.status_code = 0;
-        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_perform_failure;
-        const char * curl_error = curl_easy_strerror(curl_code);
-        RUN_LOG("curl_easy_perform failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), download_request.url_request);
-        return false;
+        event_transfer_t * event_transfer = *iter;
+        event_loop.transfer_list.push_back(event_transfer);
+        if (event_transfer->download_request_status.been_stopped)
+        {
+            mark_event_transfer_stopped(*event_transfer);
+            post_event_transfer(event_loop, event_transfer, event_transfer_t::stage_finish);
+        }
+        else if (!add_event_transfer(event_loop, *event_transfer))
+        {
+            post_event_transfer(event_loop, event_transfer, event_transfer_t::stage_finish);
+        }
     }
+}
 
-    long status_code = 0;
+void HttpClient::stop_event_transfers(event_loop_t & event_loop, bool stop_all)
+{
+    std::list<event_transfer_t *> stopped_transfer_list;
 
-    curl_code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
-    if (CURLE_OK != curl_code)
+    for (std::list<event_transfer_t *>::iterator iter = event_loop.transfer_list.begin(); event_loop.transfer_list.end() != iter; ++iter)
     {
-        callback_info.status_code = 0;
-        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_getinfo_failure;
-        const char * curl_error = curl_easy_strerror(curl_code);
-        RUN_LOG("curl_easy_getinfo(status_code) failed (%s), when get url (%s)", (nullptr == curl_error ? "unknown" : curl_error), download_request.url_request);
-        return false;
+        if (stop_all || (*iter)->download_request_status.been_stopped)
+        {
+            stopped_transfer_list.push_back(*iter);
+        }
     }
 
-    file.close();
+    for (std::list<event_transfer_t *>::iterator iter = stopped_transfer_list.begin(); stopped_transfer_list.end() != iter; ++iter)
+    {
+        mark_event_transfer_stopped(**iter);
+        post_event_transfer(event_loop, *iter, event_transfer_t::stage_finish);
+    }
+}
 
-    if (200L == status_code)
+void HttpClient::wake_event_loops()
+{
+#ifdef __linux__
+    for (std::vector<int>::iterator iter = m_event_wakeup_fd_vector.begin(); m_event_wakeup_fd_vector.end() != iter; ++iter)
     {
-        Stupid::Base::stupid_unlink_safe(download_request.save_pathname);
-        if (!Stupid::Base::stupid_rename_safe(temp_save_pathname.c_str(), download_request.save_pathname))
+        const uint64_t wakeup_count = 1;
+        if (sizeof(wakeup_count) != write(*iter, &wakeup_count, sizeof(wakeup_count)) && EAGAIN != errno)
         {
-            callback_info.status_code = 0;
-            callback_info.error_code = http_response_callback_error_t::callback_message_rename_file_failure;
-            RUN_LOG("rename file (%s) -> (%s) failed, when get url (%s)", temp_save_pathname.c_str(), download_request.save_pathname, download_request.url_request);
-            return false;
+            RUN_LOG_ERR("wake event loop (%d) failed (%d)", *iter, errno);
         }
     }
-    else
+#endif // __linux__
+}
+
+void HttpClient::do_event_loop(size_t thread_index)
+{
+    assert(thread_index < m_max_downloader_count);
+
+    RUN_LOG_INF("do event loop thread - %u begin", thread_index);
+
+    event_loop_t event_loop;
+#ifdef __linux__
+    event_loop.wakeup_fd = m_event_wakeup_fd_vector[thread_index];
+#endif // __linux__
+    if (!init_event_loop(event_loop))
     {
-        Stupid::Base::stupid_unlink_safe(temp_save_pathname.c_str());
+        RUN_LOG_CRI("do event loop thread - %u init failure", thread_index);
+        exit_event_loop(event_loop);
+        return;
     }
 
-    callback_info.status_code = status_code;
-
-    if (200L == status_code)
+    for (size_t slot_index = thread_index; slot_index < m_download_request_status_vector.size(); slot_index += m_max_downloader_count)
     {
-        callback_info.error_code = http_response_callback_error_t::callback_message_response_success;
-        RUN_LOG("url_download_with_libcurl success, when get url (%s)", download_request.url_request);
-        return true;
+        event_loop.free_slot_vector.push_back(slot_index);
     }
 
-    switch (status_code / 100)
+    while (m_is_running)
     {
-        case 2:
-        {
-            callback_info.error_code = http_response_callback_error_t::callback_message_response_2xx_failure;
-            break;
-        }
-        case 3:
-        {
-            callback_info.error_code = http_response_callback_error_t::callback_message_response_3xx_failure;
-            break;
-        }
-        case 4:
-        {
-            callback_info.error_code = http_response_callback_error_t::callback_message_response_4xx_failure;
-            break;
-        }
-        case 5:
-        {
-            callback_info.error_code = http_response_callback_error_t::callback_message_response_5xx_failure;
-            break;
-        }
-        default:
+        collect_event_transfers(event_loop);
+
+        start_event_transfers(event_loop);
+
+        drive_event_loop(event_loop);
+
+        CURLMsg * curl_message = nullptr;
+        int message_count = 0;
+        while (nullptr != (curl_message = curl_multi_info_read(event_loop.multi_handle, &message_count)))
         {
-            callback_info.error_code = http_response_callback_error_t::callback_message_response_xxx_failure;
-            break;
+            if (CURLMSG_DONE != curl_message->msg)
+            {
+                continue;
+            }
+
+            CURL * curl = curl_message->easy_handle;
+            const CURLcode curl_code = curl_message->data.result;
+
+            char * private_data = nullptr;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, &private_data);
+            event_transfer_t * event_transfer = reinterpret_cast<event_transfer_t *>(private_data);
+            if (nullptr != event_transfer)
+            {
+                complete_event_transfer(event_loop, event_transfer, curl_code);
+            }
         }
+
+        stop_event_transfers(event_loop, false);
+    }
+
+    /*
+     * the wakeup of a transfer given back may have been read by the last pass, so collect before waiting,
+     * and what comes back from the completion threads is stopped as well
+     */
+    collect_event_transfers(event_loop);
+    stop_event_transfers(event_loop, true);
+    while (event_loop.handoff_count > 0) /* the completion threads still hold transfers of this loop */
+    {
+        drive_event_loop(event_loop);
+        collect_event_transfers(event_loop);
+        stop_event_transfers(event_loop, true);
     }
 
-    RUN_LOG("curl_easy_getinfo status code (%d), when get url (%s)", status_code, download_request.url_request);
+    exit_event_loop(event_loop);
 
-    return false;
+    RUN_LOG_INF("do event loop thread - %u end", thread_index);
 }
 
-bool HttpClient::url_download_with_libcurl(download_request_status_t & download_request_status, http_response_callback_info_t & callback_info)
+/* the file work of a transfer, it runs on a completion thread, so the transfer is not in curl multi */
+bool HttpClient::open_event_download(event_transfer_t & event_transfer)
 {
-    http_download_request_t & download_request = download_request_status.download_request;
+    http_download_request_t & download_request = event_transfer.download_request_status.download_request;
 
-    callback_info.status_code = 0;
-    callback_info.error_code = http_response_callback_error_t::callback_message_response_xxx_failure;
-    callback_info.user_data = download_request.user_data;
-    strncpy(callback_info.url_request, download_request.url_request, sizeof(callback_info.url_request));
-    strncpy(callback_info.save_pathname, download_request.save_pathname, sizeof(callback_info.save_pathname));
+    std::string save_dirname;
+    Stupid::Base::stupid_extract_directory(download_request.save_pathname, save_dirname, true);
+    Stupid::Base::stupid_create_directory_recursive(save_dirname);
 
-    CURL * curl = curl_easy_init();
-    if (nullptr == curl)
+    if (need_check_local_message_digest(download_request))
     {
-        callback_info.status_code = 0;
-        callback_info.error_code = http_response_callback_error_t::callback_message_libcurl_init_failure;
-        RUN_LOG("curl_easy_init failed, when get url (%s)", download_request.url_request);
-        return false;
+        event_transfer.download_userdata.expected_digest = download_request.message_digest;
+        if (!check_local_message_digest(m_digest_index, download_request, event_transfer.callback_info))
+        {
+            return false;
+        }
     }
 
-    if (!download_request_status.been_stopped && libcurl_check_need_download(curl, m_share_handle, download_request_status, callback_info) && !download_request_status.been_stopped)
+    event_transfer.check_digest = false;
+    if (!libcurl_download_open(event_transfer.download_userdata, event_transfer.callback_info))
     {
-        libcurl_download(curl, m_share_handle, download_request_status, callback_info);
+        return false;
     }
 
-    curl_easy_cleanup(curl);
+    libcurl_download_setopt(event_transfer.curl, m_share_handle, event_transfer.download_userdata);
 
-    return http_response_callback_error_t::callback_message_response_success == callback_info.error_code;
+    return true;
 }
 
-static bool unzip_file(const std::string & unzip_dirname, const std::string & zip_filename, bool & been_stopped)
+/* returns true if the message digest was got and differs, so the download must begin */
+bool HttpClient::check_event_transfer(event_transfer_t & event_transfer)
 {
-#ifdef _MSC_VER
-    /*
-    Stupid::Base::ThreadLocker s_unzip_locker;
-    Stupid::Base::Guard<Stupid::Base::ThreadLocker> unzip_guard(s_unzip_locker);
+    download_request_status_t & download_request_status = event_transfer.download_request_status;
 
-    std::string current_dirname;
-    Stupid::Base::stupid_get_current_work_directory(current_dirname);
-    if (!Stupid::Base::stupid_set_current_work_directory(Stupid::Base::ansi_to_utf8(unzip_dirname).c_str()))
+    if (download_request_status.is_data_request)
     {
-        RUN_LOG("set current work directory failure (%s)", unzip_dirname.c_str());
+        const http_data_request_t & data_request = download_request_status.data_request;
+        http_data_callback_info_t & data_callback_info = event_transfer.data_callback_info;
+        if (http_data_request_type_t::request_get_file_size == data_request.request_type)
+        {
+            libcurl_get_file_size_result(event_transfer.curl, event_transfer.curl_code, data_request.url_request, data_callback_info.file_size, data_callback_info.status_code, data_callback_info.error_code);
+        }
+        else
+        {
+            libcurl_get_data_result(event_transfer.curl, event_transfer.curl_code, data_request.url_request, data_callback_info.status_code, data_callback_info.error_code);
+        }
+        return false;
     }
-    */
 
-    HZIP hzip = OpenZip(const_cast<char *>(zip_filename.c_str()), 0, ZIP_FILENAME);
-    if (nullptr == hzip)
+    http_download_request_t & download_request = download_request_status.download_request;
+    http_response_callback_info_t & callback_info = event_transfer.callback_info;
+
+    if (!event_transfer.check_digest)
     {
-        RUN_LOG("openzip(%s) failed", zip_filename.c_str());
+        libcurl_download_result(event_transfer.curl, event_transfer.curl_code, event_transfer.download_userdata, callback_info);
         return false;
     }
 
-    ZIPENTRY zipentry = { 0 };
-    ZRESULT zresult = GetZipItem(hzip, -1, &zipentry);
-    if (ZR_OK != zresult)
+    if (!libcurl_get_data_result(event_transfer.curl, event_transfer.curl_code, download_request.hash_request, callback_info.status_code, callback_info.error_code))
     {
-        RUN_LOG("getzipitem(%s) failed(%u)", zip_filename.c_str(), zresult);
+        callback_info.status_code = 0;
+        callback_info.error_code = http_response_callback_error_t::callback_message_get_message_digest_failure;
+        RUN_LOG_ERR("get_data(message_digest) failure, when get url (%s)", download_request.hash_request);
+        return false;
     }
-    const int count = zipentry.index;
-    for (int index = 0; index < count && !been_stopped; ++index)
+
+    if (!check_message_digest(download_request, event_transfer.digest_buffer, callback_info))
     {
-        ZRESULT zresult_get = GetZipItem(hzip, index, &zipentry);
-        if (ZR_OK != zresult_get)
-        {
-            RUN_LOG("getzipitem(%s) failed(get_ret=%u)", zip_filename.c_str(), zresult_get);
-        }
-        const std::string unzip_filename(unzip_dirname + zipentry.name);
-        ZRESULT zresult_unzip = UnzipItem(hzip, index, const_cast<char *>(unzip_filename.c_str()), 0, ZIP_FILENAME);
-        if (ZR_OK != zresult_unzip)
-        {
-            RUN_LOG("unzipitem(%s) failed(get_ret=%u, unzip_ret=%u)", zip_filename.c_str(), zresult_get, zresult_unzip);
-        }
+        return false;
     }
 
-    CloseZip(hzip);
+    event_transfer.download_userdata.expected_digest = get_response_message_digest(event_transfer.digest_buffer);
 
-    /*
-    Stupid::Base::stupid_set_current_work_directory(current_dirname);
-    */
-#endif // _MSC_VER
-    return !been_stopped;
+    return true;
 }
 
-void HttpClient::do_download(size_t thread_index)
+void HttpClient::run_event_transfer(event_transfer_t * event_transfer)
 {
-    assert(thread_index < m_download_request_status_vector.size());
-
-    RUN_LOG("do download thread - %u begin", thread_index);
-
-    download_request_status_t & download_request_status = m_download_request_status_vector[thread_index];
-
-    while (m_is_running)
+    bool need_download = (event_transfer_t::stage_open == event_transfer->stage);
+    if (event_transfer_t::stage_done == event_transfer->stage)
     {
-        bool has_request = false;
+        need_download = check_event_transfer(*event_transfer);
+    }
 
+    if (need_download)
+    {
+        if (event_transfer->download_request_status.been_stopped)
         {
-            thread_locker_guard_t list_guard(m_download_request_list_locker);
-            if (!m_download_request_list.empty())
-            {
-                download_request_status.been_stopped = false;
-                download_request_status.download_request = m_download_request_list.front();
-                m_download_request_list.pop_front();
-                has_request = true;
-            }
+            mark_event_transfer_stopped(*event_transfer);
         }
-
-        if (!m_is_running)
+        else if (open_event_download(*event_transfer))
         {
-            break;
+            give_back_event_transfer(event_transfer->event_loop, event_transfer);
+            return;
         }
+    }
 
-        if (!has_request)
-        {
-            Stupid::Base::stupid_ms_sleep(50);
-            continue;
-        }
+    finish_event_transfer(event_transfer);
+}
 
-        {
-            thread_locker_guard_t set_guard(m_download_request_set_locker);
-            if (m_download_request_set.end() == m_download_request_set.find(download_request_status.download_request))
-            {
-                continue; /* has been stopped and removed */
-            }
-        }
+void HttpClient::finish_event_transfer(event_transfer_t * event_transfer)
+{
+    download_request_status_t & download_request_status = event_transfer->download_request_status;
 
-        http_download_request_t & download_request = download_request_status.download_request;
+    if (nullptr != event_transfer->curl)
+    {
+        m_handle_pool.release((download_request_status.is_data_request ? download_request_status.data_request.url_request : download_request_status.download_request.url_request), event_transfer->curl);
+        event_transfer->curl = nullptr;
+    }
 
-        std::string save_dirname;
-        Stupid::Base::stupid_extract_directory(download_request.save_pathname, save_dirname, true);
-        Stupid::Base::stupid_create_directory_recursive(save_dirname);
+    event_transfer->save_file.close();
 
-        http_response_callback_info_t callback_info;
-        if (url_download_with_libcurl(download_request_status, callback_info) && download_request.need_unzip)
-        {
-            if (!unzip_file(Stupid::Base::utf8_to_ansi(save_dirname), Stupid::Base::utf8_to_ansi(download_request.save_pathname), download_request_status.been_stopped))
-            {
-                callback_info.status_code = 0;
-                callback_info.error_code = http_response_callback_error_t::callback_message_unzip_file_failure;
-                RUN_LOG("unzip file (%s) failure", download_request.save_pathname);
-            }
-        }
+    if (download_request_status.is_data_request)
+    {
+        handle_data_response(download_request_status, event_transfer->data_callback_info, event_transfer->data_buffer);
+    }
+    else
+    {
+        const bool download_success = (http_response_callback_error_t::callback_message_response_success == event_transfer->callback_info.error_code);
+        handle_download_response(download_request_status, event_transfer->callback_info, download_success);
+    }
 
-        if (http_response_callback_error_t::callback_message_response_success == callback_info.error_code)
-        {
-            RUN_LOG("handle download request [%s, %s] success", download_request.url_request, download_request.save_pathname);
-        }
-        else if (download_request_status.been_stopped)
-        {
-            callback_info.error_code = http_response_callback_error_t::callback_message_download_been_stopped;
-            RUN_LOG("handle download request [%s, %s] been stopped", download_request.url_request, download_request.save_pathname);
-        }
-        else
-        {
-            RUN_LOG("handle download request [%s, %s] failure", download_request.url_request, download_request.save_pathname);
-        }
+    event_loop_t & event_loop = event_transfer->event_loop;
+    const size_t slot_index = event_transfer->slot_index;
 
-        if (nullptr != download_request.response_sink)
-        {
-            download_request.response_sink->on_response(callback_info);
-        }
+    delete event_transfer;
 
-        {
-            thread_locker_guard_t set_guard(m_download_request_set_locker);
-            m_download_request_set.erase(download_request);
-        }
+    give_back_event_slot(event_loop, slot_index);
+}
+
+void HttpClient::do_event_completion(size_t thread_index)
+{
+    RUN_LOG_INF("do event completion thread - %u begin", thread_index);
+
+    event_transfer_t * event_transfer = nullptr;
+    while (m_event_transfer_queue.pop(event_transfer))
+    {
+        run_event_transfer(event_transfer);
     }
 
-    RUN_LOG("do download thread - %u end", thread_index);
+    RUN_LOG_INF("do event completion thread - %u end", thread_index);
 }
 
 IHttpClient * create_http_client()
@@ -1079,3 +5219,13 @@ void destroy_http_client(IHttpClient * http_client)
 {
     delete http_client;
 }
+
+void set_http_client_log_level(size_t log_level)
+{
+    s_run_logger.set_level(log_level);
+}
+
+void set_http_client_log_rotation(size_t max_file_size, size_t max_file_count)
+{
+    s_run_logger.set_rotation(max_file_size, max_file_count);
+}
@@ -0,0 +1,478 @@
+/********************************************************
+ * Description : asynchronous logger with per-thread lock-free rings
+ * Author      : yanrk
+ * Email       : yanrkchina@163.com
+ * Version     : 1.0
+ * History     :
+ * Copyright(C): 2025
+ ********************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif // _MSC_VER
+#include "log/async_logger.h"
+
+/*
+ * record layout in a ring, native byte order, may wrap around the end of the ring:
+ *     time in milliseconds since the epoch (8 bytes), data size (4 bytes), data
+ */
+static const size_t RECORD_HEAD_SIZE = 12;
+
+struct AsyncLogger::ring_t
+{
+    explicit ring_t(size_t size)
+        : buffer(size)
+        , mask(size - 1)
+        , head(0)
+        , tail(0)
+        , last_time(0)
+        , retired(false)
+    {
+
+    }
+
+    std::vector<char>       buffer;     /* size is a power of two */
+    const size_t            mask;
+    std::atomic<size_t>     head;       /* bytes produced so far, stored by the owner thread only */
+    std::atomic<size_t>     tail;       /* bytes consumed so far, stored by the flusher only */
+    int64_t                 last_time;  /* owner thread only, keeps the times of one thread in order */
+    std::atomic<bool>       retired;    /* the owner thread has exited, the ring goes once it is drained */
+};
+
+struct AsyncLogger::thread_ring_t
+{
+    thread_ring_t()
+        : owner(nullptr)
+        , ring()
+    {
+
+    }
+
+    ~thread_ring_t()
+    {
+        if (ring)
+        {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+
+    const AsyncLogger     * owner;
+    std::shared_ptr<ring_t> ring;
+};
+
+struct log_record_t
+{
+    int64_t                 time;
+    size_t                  offset;
+    size_t                  size;
+};
+
+static bool operator < (const log_record_t & lhs, const log_record_t & rhs)
+{
+    return (lhs.time < rhs.time);
+}
+
+/* coarse wall clock: the tick the kernel already keeps, a few milliseconds at worst, and no system call */
+static int64_t get_coarse_time_ms()
+{
+#ifdef _MSC_VER
+    FILETIME file_time;
+    GetSystemTimeAsFileTime(&file_time);
+    const uint64_t time_100ns = (static_cast<uint64_t>(file_time.dwHighDateTime) << 32) | file_time.dwLowDateTime;
+    return static_cast<int64_t>((time_100ns - 116444736000000000ULL) / 10000);
+#else
+    struct timespec time_spec;
+#ifdef CLOCK_REALTIME_COARSE
+    clock_gettime(CLOCK_REALTIME_COARSE, &time_spec);
+#else
+    clock_gettime(CLOCK_REALTIME, &time_spec);
+#endif // CLOCK_REALTIME_COARSE
+    return static_cast<int64_t>(time_spec.tv_sec) * 1000 + time_spec.tv_nsec / 1000000;
+#endif // _MSC_VER
+}
+
+static void ring_copy_in(std::vector<char> & buffer, size_t mask, size_t position, const void * data, size_t data_len)
+{
+    const size_t offset = position & mask;
+    const size_t first = (data_len < buffer.size() - offset ? data_len : buffer.size() - offset);
+    memcpy(&buffer[offset], data, first);
+    if (first < data_len)
+    {
+        memcpy(&buffer[0], static_cast<const char *>(data) + first, data_len - first);
+    }
+}
+
+static void ring_copy_out(const std::vector<char> & buffer, size_t mask, size_t position, void * data, size_t data_len)
+{
+    const size_t offset = position & mask;
+    const size_t first = (data_len < buffer.size() - offset ? data_len : buffer.size() - offset);
+    memcpy(data, &buffer[offset], first);
+    if (first < data_len)
+    {
+        memcpy(static_cast<char *>(data) + first, &buffer[0], data_len - first);
+    }
+}
+
+AsyncLogger::AsyncLogger(const char * pathname, size_t level, size_t ring_size, uint32_t flush_interval_ms, size_t max_file_size, size_t max_file_count)
+    : m_name(nullptr != pathname ? pathname : "")
+    , m_file()
+    , m_file_size(0)
+    , m_level(level)
+    , m_max_file_size(max_file_size)
+    , m_max_file_count(max_file_count)
+    , m_ring_size(ring_size)
+    , m_flush_interval_ms(0 != flush_interval_ms ? flush_interval_ms : 1)
+    , m_rings_mutex()
+    , m_rings()
+    , m_start_mutex()
+    , m_running(false)
+    , m_flusher()
+    , m_wake_mutex()
+    , m_wake_condition()
+    , m_wake_pending(false)
+    , m_idle(false)
+    , m_stopping(false)
+    , m_dropped(0)
+    , m_dropped_reported(0)
+    , m_records()
+    , m_output()
+    , m_time_second(-1)
+{
+    memset(m_time_text, 0x00, sizeof(m_time_text));
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+    m_file.close();
+}
+
+void AsyncLogger::set_level(size_t level)
+{
+    m_level.store(level, std::memory_order_relaxed);
+}
+
+void AsyncLogger::set_rotation(size_t max_file_size, size_t max_file_count)
+{
+    m_max_file_size.store(max_file_size, std::memory_order_relaxed);
+    m_max_file_count.store(max_file_count, std::memory_order_relaxed);
+}
+
+void AsyncLogger::write(const char * data, size_t data_len)
+{
+    if (nullptr == data)
+    {
+        return;
+    }
+
+    ring_t * ring = get_ring();
+    const size_t ring_size = ring->buffer.size();
+    const size_t record_size = RECORD_HEAD_SIZE + data_len;
+    const size_t head = ring->head.load(std::memory_order_relaxed);
+    const size_t used = head - ring->tail.load(std::memory_order_acquire);
+    if (record_size > ring_size - used)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    int64_t time_ms = get_coarse_time_ms();
+    if (time_ms < ring->last_time)
+    {
+        time_ms = ring->last_time;
+    }
+    ring->last_time = time_ms;
+    const uint32_t size = static_cast<uint32_t>(data_len);
+
+    ring_copy_in(ring->buffer, ring->mask, head, &time_ms, sizeof(time_ms));
+    ring_copy_in(ring->buffer, ring->mask, head + sizeof(time_ms), &size, sizeof(size));
+    ring_copy_in(ring->buffer, ring->mask, head + RECORD_HEAD_SIZE, data, data_len);
+    ring->head.store(head + record_size, std::memory_order_seq_cst); /* ordered before m_idle is read, see run */
+
+    if (!m_running.load(std::memory_order_acquire))
+    {
+        start();
+    }
+    else if (0 == used && m_idle.load(std::memory_order_seq_cst) && m_idle.exchange(false))
+    {
+        /* the first record after a quiet spell wakes the flusher, the ones after it wait for the interval */
+        std::lock_guard<std::mutex> locker(m_wake_mutex);
+        m_wake_condition.notify_one();
+    }
+    else if (used + record_size > ring_size / 2 && !m_wake_pending.load(std::memory_order_relaxed) && !m_wake_pending.exchange(true))
+    {
+        /* do not wait for the interval when the ring is filling up */
+        m_wake_condition.notify_one();
+    }
+}
+
+uint64_t AsyncLogger::dropped() const
+{
+    return (m_dropped.load(std::memory_order_relaxed));
+}
+
+AsyncLogger::ring_t * AsyncLogger::get_ring()
+{
+    static thread_local thread_ring_t s_thread_ring;
+    if (this != s_thread_ring.owner || !s_thread_ring.ring)
+    {
+        if (s_thread_ring.ring)
+        {
+            s_thread_ring.ring->retired.store(true, std::memory_order_release);
+        }
+
+        size_t ring_size = 4096; /* holds the largest record run_log makes */
+        while (ring_size < m_ring_size && ring_size < (static_cast<size_t>(1) << 30))
+        {
+            ring_size <<= 1;
+        }
+        s_thread_ring.ring = std::make_shared<ring_t>(ring_size);
+        s_thread_ring.owner = this;
+
+        {
+            std::lock_guard<std::mutex> locker(m_rings_mutex);
+            m_rings.push_back(s_thread_ring.ring);
+        }
+    }
+    return (s_thread_ring.ring.get());
+}
+
+void AsyncLogger::start()
+{
+    std::lock_guard<std::mutex> start_locker(m_start_mutex);
+    if (!m_running.load(std::memory_order_relaxed))
+    {
+        m_flusher = std::thread(&AsyncLogger::run, this);
+        m_running.store(true, std::memory_order_release);
+    }
+}
+
+void AsyncLogger::stop()
+{
+    std::lock_guard<std::mutex> start_locker(m_start_mutex);
+    if (m_flusher.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> locker(m_wake_mutex);
+            m_stopping.store(true, std::memory_order_release);
+        }
+        m_wake_condition.notify_all();
+        m_flusher.join();
+        m_stopping.store(false, std::memory_order_relaxed);
+    }
+    drain();
+    m_running.store(false, std::memory_order_release);
+}
+
+void AsyncLogger::run()
+{
+    size_t drained_count = 1;
+    while (!m_stopping.load(std::memory_order_acquire))
+    {
+        {
+            std::unique_lock<std::mutex> locker(m_wake_mutex);
+            if (0 == drained_count)
+            {
+                /* idle is set before the rings are looked at, and a write sets head before it reads idle, so one of the two sees the other */
+                m_idle.store(true, std::memory_order_seq_cst);
+                if (rings_empty())
+                {
+                    m_wake_condition.wait(locker, [this]() { return (!m_idle.load(std::memory_order_relaxed) || m_stopping.load(std::memory_order_relaxed)); });
+                }
+                m_idle.store(false, std::memory_order_relaxed);
+            }
+            else if (!m_stopping.load(std::memory_order_relaxed) && !m_wake_pending.load(std::memory_order_relaxed))
+            {
+                m_wake_condition.wait_for(locker, std::chrono::milliseconds(m_flush_interval_ms));
+            }
+        }
+        m_wake_pending.store(false, std::memory_order_relaxed);
+        drained_count = drain();
+    }
+}
+
+bool AsyncLogger::rings_empty()
+{
+    std::lock_guard<std::mutex> locker(m_rings_mutex);
+    for (size_t index = 0; index < m_rings.size(); ++index)
+    {
+        if (m_rings[index]->head.load(std::memory_order_seq_cst) != m_rings[index]->tail.load(std::memory_order_relaxed))
+        {
+            return (false);
+        }
+    }
+    return (m_dropped.load(std::memory_order_relaxed) == m_dropped_reported);
+}
+
+size_t AsyncLogger::drain()
+{
+    std::vector<std::shared_ptr<ring_t>> rings;
+    {
+        std::lock_guard<std::mutex> locker(m_rings_mutex);
+        rings = m_rings;
+    }
+
+    std::vector<log_record_t> records;
+    bool has_retired = false;
+    m_records.clear();
+
+    for (size_t index = 0; index < rings.size(); ++index)
+    {
+        ring_t & ring = *rings[index];
+        /* retired is read before head, so a retired ring is empty once what head shows is consumed */
+        has_retired = ring.retired.load(std::memory_order_acquire) || has_retired;
+        const size_t head = ring.head.load(std::memory_order_acquire);
+        size_t tail = ring.tail.load(std::memory_order_relaxed);
+        while (tail != head)
+        {
+            log_record_t record;
+            uint32_t size = 0;
+            ring_copy_out(ring.buffer, ring.mask, tail, &record.time, sizeof(record.time));
+            ring_copy_out(ring.buffer, ring.mask, tail + sizeof(record.time), &size, sizeof(size));
+            record.offset = m_records.size();
+            record.size = size;
+            m_records.resize(m_records.size() + size);
+            ring_copy_out(ring.buffer, ring.mask, tail + RECORD_HEAD_SIZE, m_records.data() + record.offset, size);
+            records.push_back(record);
+            tail += RECORD_HEAD_SIZE + size;
+        }
+        ring.tail.store(tail, std::memory_order_release);
+    }
+
+    if (has_retired)
+    {
+        std::lock_guard<std::mutex> locker(m_rings_mutex);
+        for (std::vector<std::shared_ptr<ring_t>>::iterator iter = m_rings.begin(); m_rings.end() != iter;)
+        {
+            ring_t & ring = **iter;
+            if (ring.retired.load(std::memory_order_acquire) && ring.head.load(std::memory_order_acquire) == ring.tail.load(std::memory_order_relaxed))
+            {
+                iter = m_rings.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    /* each ring is in time order already, this merges the threads (to the millisecond, records of the same millisecond stay grouped by thread) */
+    std::stable_sort(records.begin(), records.end());
+
+    const uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_dropped_reported)
+    {
+        char notice[128] = { 0 };
+        const int notice_size = snprintf(notice, sizeof(notice), " | %s | dropped %llu log records, the ring of the thread was full", "WARN", static_cast<unsigned long long>(dropped - m_dropped_reported));
+        log_record_t record;
+        record.time = (records.empty() ? get_coarse_time_ms() : records.back().time);
+        record.offset = m_records.size();
+        record.size = (notice_size < 0 ? 0 : notice_size < static_cast<int>(sizeof(notice)) ? static_cast<size_t>(notice_size) : sizeof(notice) - 1);
+        m_records.insert(m_records.end(), notice, notice + record.size);
+        records.push_back(record);
+        m_dropped_reported = dropped;
+    }
+
+    if (!records.empty() && !m_file.is_open())
+    {
+        open_file();
+    }
+
+    /* the lines go out in one write, unless the file has to be rotated between two of them */
+    const size_t max_file_size = m_max_file_size.load(std::memory_order_relaxed);
+    m_output.clear();
+    for (size_t index = 0; index < records.size(); ++index)
+    {
+        const size_t line_begin = m_output.size();
+        m_output += format_time(records[index].time);
+        m_output.append(m_records.data() + records[index].offset, records[index].size);
+#ifdef _MSC_VER
+        OutputDebugStringA(m_output.c_str() + line_begin);
+#endif // _MSC_VER
+        m_output += '\n';
+        if (0 != max_file_size && m_file_size + m_output.size() > max_file_size && m_file_size + line_begin > 0)
+        {
+            write_file(m_output.data(), line_begin);
+            m_output.erase(0, line_begin);
+            rotate_file();
+        }
+    }
+    write_file(m_output.data(), m_output.size());
+
+    return (records.size());
+}
+
+void AsyncLogger::write_file(const char * data, size_t data_len)
+{
+    if (data_len > 0)
+    {
+        m_file.write(data, data_len);
+        m_file.flush();
+        m_file_size += data_len;
+    }
+}
+
+/* what the previous run left is kept as the first backup rather than truncated */
+void AsyncLogger::open_file()
+{
+    std::ifstream old_file(m_name.c_str(), std::ios::binary | std::ios::ate);
+    const bool has_old_file = (old_file.is_open() && old_file.tellg() > 0);
+    old_file.close();
+    if (has_old_file)
+    {
+        rotate_file();
+        return;
+    }
+    m_file.open(m_name.c_str(), std::ios::binary | std::ios::trunc);
+    m_file_size = 0;
+}
+
+void AsyncLogger::rotate_file()
+{
+    m_file.close();
+
+    const size_t max_file_count = m_max_file_count.load(std::memory_order_relaxed);
+    if (max_file_count > 0)
+    {
+        char older_name[32] = { 0 };
+        char newer_name[32] = { 0 };
+        snprintf(older_name, sizeof(older_name), ".%u", static_cast<unsigned int>(max_file_count));
+        std::remove((m_name + older_name).c_str());
+        for (size_t index = max_file_count - 1; index > 0; --index)
+        {
+            snprintf(newer_name, sizeof(newer_name), ".%u", static_cast<unsigned int>(index));
+            std::rename((m_name + newer_name).c_str(), (m_name + older_name).c_str());
+            memcpy(older_name, newer_name, sizeof(older_name));
+        }
+        std::rename(m_name.c_str(), (m_name + older_name).c_str());
+    }
+
+    m_file.open(m_name.c_str(), std::ios::binary | std::ios::trunc);
+    m_file_size = 0;
+}
+
+const char * AsyncLogger::format_time(int64_t time_ms)
+{
+    const int64_t time_second = time_ms / 1000;
+    if (time_second != m_time_second)
+    {
+        const time_t seconds = static_cast<time_t>(time_second);
+        struct tm time_value;
+        memset(&time_value, 0x00, sizeof(time_value));
+#ifdef _MSC_VER
+        localtime_s(&time_value, &seconds);
+#else
+        localtime_r(&seconds, &time_value);
+#endif // _MSC_VER
+        strftime(m_time_text, sizeof(m_time_text), "%Y-%m-%d %H:%M:%S", &time_value);
+        m_time_second = time_second;
+    }
+    const size_t second_size = 19; /* yyyy-mm-dd hh:mm:ss */
+    snprintf(m_time_text + second_size, sizeof(m_time_text) - second_size, ".%03d", static_cast<int>(time_ms % 1000));
+    return (m_time_text);
+}
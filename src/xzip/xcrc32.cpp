@@ -0,0 +1,271 @@
+// XCrc32.cpp
+//
+// CRC-32 for XZip and XUnzip, see XCrc32.h.
+//
+// The PCLMULQDQ kernel folds 64 bytes per step in the bit-reflected domain,
+// following Gopal et al., "Fast CRC Computation for Generic Polynomials
+// Using PCLMULQDQ Instruction" (Intel, 2009); the constants are the ones
+// given at the end of that paper for the zip polynomial 0xedb88320.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "xzip/xcrc32.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define XCRC32_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define XCRC32_TARGET_PCLMUL
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define XCRC32_TARGET_PCLMUL __attribute__((target("sse4.1,pclmul")))
+#endif // _MSC_VER
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define XCRC32_ARM64
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <intrin.h>
+#define XCRC32_TARGET_CRC
+#else
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#ifdef __clang__
+#define XCRC32_TARGET_CRC __attribute__((target("crc")))
+#else
+#define XCRC32_TARGET_CRC __attribute__((target("+crc")))
+#endif // __clang__
+#endif // _MSC_VER
+#endif
+
+
+typedef uint32_t (*crc32_kernel)(uint32_t crc, const unsigned char *buf, size_t len);
+
+
+// Slicing-by-8 tables: table[0] is the classic byte table, table[k][n] is
+// the CRC of byte n followed by k zero bytes.
+struct crc32_tables
+{ uint32_t table[8][256];
+
+  crc32_tables()
+  { for (uint32_t n=0; n<256; n++)
+    { uint32_t c=n;
+      for (int k=0; k<8; k++) c = (c&1) ? (0xedb88320U ^ (c>>1)) : (c>>1);
+      table[0][n]=c;
+    }
+    for (uint32_t n=0; n<256; n++)
+    { uint32_t c=table[0][n];
+      for (int k=1; k<8; k++) {c = table[0][c&0xff] ^ (c>>8); table[k][n]=c;}
+    }
+  }
+};
+
+static const crc32_tables & get_crc32_tables()
+{ static const crc32_tables tables;
+  return tables;
+}
+
+static inline uint32_t load_le32(const unsigned char *p)
+{ return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+// crc here is the inverted running value, as inside zlib's crc32()
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *buf, size_t len)
+{ const uint32_t (*t)[256] = get_crc32_tables().table;
+  while (len>=8)
+  { uint32_t one = crc ^ load_le32(buf);
+    uint32_t two = load_le32(buf+4);
+    crc = t[7][one&0xff] ^ t[6][(one>>8)&0xff] ^ t[5][(one>>16)&0xff] ^ t[4][one>>24]
+        ^ t[3][two&0xff] ^ t[2][(two>>8)&0xff] ^ t[1][(two>>16)&0xff] ^ t[0][two>>24];
+    buf+=8; len-=8;
+  }
+  while (len--) crc = t[0][(crc ^ *buf++)&0xff] ^ (crc>>8);
+  return crc;
+}
+
+
+#ifdef XCRC32_X86
+
+// len must be a multiple of 16 and at least 64
+XCRC32_TARGET_PCLMUL
+static uint32_t crc32_pclmul_fold(uint32_t crc, const unsigned char *buf, size_t len)
+{ const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  x0 = k1k2;
+  buf += 64; len -= 64;
+
+  // fold four 128-bit lanes in parallel
+  while (len >= 64)
+  { x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    buf += 64; len -= 64;
+  }
+
+  // fold the four lanes into one
+  x0 = k3k4;
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // fold the remaining 16-byte blocks
+  while (len >= 16)
+  { x2 = _mm_loadu_si128((const __m128i *)buf);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    buf += 16; len -= 16;
+  }
+
+  // 128 bits down to 64
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+  x0 = k5k0;
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x0 = poly;
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *buf, size_t len)
+{ if (len>=64)
+  { size_t chunk = len & ~(size_t)15;
+    crc = crc32_pclmul_fold(crc, buf, chunk);
+    buf+=chunk; len-=chunk;
+  }
+  return crc32_slice8(crc, buf, len);
+}
+
+static bool has_pclmul()
+{ unsigned int ecx=0;
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0]<1) return false;
+  __cpuid(info, 1);
+  ecx = (unsigned int)info[2];
+#else
+  unsigned int eax=0, ebx=0, edx=0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+  return (ecx & (1u<<1))!=0 && (ecx & (1u<<19))!=0; // PCLMULQDQ and SSE4.1
+}
+
+#endif // XCRC32_X86
+
+
+#ifdef XCRC32_ARM64
+
+XCRC32_TARGET_CRC
+static uint32_t crc32_armv8(uint32_t crc, const unsigned char *buf, size_t len)
+{ while (len>0 && ((uintptr_t)buf & 7)!=0) {crc = __crc32b(crc, *buf++); len--;}
+  while (len>=32)
+  { uint64_t a, b, c, d;
+    memcpy(&a, buf, 8); memcpy(&b, buf+8, 8); memcpy(&c, buf+16, 8); memcpy(&d, buf+24, 8);
+    crc = __crc32d(crc, a); crc = __crc32d(crc, b); crc = __crc32d(crc, c); crc = __crc32d(crc, d);
+    buf+=32; len-=32;
+  }
+  while (len>=8) {uint64_t a; memcpy(&a, buf, 8); crc = __crc32d(crc, a); buf+=8; len-=8;}
+  while (len>0) {crc = __crc32b(crc, *buf++); len--;}
+  return crc;
+}
+
+static bool has_armv8_crc()
+{
+#if defined(_MSC_VER)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE)!=FALSE;
+#elif defined(__APPLE__) || defined(__ARM_FEATURE_CRC32)
+  return true;
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32)!=0;
+#else
+  return false;
+#endif
+}
+
+#endif // XCRC32_ARM64
+
+
+struct crc32_engine
+{ crc32_kernel kernel;
+  const char *name;
+
+  crc32_engine() : kernel(crc32_slice8), name("slice-by-8")
+  {
+#if defined(XCRC32_X86)
+    if (has_pclmul()) {kernel=crc32_pclmul; name="pclmul";}
+#elif defined(XCRC32_ARM64)
+    if (has_armv8_crc()) {kernel=crc32_armv8; name="armv8-crc";}
+#endif
+    get_crc32_tables(); // build the tables before any thread needs them
+  }
+};
+
+static const crc32_engine & get_crc32_engine()
+{ static const crc32_engine engine;
+  return engine;
+}
+
+
+unsigned long xcrc32(unsigned long crc, const unsigned char *buf, size_t len)
+{ if (buf==NULL) return 0L;
+  return get_crc32_engine().kernel(~(uint32_t)crc, buf, len) ^ 0xffffffffUL;
+}
+
+unsigned long xcrc32_portable(unsigned long crc, const unsigned char *buf, size_t len)
+{ if (buf==NULL) return 0L;
+  return crc32_slice8(~(uint32_t)crc, buf, len) ^ 0xffffffffUL;
+}
+
+const char *xcrc32_engine()
+{ return get_crc32_engine().name;
+}
@@ -106,9 +106,38 @@
 #include <string.h>
 #include <tchar.h>
 #include "xzip/xunzip.h"
+#include "xzip/xcrc32.h"
 
 #pragma warning(disable : 4996)	// disable bogus deprecation warning
 
+
+#else
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include "xzip/xunzip.h"
+#include "xzip/xcrc32.h"
+
+
+#endif // _MSC_VER
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 // THIS FILE is almost entirely based upon code by Jean-loup Gailly
 // and Mark Adler. It has been modified by Lucian Wischik.
 // The original code may be found at http://www.gzip.org/zlib/
@@ -203,9 +232,11 @@ void zfree(void *buf)
 }
 */
 
+#ifdef _MSC_VER
 #pragma warning(disable : 4702)   // unreachable code
+#endif
 
-static ZRESULT zopenerror = ZR_OK; //+++1.2
+static thread_local ZRESULT zopenerror = ZR_OK; //+++1.2
 
 typedef struct tm_unz_s {
     unsigned int tm_sec;            // seconds after the minute - [0,59]
@@ -231,8 +262,8 @@ typedef struct unz_file_info_s {
     unsigned long compression_method;   // compression method              2 bytes
     unsigned long dosDate;              // last mod file date in Dos fmt   4 bytes
     unsigned long crc;                  // crc-32                          4 bytes
-    unsigned long compressed_size;      // compressed size                 4 bytes
-    unsigned long uncompressed_size;    // uncompressed size               4 bytes
+    unsigned long long compressed_size;   // compressed size               4 bytes, 8 in zip64
+    unsigned long long uncompressed_size; // uncompressed size             4 bytes, 8 in zip64
     unsigned long size_filename;        // filename length                 2 bytes
     unsigned long size_file_extra;      // extra field length              2 bytes
     unsigned long size_file_comment;    // file comment length             2 bytes
@@ -313,6 +344,7 @@ typedef struct unz_file_info_s {
 typedef unsigned char  Byte;  // 8 bits
 typedef unsigned int   uInt;  // 16 bits or more
 typedef unsigned long  uLong; // 32 bits or more
+typedef unsigned long long uLong64; // 64 bits, zip64 sizes and offsets
 typedef void *voidpf;
 typedef void     *voidp;
 typedef long z_off_t;
@@ -1540,9 +1572,8 @@ int inflate_blocks(inflate_blocks_statef *s, z_streamp z, int r)
                                    &s->sub.trees.tb, s->hufts, z);
             if (t != Z_OK) {
                 ZFREE(z, s->sub.trees.blens);
+                s->mode = IBM_BAD; // blens is gone, so inflate_blocks_reset must not free it again (zlib 1.1.4)
                 r = t;
-                if (r == Z_DATA_ERROR)
-                    s->mode = IBM_BAD;
                 LEAVE
             }
             s->sub.trees.index = 0;
@@ -1600,8 +1631,7 @@ int inflate_blocks(inflate_blocks_statef *s, z_streamp z, int r)
                                           s->hufts, z);
                 ZFREE(z, s->sub.trees.blens);
                 if (t != Z_OK) {
-                    if (t == (uInt)Z_DATA_ERROR)
-                        s->mode = IBM_BAD;
+                    s->mode = IBM_BAD; // blens is gone, so inflate_blocks_reset must not free it again (zlib 1.1.4)
                     r = t;
                     LEAVE
                 }
@@ -2044,6 +2074,178 @@ int inflate_trees_fixed(
 //struct inflate_codes_state {int dummy;}; // for buggy compilers
 
 
+#if XUNZIP_FAST_INFLATE
+
+// The fast loop below keeps the bit buffer in 64 bits and refills it eight
+// bytes at a time with no test per byte: after a refill it holds 56 to 63
+// bits, enough for a whole length/distance pair (at most 15+5+15+13 = 48
+// bits), so nothing inside one code needs to check for more input. Matches
+// are copied 16 or 8 bytes at a time when the distance is at least that,
+// which may write up to 15 bytes past the match, so the window must have
+// that much room left beyond it as well.
+
+static inline uLong64 load_le64(const Byte *p)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return (uLong64)p[0] | ((uLong64)p[1]<<8) | ((uLong64)p[2]<<16) | ((uLong64)p[3]<<24) |
+           ((uLong64)p[4]<<32) | ((uLong64)p[5]<<40) | ((uLong64)p[6]<<48) | ((uLong64)p[7]<<56);
+#else
+    uLong64 v;
+    memcpy(&v, p, 8);
+    return v;
+#endif
+}
+
+// refill the bit buffer, needs at least eight bytes of input
+#define REFILL64 {b|=load_le64(p)<<k;c=(63-k)>>3;p+=c;n-=c;k|=56;}
+// return unused bytes and clear the bits above k that the refill read ahead
+#define UNGRAB64 {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;b&=((uLong64)1<<k)-1;}
+#define UPDATE64 {s->bitb=(uLong)b;s->bitk=k;UPDIN UPDOUT}
+
+// Called with number of bytes left to write in window at least 258
+// (the maximum string length) and number of input bytes available
+// at least ten.
+
+int inflate_fast(
+    uInt bl, uInt bd,
+    const inflate_huft *tl,
+    const inflate_huft *td, // need separate declaration for Borland C++
+    inflate_blocks_statef *s,
+    z_streamp z)
+{
+    const inflate_huft *t;      // temporary pointer
+    uInt e;               // extra bits or operation
+    uLong64 b;            // bit buffer
+    uInt k;               // bits in bit buffer
+    Byte *p;             // input data pointer
+    uInt n;               // bytes available there
+    Byte *q;             // output window write pointer
+    uInt m;               // bytes to end of window or read pointer
+    uInt ml;              // mask for literal/length tree
+    uInt md;              // mask for distance tree
+    uInt c;               // bytes to copy
+    uInt d;               // distance back to copy from
+    Byte *r;             // copy source pointer
+    Byte *qe;            // end of the copy
+
+    // load input, output, bit values
+    p=z->next_in;n=z->avail_in;b=s->bitb;k=s->bitk;
+    LOADOUT
+
+    // initialize masks
+    ml = inflate_mask[bl];
+    md = inflate_mask[bd];
+
+    // do until not enough input or output space for fast loop
+    do {                          // assume called with m >= 258 && n >= 10
+        REFILL64
+        if ((e = (t = tl + ((uInt)b & ml))->exop) == 0) {
+            DUMPBITS(t->bits)
+            *q++ = (Byte)t->base;
+            m--;
+            continue;
+        }
+        for (;;) {
+            DUMPBITS(t->bits)
+            if (e & 16) {
+                // get extra bits for length
+                e &= 15;
+                c = t->base + ((uInt)b & inflate_mask[e]);
+                DUMPBITS(e)
+
+                // decode distance base of block to copy
+                e = (t = td + ((uInt)b & md))->exop;
+                for (;;) {
+                    DUMPBITS(t->bits)
+                    if (e & 16) {
+                        // get extra bits to add to distance base
+                        e &= 15;
+                        d = t->base + ((uInt)b & inflate_mask[e]);
+                        DUMPBITS(e)
+
+                        // do the copy
+                        m -= c;
+                        if ((uInt)(q - s->window) >= d) {   // offset before dest
+                            r = q - d;
+                            qe = q + c;
+                            if (d >= 16 && m >= 16) {
+                                do {
+                                    memcpy(q, r, 16);
+                                    q += 16;
+                                    r += 16;
+                                } while (q < qe);
+                                q = qe;
+                            } else if (d >= 8 && m >= 8) {
+                                do {
+                                    memcpy(q, r, 8);
+                                    q += 8;
+                                    r += 8;
+                                } while (q < qe);
+                                q = qe;
+                            } else if (d == 1) {
+                                memset(q, *r, c);
+                                q = qe;
+                            } else {
+                                do {
+                                    *q++ = *r++;
+                                } while (--c);
+                            }
+                        } else {                    // else offset after destination
+                            e = d - (uInt)(q - s->window); // bytes from offset to end
+                            r = s->end - e;           // pointer to offset
+                            if (c > e) {              // if source crosses,
+                                c -= e;                 // copy to end of window
+                                do {
+                                    *q++ = *r++;
+                                } while (--e);
+                                r = s->window;          // copy rest from start of window
+                            }
+                            do {                    // copy all or what's left
+                                *q++ = *r++;
+                            } while (--c);
+                        }
+                        break;
+                    } else if ((e & 64) == 0) {
+                        t += t->base;
+                        e = (t += ((uInt)b & inflate_mask[e]))->exop;
+                    } else {
+                        z->msg = (char*)"invalid distance code";
+                        UNGRAB64
+                        UPDATE64
+                        return Z_DATA_ERROR;
+                    }
+                };
+                break;
+            }
+            if ((e & 64) == 0) {
+                t += t->base;
+                if ((e = (t += ((uInt)b & inflate_mask[e]))->exop) == 0) {
+                    DUMPBITS(t->bits)
+                    *q++ = (Byte)t->base;
+                    m--;
+                    break;
+                }
+            } else if (e & 32) {
+                UNGRAB64
+                UPDATE64
+                return Z_STREAM_END;
+            } else {
+                z->msg = (char*)"invalid literal/length code";
+                UNGRAB64
+                UPDATE64
+                return Z_DATA_ERROR;
+            }
+        };
+    } while (m >= 258 && n >= 10);
+
+    // not enough input or output--restore pointers and return
+    UNGRAB64
+    UPDATE64
+    return Z_OK;
+}
+
+#else
+
 // macros for bit input with no checking and for returning unused bytes
 #define GRABBITS(j) {while(k<(j)){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
 #define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;}
@@ -2183,6 +2385,8 @@ int inflate_fast(
     return Z_OK;
 }
 
+#endif // XUNZIP_FAST_INFLATE
+
 
 
 
@@ -2260,23 +2464,11 @@ const uLong * get_crc_table()
     return (const uLong *)crc_table;
 }
 
-#define CRC_DO1(buf) crc = crc_table[((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
-#define CRC_DO2(buf)  CRC_DO1(buf); CRC_DO1(buf);
-#define CRC_DO4(buf)  CRC_DO2(buf); CRC_DO2(buf);
-#define CRC_DO8(buf)  CRC_DO4(buf); CRC_DO4(buf);
-
+// slicing-by-8, or PCLMULQDQ / ARMv8 CRC32 where available, see XCrc32.cpp
 uLong ucrc32(uLong crc, const Byte *buf, uInt len)
 {
     if (buf == Z_NULL) return 0L;
-    crc = crc ^ 0xffffffffL;
-    while (len >= 8)  {
-        CRC_DO8(buf);
-        len -= 8;
-    }
-    if (len) do {
-            CRC_DO1(buf);
-        } while (--len);
-    return crc ^ 0xffffffffL;
+    return xcrc32(crc, buf, len);
 }
 
 
@@ -2674,7 +2866,7 @@ const char unz_copyright[] = " ";//unzip 0.15 Copyright 1998 Gilles Vollant ";
 
 // unz_file_info_interntal contain internal info about a file in zipfile
 typedef struct unz_file_info_internal_s {
-    uLong offset_curfile;// relative offset of local header 4 bytes
+    uLong64 offset_curfile;// relative offset of local header 4 bytes, 8 in zip64
 } unz_file_info_internal;
 
 
@@ -2682,12 +2874,18 @@ typedef struct {
     bool is_handle; // either a handle or memory
     bool canseek;
     // for handles:
+#ifdef _MSC_VER
     HANDLE h;
+#else
+    int fd;
+    uLong64 filepos;      // relative to initial_offset; pread leaves the descriptor's own offset alone
+#endif
     bool herr;
-    unsigned long initial_offset;
+    uLong64 initial_offset;
     // for memory:
     void *buf;
-    unsigned int len,pos; // if it's a memory block
+    uLong64 len,pos;      // if it's a memory block
+    bool mapped;          // buf is a read-only mapping of a ZIP_FILENAME file, unmapped by lufclose
 } LUFILE;
 
 
@@ -2698,6 +2896,9 @@ LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
         return NULL;
     }
     //
+    void *map=NULL;         // ZIP_FILENAME files are mapped whole and then read like ZIP_MEMORY
+    uLong64 maplen=0;
+#ifdef _MSC_VER
     HANDLE h=0;
     bool canseek=false;
     *err=ZR_OK;
@@ -2722,22 +2923,88 @@ LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
         }
         DWORD type = GetFileType(h);
         canseek = (type==FILE_TYPE_DISK);
+#if XUNZIP_MMAP_FILES
+        LARGE_INTEGER size;
+        if (flags==ZIP_FILENAME && canseek && GetFileSizeEx(h,&size) && size.QuadPart>0 && (uLong64)size.QuadPart<=(uLong64)(SIZE_T)-1) {
+            HANDLE hm = CreateFileMapping(h,NULL,PAGE_READONLY,0,0,NULL);
+            if (hm!=NULL) {
+                map = MapViewOfFile(hm,FILE_MAP_READ,0,0,0);
+                CloseHandle(hm);    // the view keeps the mapping alive
+            }
+            if (map!=NULL) {
+                maplen = (uLong64)size.QuadPart;
+                CloseHandle(h);
+            }
+        }
+#endif
     }
     LUFILE *lf = new LUFILE;
-    if (flags==ZIP_HANDLE||flags==ZIP_FILENAME) {
+    if ((flags==ZIP_HANDLE||flags==ZIP_FILENAME) && map==NULL) {
         lf->is_handle=true;
         lf->canseek=canseek;
+        lf->mapped=false;
         lf->h=h;
         lf->herr=false;
         lf->initial_offset=0;
-        if (canseek)
-            lf->initial_offset = SetFilePointer(h,0,NULL,FILE_CURRENT);
+        if (canseek) {
+            LARGE_INTEGER zero, cur;
+            zero.QuadPart = 0;
+            lf->initial_offset = SetFilePointerEx(h,zero,&cur,FILE_CURRENT) ? (uLong64)cur.QuadPart : 0;
+        }
+    } else {
+#else
+    int fd=-1;
+    bool canseek=false;
+    *err=ZR_OK;
+    if (flags==ZIP_HANDLE||flags==ZIP_FILENAME) {
+        if (flags==ZIP_HANDLE) {
+            fd = dup((int)(intptr_t)z);
+            if (fd<0) {
+                *err=ZR_NODUPH;
+                return NULL;
+            }
+        } else {
+            fd = open((const char *)z, O_RDONLY | O_CLOEXEC);
+            if (fd<0) {
+                *err = ZR_NOFILE;
+                return NULL;
+            }
+        }
+        struct stat st;
+        canseek = (fstat(fd,&st)==0 && S_ISREG(st.st_mode));
+#if XUNZIP_MMAP_FILES
+        if (flags==ZIP_FILENAME && canseek && st.st_size>0 && (uLong64)st.st_size<=(uLong64)(size_t)-1) {
+            map = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+            if (map==MAP_FAILED) map=NULL;
+            else {
+                maplen = (uLong64)st.st_size;
+                close(fd);      // the mapping outlives the descriptor
+            }
+        }
+#endif
+    }
+    LUFILE *lf = new LUFILE;
+    if ((flags==ZIP_HANDLE||flags==ZIP_FILENAME) && map==NULL) {
+        lf->is_handle=true;
+        lf->canseek=canseek;
+        lf->mapped=false;
+        lf->fd=fd;
+        lf->filepos=0;
+        lf->herr=false;
+        lf->initial_offset=0;
+        if (canseek) {
+            off_t cur = lseek(fd,0,SEEK_CUR);
+            lf->initial_offset = (cur<0) ? 0 : (uLong64)cur;
+        }
     } else {
+#endif // _MSC_VER
         lf->is_handle=false;
         lf->canseek=true;
-        lf->buf=z;
-        lf->len=len;
+        lf->mapped=(map!=NULL);
+        lf->buf=(map!=NULL) ? map : z;
+        lf->len=(map!=NULL) ? maplen : len;
         lf->pos=0;
+        lf->herr=false;
         lf->initial_offset=0;
     }
     *err=ZR_OK;
@@ -2748,7 +3015,13 @@ LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
 int lufclose(LUFILE *stream)
 {
     if (stream==NULL) return EOF;
+#ifdef _MSC_VER
     if (stream->is_handle) CloseHandle(stream->h);
+    else if (stream->mapped) UnmapViewOfFile(stream->buf);
+#else
+    if (stream->is_handle) close(stream->fd);
+    else if (stream->mapped) munmap(stream->buf,(size_t)stream->len);
+#endif
     delete stream;
     return 0;
 }
@@ -2759,20 +3032,42 @@ int luferror(LUFILE *stream)
     else return 0;
 }
 
-long int luftell(LUFILE *stream)
+uLong64 luftell(LUFILE *stream)
 {
-    if (stream->is_handle && stream->canseek) return SetFilePointer(stream->h,0,NULL,FILE_CURRENT)-stream->initial_offset;
+#ifdef _MSC_VER
+    if (stream->is_handle && stream->canseek) {
+        LARGE_INTEGER zero, cur;
+        zero.QuadPart = 0;
+        if (!SetFilePointerEx(stream->h,zero,&cur,FILE_CURRENT)) return 0;
+        return (uLong64)cur.QuadPart-stream->initial_offset;
+    }
+#else
+    if (stream->is_handle && stream->canseek) return stream->filepos;
+#endif
     else if (stream->is_handle) return 0;
     else return stream->pos;
 }
 
-int lufseek(LUFILE *stream, long offset, int whence)
+int lufseek(LUFILE *stream, long long offset, int whence)
 {
     if (stream->is_handle && stream->canseek) {
-        if (whence==SEEK_SET) SetFilePointer(stream->h,stream->initial_offset+offset,0,FILE_BEGIN);
-        else if (whence==SEEK_CUR) SetFilePointer(stream->h,offset,NULL,FILE_CURRENT);
-        else if (whence==SEEK_END) SetFilePointer(stream->h,offset,NULL,FILE_END);
+#ifdef _MSC_VER
+        LARGE_INTEGER li;
+        li.QuadPart = offset;
+        if (whence==SEEK_SET) {li.QuadPart += (LONGLONG)stream->initial_offset; SetFilePointerEx(stream->h,li,NULL,FILE_BEGIN);}
+        else if (whence==SEEK_CUR) SetFilePointerEx(stream->h,li,NULL,FILE_CURRENT);
+        else if (whence==SEEK_END) SetFilePointerEx(stream->h,li,NULL,FILE_END);
+        else return 19; // EINVAL
+#else
+        if (whence==SEEK_SET) stream->filepos=offset;
+        else if (whence==SEEK_CUR) stream->filepos+=offset;
+        else if (whence==SEEK_END) {
+            struct stat st;
+            if (fstat(stream->fd,&st)!=0) return 5; // EIO
+            stream->filepos=(uLong64)st.st_size+offset-stream->initial_offset;
+        }
         else return 19; // EINVAL
+#endif
         return 0;
     } else if (stream->is_handle) return 29; // ESPIPE
     else {
@@ -2788,18 +3083,41 @@ size_t lufread(void *ptr,size_t size,size_t n,LUFILE *stream)
 {
     unsigned int toread = (unsigned int)(size*n);
     if (stream->is_handle) {
+#ifdef _MSC_VER
         DWORD red;
         BOOL res = ReadFile(stream->h,ptr,toread,&red,NULL);
         if (!res) stream->herr=true;
+#else
+        DWORD red = 0;
+        while (red < toread) {
+            ssize_t res = stream->canseek ? pread(stream->fd,(char*)ptr+red,toread-red,(off_t)(stream->initial_offset+stream->filepos+red)) : read(stream->fd,(char*)ptr+red,toread-red);
+            if (res<0 && errno==EINTR) continue;
+            if (res<0) stream->herr=true;
+            if (res<=0) break;
+            red += (DWORD)res;
+        }
+        stream->filepos += red;
+#endif
         return red/size;
     }
-    if (stream->pos+toread > stream->len) toread = stream->len-stream->pos;
+    if (stream->pos >= stream->len) toread = 0;
+    else if (stream->len-stream->pos < toread) toread = (unsigned int)(stream->len-stream->pos);
     memcpy(ptr, (char*)stream->buf + stream->pos, toread);
     DWORD red = toread;
     stream->pos += red;
     return red/size;
 }
 
+// For a memory (or mapped) LUFILE, the next n bytes in place, skipping past
+// them; NULL for a handle or if fewer than n bytes are left.
+const Byte *lufdata(LUFILE *stream,unsigned int n)
+{
+    if (stream->is_handle || stream->pos>stream->len || stream->len-stream->pos<n) return NULL;
+    const Byte *p = (const Byte *)stream->buf + stream->pos;
+    stream->pos += n;
+    return p;
+}
+
 
 
 
@@ -2809,20 +3127,20 @@ typedef struct {
     char  *read_buffer;         // internal buffer for compressed data
     z_stream stream;            // zLib stream structure for inflate
 
-    uLong pos_in_zipfile;       // position in byte on the zipfile, for fseek
+    uLong64 pos_in_zipfile;     // position in byte on the zipfile, for fseek
     uLong stream_initialised;   // flag set if stream structure is initialised
 
-    uLong offset_local_extrafield;// offset of the local extra field
+    uLong64 offset_local_extrafield;// offset of the local extra field
     uInt  size_local_extrafield;// size of the local extra field
     uLong pos_local_extrafield;   // position in the local extra field in read
 
     uLong crc32;                // crc32 of all data uncompressed
     uLong crc32_wait;           // crc32 we must obtain after decompress all
-    uLong rest_read_compressed; // number of byte to be decompressed
-    uLong rest_read_uncompressed;//number of byte to be obtained after decomp
+    uLong64 rest_read_compressed; // number of byte to be decompressed
+    uLong64 rest_read_uncompressed;//number of byte to be obtained after decomp
     LUFILE* file;                 // io structore of the zipfile
     uLong compression_method;   // compression method (0==store)
-    uLong byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
+    uLong64 byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
 } file_in_zip_read_info_s;
 
 
@@ -2830,14 +3148,14 @@ typedef struct {
 typedef struct {
     LUFILE* file;               // io structore of the zipfile
     unz_global_info gi;         // public global information
-    uLong byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
+    uLong64 byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
     uLong num_file;             // number of the current file in the zipfile
-    uLong pos_in_central_dir;   // pos of the current file in the central dir
+    uLong64 pos_in_central_dir; // pos of the current file in the central dir
     uLong current_file_ok;      // flag about the usability of the current file
-    uLong central_pos;          // position of the beginning of the central dir
+    uLong64 central_pos;        // position of the end of central dir record
 
-    uLong size_central_dir;     // size of the central directory
-    uLong offset_central_dir;   // offset of start of central directory with respect to the starting disk number
+    uLong64 size_central_dir;   // size of the central directory
+    uLong64 offset_central_dir; // offset of start of central directory with respect to the starting disk number
 
     unz_file_info cur_file_info; // public info about the current file in zip
     unz_file_info_internal cur_file_info_internal; // private info about it
@@ -2875,6 +3193,11 @@ int unzGetLocalExtrafield (unzFile file, voidp buf, unsigned len);
 
 int unzlocal_getByte(LUFILE *fin,int *pi)
 {
+    const Byte *p = lufdata(fin,1);
+    if (p!=NULL) {
+        *pi = (int)p[0];
+        return UNZ_OK;
+    }
     unsigned char c;
     int err = (int)lufread(&c, 1, 1, fin);
     if (err==1) {
@@ -2891,6 +3214,11 @@ int unzlocal_getByte(LUFILE *fin,int *pi)
 // Reads a long in LSB order from the given gz_stream. Sets
 int unzlocal_getShort (LUFILE *fin,uLong *pX)
 {
+    const Byte *p = lufdata(fin,2);
+    if (p!=NULL) {
+        *pX = (uLong)p[0] | ((uLong)p[1]<<8);
+        return UNZ_OK;
+    }
     uLong x ;
     int i;
     int err;
@@ -2911,6 +3239,11 @@ int unzlocal_getShort (LUFILE *fin,uLong *pX)
 
 int unzlocal_getLong (LUFILE *fin,uLong *pX)
 {
+    const Byte *p = lufdata(fin,4);
+    if (p!=NULL) {
+        *pX = (uLong)p[0] | ((uLong)p[1]<<8) | ((uLong)p[2]<<16) | ((uLong)p[3]<<24);
+        return UNZ_OK;
+    }
     uLong x ;
     int i;
     int err;
@@ -2937,6 +3270,16 @@ int unzlocal_getLong (LUFILE *fin,uLong *pX)
     return err;
 }
 
+int unzlocal_getLong64 (LUFILE *fin,uLong64 *pX)
+{
+    uLong lo=0, hi=0;
+    int err = unzlocal_getLong(fin,&lo);
+    if (err==UNZ_OK)
+        err = unzlocal_getLong(fin,&hi);
+    *pX = (err==UNZ_OK) ? ((uLong64)hi<<32) | lo : 0;
+    return err;
+}
+
 
 // My own strcmpi / strcasecmp
 int strcmpcasenosensitive_internal (const char* fileName1,const char *fileName2)
@@ -2978,21 +3321,21 @@ int unzStringFileNameCompare (const char*fileName1,const char*fileName2,int iCas
 
 //  Locate the Central directory of a zipfile (at the end, just before
 // the global comment)
-uLong unzlocal_SearchCentralDir(LUFILE *fin)
+uLong64 unzlocal_SearchCentralDir(LUFILE *fin)
 {
     if (lufseek(fin,0,SEEK_END) != 0) return 0;
-    uLong uSizeFile = luftell(fin);
+    uLong64 uSizeFile = luftell(fin);
 
-    uLong uMaxBack=0xffff; // maximum size of global comment
+    uLong64 uMaxBack=0xffff; // maximum size of global comment
     if (uMaxBack>uSizeFile) uMaxBack = uSizeFile;
 
     unsigned char *buf = (unsigned char*)zmalloc(BUFREADCOMMENT+4);
     if (buf==NULL) return 0;
-    uLong uPosFound=0;
+    uLong64 uPosFound=0;
 
-    uLong uBackRead = 4;
+    uLong64 uBackRead = 4;
     while (uBackRead<uMaxBack) {
-        uLong uReadSize,uReadPos ;
+        uLong64 uReadSize,uReadPos ;
         int i;
         if (uBackRead+BUFREADCOMMENT>uMaxBack) uBackRead = uMaxBack;
         else uBackRead+=BUFREADCOMMENT;
@@ -3012,6 +3355,29 @@ uLong unzlocal_SearchCentralDir(LUFILE *fin)
     return uPosFound;
 }
 
+//  Locate the zip64 end of central directory record from the zip64 locator
+// that sits right before the end of central directory record at central_pos;
+// 0 if the zipfile is not a zip64 one
+uLong64 unzlocal_SearchCentralDir64(LUFILE *fin,uLong64 central_pos)
+{
+    if (central_pos<20) return 0;
+    if (lufseek(fin,central_pos-20,SEEK_SET)!=0) return 0;
+    uLong uL, number_disk;
+    uLong64 pos64;
+    if (unzlocal_getLong(fin,&uL)!=UNZ_OK || uL!=0x07064b50) return 0;
+    if (unzlocal_getLong(fin,&number_disk)!=UNZ_OK) return 0;
+    if (unzlocal_getLong64(fin,&pos64)!=UNZ_OK) return 0;
+    // the locator's offset ignores any bytes before the zipfile (sfx), so if
+    // the record is not there, look for it right before the locator
+    if (lufseek(fin,pos64,SEEK_SET)==0 && unzlocal_getLong(fin,&uL)==UNZ_OK && uL==0x06064b50)
+        return pos64;
+    if (central_pos<20+56) return 0;
+    pos64 = central_pos-20-56;
+    if (lufseek(fin,pos64,SEEK_SET)==0 && unzlocal_getLong(fin,&uL)==UNZ_OK && uL==0x06064b50)
+        return pos64;
+    return 0;
+}
+
 
 int unzGoToFirstFile (unzFile file);
 int unzCloseCurrentFile (unzFile file);
@@ -3034,7 +3400,8 @@ unzFile unzOpenInternal(LUFILE *fin)
 
     int err=UNZ_OK;
     unz_s us;
-    uLong central_pos,uL;
+    uLong uL;
+    uLong64 central_pos;
     central_pos = unzlocal_SearchCentralDir(fin);
     if (central_pos==0) err=UNZ_ERRNO;
     if (lufseek(fin,central_pos,SEEK_SET)!=0) err=UNZ_ERRNO;
@@ -3053,12 +3420,34 @@ unzFile unzOpenInternal(LUFILE *fin)
     if (unzlocal_getShort(fin,&number_entry_CD)!=UNZ_OK) err=UNZ_ERRNO;
     if ((number_entry_CD!=us.gi.number_entry) || (number_disk_with_CD!=0) || (number_disk!=0)) err=UNZ_BADZIPFILE;
     // size of the central directory
-    if (unzlocal_getLong(fin,&us.size_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+    if (unzlocal_getLong(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;
+    us.size_central_dir = uL;
     // offset of start of central directory with respect to the starting disk number
-    if (unzlocal_getLong(fin,&us.offset_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+    if (unzlocal_getLong(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;
+    us.offset_central_dir = uL;
     // zipfile comment length
     if (unzlocal_getShort(fin,&us.gi.size_comment)!=UNZ_OK) err=UNZ_ERRNO;
-    if ((central_pos+fin->initial_offset<us.offset_central_dir+us.size_central_dir) && (err==UNZ_OK)) err=UNZ_BADZIPFILE;
+    // a zip64 end of central directory record, if there is one, holds the
+    // real entry count, size and offset (the ones above are then 0xffff...)
+    uLong64 end_pos = central_pos;
+    uLong64 central_pos64 = (err==UNZ_OK) ? unzlocal_SearchCentralDir64(fin,central_pos) : 0;
+    if (central_pos64!=0) {
+        uLong64 size_record, number_entry64, number_entry_CD64;
+        if (lufseek(fin,central_pos64+4,SEEK_SET)!=0) err=UNZ_ERRNO;
+        if (unzlocal_getLong64(fin,&size_record)!=UNZ_OK) err=UNZ_ERRNO;
+        if (unzlocal_getShort(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;     // version made by
+        if (unzlocal_getShort(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;     // version needed to extract
+        if (unzlocal_getLong(fin,&number_disk)!=UNZ_OK) err=UNZ_ERRNO;
+        if (unzlocal_getLong(fin,&number_disk_with_CD)!=UNZ_OK) err=UNZ_ERRNO;
+        if (unzlocal_getLong64(fin,&number_entry64)!=UNZ_OK) err=UNZ_ERRNO;
+        if (unzlocal_getLong64(fin,&number_entry_CD64)!=UNZ_OK) err=UNZ_ERRNO;
+        if (unzlocal_getLong64(fin,&us.size_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+        if (unzlocal_getLong64(fin,&us.offset_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+        if ((number_entry_CD64!=number_entry64) || (number_disk_with_CD!=0) || (number_disk!=0) || (number_entry64>0x7fffffff)) err=UNZ_BADZIPFILE;
+        us.gi.number_entry = (uLong)number_entry64;
+        end_pos = central_pos64;
+    }
+    if ((end_pos+fin->initial_offset<us.offset_central_dir+us.size_central_dir) && (err==UNZ_OK)) err=UNZ_BADZIPFILE;
     //if (err!=UNZ_OK) {lufclose(fin);return NULL;}
     if (err!=UNZ_OK) {
         lufclose(fin);    //+++1.2
@@ -3067,7 +3456,7 @@ unzFile unzOpenInternal(LUFILE *fin)
     }
 
     us.file=fin;
-    us.byte_before_the_zipfile = central_pos+fin->initial_offset - (us.offset_central_dir+us.size_central_dir);
+    us.byte_before_the_zipfile = end_pos+fin->initial_offset - (us.offset_central_dir+us.size_central_dir);
     us.central_pos = central_pos;
     us.pfile_in_zip_read = NULL;
     fin->initial_offset = 0; // since the zipfile itself is expected to handle this
@@ -3128,6 +3517,52 @@ void unzlocal_DosDateToTmuDate (uLong ulDosDate, tm_unz* ptm)
     ptm->tm_sec =  (uInt) (2*(ulDosDate&0x1f)) ;
 }
 
+//  Replace the 0xffffffff sizes and offset of a zip64 entry with the 64-bit
+// values from its zip64 extended information extra field (header 0x0001),
+// which has only the fields whose 32-bit value is 0xffffffff, in this order
+int unzlocal_GetZip64ExtraField(LUFILE *fin,uLong64 extra_pos,uLong extra_len,
+        unz_file_info *pfile_info,unz_file_info_internal *pfile_info_internal)
+{
+    if (extra_len==0) return UNZ_BADZIPFILE;
+    if (lufseek(fin,extra_pos,SEEK_SET)!=0) return UNZ_ERRNO;
+    Byte *extra = (Byte*)zmalloc(extra_len);
+    if (extra==NULL) return UNZ_INTERNALERROR;
+    if (lufread(extra,(uInt)extra_len,1,fin)!=1) {
+        zfree(extra);
+        return UNZ_ERRNO;
+    }
+    int err=UNZ_BADZIPFILE;
+    uLong epos=0;
+    while (epos+4<=extra_len) {
+        uLong id = extra[epos] | (extra[epos+1]<<8);
+        uLong size = extra[epos+2] | (extra[epos+3]<<8);
+        epos += 4;
+        if (epos+size>extra_len) break;
+        if (id!=0x0001) {
+            epos += size;
+            continue;
+        }
+        const Byte *p = extra+epos;
+        const Byte *pend = p+size;
+        uLong64 *fields[3] = {&pfile_info->uncompressed_size,&pfile_info->compressed_size,&pfile_info_internal->offset_curfile};
+        err=UNZ_OK;
+        for (int i=0; i<3 && err==UNZ_OK; i++) {
+            if (*fields[i]!=0xffffffff) continue;
+            if (pend-p<8) {
+                err=UNZ_BADZIPFILE;
+                break;
+            }
+            uLong64 v=0;
+            for (int b=7; b>=0; b--) v = (v<<8) | p[b];
+            *fields[i]=v;
+            p+=8;
+        }
+        break;
+    }
+    zfree(extra);
+    return err;
+}
+
 //  Get Info about the current file in the zipfile, with internal only info
 int unzlocal_GetCurrentFileInfoInternal (unzFile file,
         unz_file_info *pfile_info,
@@ -3149,7 +3584,7 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
     unz_file_info file_info;
     unz_file_info_internal file_info_internal;
     int err=UNZ_OK;
-    uLong uMagic;
+    uLong uMagic,uL;
     long lSeek=0;
 
     if (file==NULL)
@@ -3186,11 +3621,13 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
     if (unzlocal_getLong(s->file,&file_info.crc) != UNZ_OK)
         err=UNZ_ERRNO;
 
-    if (unzlocal_getLong(s->file,&file_info.compressed_size) != UNZ_OK)
+    if (unzlocal_getLong(s->file,&uL) != UNZ_OK)
         err=UNZ_ERRNO;
+    file_info.compressed_size = uL;
 
-    if (unzlocal_getLong(s->file,&file_info.uncompressed_size) != UNZ_OK)
+    if (unzlocal_getLong(s->file,&uL) != UNZ_OK)
         err=UNZ_ERRNO;
+    file_info.uncompressed_size = uL;
 
     if (unzlocal_getShort(s->file,&file_info.size_filename) != UNZ_OK)
         err=UNZ_ERRNO;
@@ -3210,8 +3647,18 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
     if (unzlocal_getLong(s->file,&file_info.external_fa) != UNZ_OK)
         err=UNZ_ERRNO;
 
-    if (unzlocal_getLong(s->file,&file_info_internal.offset_curfile) != UNZ_OK)
+    if (unzlocal_getLong(s->file,&uL) != UNZ_OK)
         err=UNZ_ERRNO;
+    file_info_internal.offset_curfile = uL;
+
+    if ((err==UNZ_OK) && (file_info.compressed_size==0xffffffff || file_info.uncompressed_size==0xffffffff ||
+                          file_info_internal.offset_curfile==0xffffffff || file_info.disk_num_start==0xffff)) {
+        err = unzlocal_GetZip64ExtraField(s->file,
+                  s->pos_in_central_dir+s->byte_before_the_zipfile+SIZECENTRALDIRITEM+file_info.size_filename,
+                  file_info.size_file_extra,&file_info,&file_info_internal);
+        if ((err==UNZ_OK) && (lufseek(s->file,s->pos_in_central_dir+s->byte_before_the_zipfile+SIZECENTRALDIRITEM,SEEK_SET)!=0))
+            err=UNZ_ERRNO;
+    }
 
     lSeek+=file_info.size_filename;
     if ((err==UNZ_OK) && (szFileName!=NULL)) {
@@ -3394,7 +3841,7 @@ int unzLocateFile (unzFile file, const TCHAR *szFileName, int iCaseSensitivity)
 //  store in *piSizeVar the size of extra info in local header
 //        (filename and size of extra field data)
 int unzlocal_CheckCurrentFileCoherencyHeader (unz_s *s,uInt *piSizeVar,
-        uLong *poffset_local_extrafield, uInt  *psize_local_extrafield)
+        uLong64 *poffset_local_extrafield, uInt  *psize_local_extrafield)
 {
     uLong uMagic,uData,uFlags;
     uLong size_filename;
@@ -3440,16 +3887,17 @@ int unzlocal_CheckCurrentFileCoherencyHeader (unz_s *s,uInt *piSizeVar,
              ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
+    // 0xffffffff: the size is in the zip64 extra field, the central one is used
     if (unzlocal_getLong(s->file,&uData) != UNZ_OK) // size compr
         err=UNZ_ERRNO;
     else if ((err==UNZ_OK) && (uData!=s->cur_file_info.compressed_size) &&
-             ((uFlags & 8)==0))
+             (uData!=0xffffffff) && ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
     if (unzlocal_getLong(s->file,&uData) != UNZ_OK) // size uncompr
         err=UNZ_ERRNO;
     else if ((err==UNZ_OK) && (uData!=s->cur_file_info.uncompressed_size) &&
-             ((uFlags & 8)==0))
+             (uData!=0xffffffff) && ((uFlags & 8)==0))
         err=UNZ_BADZIPFILE;
 
 
@@ -3484,7 +3932,7 @@ int unzOpenCurrentFile (unzFile file)
     uInt iSizeVar;
     unz_s* s;
     file_in_zip_read_info_s* pfile_in_zip_read_info;
-    uLong offset_local_extrafield;  // offset of the local extra field
+    uLong64 offset_local_extrafield;// offset of the local extra field
     uInt  size_local_extrafield;    // size of the local extra field
 
     if (file==NULL)
@@ -3592,27 +4040,31 @@ int unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
     while (pfile_in_zip_read_info->stream.avail_out>0) {
         if ((pfile_in_zip_read_info->stream.avail_in==0) && (pfile_in_zip_read_info->rest_read_compressed>0)) {
-            uInt uReadThis = UNZ_BUFSIZE;
+            // memory and mapped files are inflated in place, handles through read_buffer
+            const bool inplace = !pfile_in_zip_read_info->file->is_handle;
+            uInt uReadThis = inplace ? 0x7fffffff : UNZ_BUFSIZE;
             if (pfile_in_zip_read_info->rest_read_compressed<uReadThis) uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
             if (uReadThis == 0) return UNZ_EOF;
             if (lufseek(pfile_in_zip_read_info->file, pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile,SEEK_SET)!=0) return UNZ_ERRNO;
-            if (lufread(pfile_in_zip_read_info->read_buffer,uReadThis,1,pfile_in_zip_read_info->file)!=1) return UNZ_ERRNO;
+            const Byte *data = (const Byte*)pfile_in_zip_read_info->read_buffer;
+            if (inplace) {
+                data = lufdata(pfile_in_zip_read_info->file,uReadThis);
+                if (data==NULL) return UNZ_ERRNO;
+            } else if (lufread(pfile_in_zip_read_info->read_buffer,uReadThis,1,pfile_in_zip_read_info->file)!=1) return UNZ_ERRNO;
             pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
             pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
-            pfile_in_zip_read_info->stream.next_in = (Byte*)pfile_in_zip_read_info->read_buffer;
+            pfile_in_zip_read_info->stream.next_in = (Byte*)data;
             pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
         }
 
         if (pfile_in_zip_read_info->compression_method==0) {
-            uInt uDoCopy,i ;
+            uInt uDoCopy ;
             if (pfile_in_zip_read_info->stream.avail_out < pfile_in_zip_read_info->stream.avail_in) {
                 uDoCopy = pfile_in_zip_read_info->stream.avail_out ;
             } else {
                 uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
             }
-            for (i=0; i<uDoCopy; i++) {
-                *(pfile_in_zip_read_info->stream.next_out+i) = *(pfile_in_zip_read_info->stream.next_in+i);
-            }
+            memcpy(pfile_in_zip_read_info->stream.next_out,pfile_in_zip_read_info->stream.next_in,uDoCopy);
             pfile_in_zip_read_info->crc32 = ucrc32(pfile_in_zip_read_info->crc32,pfile_in_zip_read_info->stream.next_out,uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
             pfile_in_zip_read_info->stream.avail_in -= uDoCopy;
@@ -3800,6 +4252,50 @@ int unzReadCurrentFile (unzFile file, void *buf, unsigned len);
 int unzCloseCurrentFile (unzFile file);
 
 
+#ifndef _MSC_VER
+
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL // 1970-01-01 in 100 nanoseconds since 1601-01-01
+
+FILETIME timet2filetime(time_t timer)
+{
+    unsigned long long t = (unsigned long long)((long long)timer * 10000000LL + (long long)FILETIME_UNIX_EPOCH);
+    FILETIME ft;
+    ft.dwLowDateTime = (DWORD)(t & 0xFFFFFFFF);
+    ft.dwHighDateTime = (DWORD)(t >> 32);
+    return ft;
+}
+
+struct timespec filetime2timespec(const FILETIME &ft)
+{
+    unsigned long long t = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(((long long)t - (long long)FILETIME_UNIX_EPOCH) / 10000000LL);
+    ts.tv_nsec = (long)((t % 10000000ULL) * 100);
+    return ts;
+}
+
+// dos date and time are local time
+FILETIME dosdatetime2filetime(WORD dosdate, WORD dostime)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = ((dosdate >> 9) & 0x7F) + 80;
+    tm.tm_mon = ((dosdate >> 5) & 0x0F) - 1;
+    tm.tm_mday = dosdate & 0x1F;
+    tm.tm_hour = (dostime >> 11) & 0x1F;
+    tm.tm_min = (dostime >> 5) & 0x3F;
+    tm.tm_sec = (dostime & 0x1F) * 2;
+    tm.tm_isdst = -1;
+    return timet2filetime(mktime(&tm));
+}
+
+static void CreateDirectory(const TCHAR *dir, void *)
+{
+    mkdir(dir, 0755);
+}
+
+#else
+
 FILETIME timet2filetime(time_t timer)
 {
     struct tm *tm = gmtime(&timer);
@@ -3816,24 +4312,56 @@ FILETIME timet2filetime(time_t timer)
     return ft;
 }
 
+#endif // _MSC_VER
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-class TUnzip
+// names of all the items, so that Find needn't walk the central directory;
+// a name that occurs more than once maps to its first item, as unzLocateFile
+// would find it. Once built it is never changed, so clones share it.
+struct TUnzipIndex
 {
-public:
-    TUnzip() : uf(0), currentfile(-1), czei(-1) {}
+    std::unordered_map<std::string,int> names;  // as stored
+    std::unordered_map<std::string,int> folded; // a-z folded to A-Z, as strcmpcasenosensitive_internal does
+};
 
-    unzFile uf;
-    int currentfile;
-    ZIPENTRY cze;
+static std::string FoldZipName(const char *name)
+{
+    std::string folded(name);
+    for (size_t i=0; i<folded.size(); i++) {
+        if (folded[i]>='a' && folded[i]<='z')
+            folded[i] -= (char)0x20;
+    }
+    return folded;
+}
+
+class TUnzip
+{
+public:
+    TUnzip() : uf(0), currentfile(-1), czei(-1), openflags(0), openbuf(0), openlen(0) {}
+
+    unzFile uf;
+    int currentfile;
+    ZIPENTRY cze;
     int czei;
     TCHAR rootdir[MAX_PATH];
+    std::vector<uLong64> centralpos; // where each item found so far starts in the central directory
+    DWORD openflags;               // what the zip was opened from, so that it can be cloned
+    TCHAR openname[MAX_PATH];
+    void *openbuf;
+    unsigned int openlen;
+    std::shared_ptr<const TUnzipIndex> nameindex; // built by the first lookup by name
 
     ZRESULT Open(void *z,unsigned int len,DWORD flags);
+    ZRESULT Clone(const TUnzip &src);
+    ZRESULT GoTo(int index);
     ZRESULT Get(int index,ZIPENTRY *ze);
+    ZRESULT Index();
+    int Lookup(const TCHAR *name,bool ic);
     ZRESULT Find(const TCHAR *name,bool ic,int *index,ZIPENTRY *ze);
     ZRESULT Unzip(int index,void *dst,unsigned int len,DWORD flags);
+    ZRESULT UnzipMany(const TCHAR *const *names,int count,bool ic,const TCHAR *dir,ZRESULT *results);
     ZRESULT Close();
 };
 
@@ -3842,6 +4370,7 @@ ZRESULT TUnzip::Open(void *z,unsigned int len,DWORD flags)
 {
     if (uf!=0 || currentfile!=-1)
         return ZR_NOTINITED;
+#ifdef _MSC_VER
     GetCurrentDirectory(MAX_PATH,rootdir);
     _tcscat(rootdir,_T("\\"));
     if (flags==ZIP_HANDLE) {
@@ -3849,15 +4378,78 @@ ZRESULT TUnzip::Open(void *z,unsigned int len,DWORD flags)
         if (type!=FILE_TYPE_DISK)
             return ZR_SEEK;
     }
+#else
+    if (getcwd(rootdir,MAX_PATH-1)==NULL)
+        rootdir[0]=0;
+    _tcscat(rootdir,_T("/"));
+    if (flags==ZIP_HANDLE) {
+        struct stat st;
+        if (fstat((int)(intptr_t)z,&st)!=0 || !S_ISREG(st.st_mode))
+            return ZR_SEEK;
+    }
+#endif
     ZRESULT e;
     LUFILE *f = lufopen(z,len,flags,&e);
     if (f==NULL)
         return e;
     uf = unzOpenInternal(f);
+    if (uf!=0) {
+        openflags=flags;
+        if (flags==ZIP_FILENAME) {
+            _tcsncpy(openname,(const TCHAR*)z,MAX_PATH-1);
+            openname[MAX_PATH-1]=0;
+        }
+        else
+            openbuf=z;
+        openlen=len;
+        if (uf->gi.number_entry>0)
+            centralpos.push_back(uf->pos_in_central_dir);
+    }
     //return ZR_OK;
     return zopenerror;	//+++1.2
 }
 
+ZRESULT TUnzip::Clone(const TUnzip &src)
+{
+    // a duplicated handle would share its file position with the original
+    if (src.uf==0 || src.openflags==ZIP_HANDLE)
+        return ZR_ARGS;
+    ZRESULT zr = Open(src.openflags==ZIP_FILENAME ? (void*)src.openname : src.openbuf, src.openlen, src.openflags);
+    if (zr!=ZR_OK)
+        return zr;
+    _tcscpy(rootdir,src.rootdir);
+    centralpos=src.centralpos;
+    nameindex=src.nameindex;
+    return ZR_OK;
+}
+
+// makes index the current file, straight from its place in the central directory
+// if that is known, otherwise by walking there from the last place that is known
+ZRESULT TUnzip::GoTo(int index)
+{
+    if (index<0 || index>=(int)uf->gi.number_entry)
+        return ZR_ARGS;
+    if (index==(int)uf->num_file && uf->current_file_ok)
+        return ZR_OK;
+    int known = (int)centralpos.size()-1;
+    int start = (index<known ? index : known);
+    if (start!=(int)uf->num_file || !uf->current_file_ok) {
+        uf->pos_in_central_dir=centralpos[start];
+        uf->num_file=start;
+        int err=unzlocal_GetCurrentFileInfoInternal(uf,&uf->cur_file_info,&uf->cur_file_info_internal,NULL,0,NULL,0,NULL,0);
+        uf->current_file_ok=(err==UNZ_OK);
+        if (err!=UNZ_OK)
+            return ZR_CORRUPT;
+    }
+    while ((int)uf->num_file<index) {
+        if (unzGoToNextFile(uf)!=UNZ_OK)
+            return ZR_CORRUPT;
+        if ((int)uf->num_file==(int)centralpos.size())
+            centralpos.push_back(uf->pos_in_central_dir);
+    }
+    return ZR_OK;
+}
+
 ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
 {
     if (index<-1 || index>=(int)uf->gi.number_entry)
@@ -3883,8 +4475,9 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
         ze->unc_size=0;
         return ZR_OK;
     }
-    if (index<(int)uf->num_file) unzGoToFirstFile(uf);
-    while ((int)uf->num_file<index) unzGoToNextFile(uf);
+    ZRESULT zr=GoTo(index);
+    if (zr!=ZR_OK)
+        return zr;
     unz_file_info ufi;
     char fn[MAX_PATH];
     unzGetCurrentFileInfo(uf,&ufi,fn,MAX_PATH,NULL,0,NULL,0);
@@ -3892,7 +4485,7 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
     // now get the extra header. We do this ourselves, instead of
     // calling unzOpenCurrentFile &c., to avoid allocating more than necessary.
     unsigned int extralen,iSizeVar;
-    unsigned long offset;
+    uLong64 offset;
     int res = unzlocal_CheckCurrentFileCoherencyHeader(uf,&iSizeVar,&offset,&extralen);
     if (res!=UNZ_OK) return ZR_CORRUPT;
     if (lufseek(uf->file,offset,SEEK_SET)!=0) return ZR_READ;
@@ -3923,12 +4516,13 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
     if (whidden) ze->attr|=FILE_ATTRIBUTE_HIDDEN;
     if (!uwriteable||wreadonly) ze->attr|=FILE_ATTRIBUTE_READONLY;
     if (wsystem) ze->attr|=FILE_ATTRIBUTE_SYSTEM;
-    ze->comp_size = ufi.compressed_size;
-    ze->unc_size = ufi.uncompressed_size;
+    ze->comp_size = (long long)ufi.compressed_size;
+    ze->unc_size = (long long)ufi.uncompressed_size;
     //
     WORD dostime = (WORD)(ufi.dosDate&0xFFFF);
     WORD dosdate = (WORD)((ufi.dosDate>>16)&0xFFFF);
 
+#ifdef _MSC_VER
     FILETIME ft;
     DosDateTimeToFileTime(dosdate,dostime,&ft);
 
@@ -3950,6 +4544,9 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
 
     ft.dwHighDateTime = temp_ft.HighPart;
     ft.dwLowDateTime = temp_ft.LowPart;
+#else
+    FILETIME ft = dosdatetime2filetime(dosdate,dostime);
+#endif
 
     ze->atime=ft;
     ze->ctime=ft;
@@ -3957,33 +4554,42 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
     // the zip will always have at least that dostime. But if it also has
     // an extra header, then we'll instead get the info from that.
     unsigned int epos=0;
-    while (epos+4<extralen) {
+    while (epos+4<=extralen) {
         char etype[3];
         etype[0]=extra[epos+0];
         etype[1]=extra[epos+1];
         etype[2]=0;
-        int size = extra[epos+2];
-        if (strcmp(etype,"UT")!=0) {
+        unsigned int size = (unsigned char)extra[epos+2] | ((unsigned char)extra[epos+3]<<8);
+        if (epos+4+size>extralen) // a truncated field, don't read past the extra buffer
+            break;
+        if (strcmp(etype,"UT")!=0 || size<1) {
             epos += 4+size;
             continue;
         }
-        int flags = extra[epos+4];
+        const char *e=extra+epos+4;
+        int flags = e[0];
         bool hasmtime = (flags&1)!=0;
         bool hasatime = (flags&2)!=0;
         bool hasctime = (flags&4)!=0;
-        epos+=5;
-        if (hasmtime) {
-            time_t mtime = *(time_t*)(extra+epos);
-            epos+=4;
+        unsigned int tpos=1;
+        if (hasmtime && tpos+4<=size) {
+            int mtime32;
+            memcpy(&mtime32,e+tpos,4); // 4 bytes, whatever the size of time_t
+            time_t mtime = (time_t)mtime32;
+            tpos+=4;
             ze->mtime = timet2filetime(mtime);
         }
-        if (hasatime) {
-            time_t atime = *(time_t*)(extra+epos);
-            epos+=4;
+        if (hasatime && tpos+4<=size) {
+            int atime32;
+            memcpy(&atime32,e+tpos,4); // 4 bytes, whatever the size of time_t
+            time_t atime = (time_t)atime32;
+            tpos+=4;
             ze->atime = timet2filetime(atime);
         }
-        if (hasctime) {
-            time_t ctime = *(time_t*)(extra+epos);
+        if (hasctime && tpos+4<=size) {
+            int ctime32;
+            memcpy(&ctime32,e+tpos,4); // 4 bytes, whatever the size of time_t
+            time_t ctime = (time_t)ctime32;
             ze->ctime = timet2filetime(ctime);
         }
         break;
@@ -3995,14 +4601,58 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
     return ZR_OK;
 }
 
+// walks the central directory once, indexing every name; this also leaves
+// centralpos complete, so that GoTo reaches any item at once afterwards
+ZRESULT TUnzip::Index()
+{
+    if (nameindex)
+        return ZR_OK;
+    if (currentfile!=-1)
+        unzCloseCurrentFile(uf);
+    currentfile=-1;
+    std::shared_ptr<TUnzipIndex> idx(new TUnzipIndex);
+    int count = (int)uf->gi.number_entry;
+    idx->names.reserve(count);
+    idx->folded.reserve(count);
+    for (int i=0; i<count; i++) {
+        ZRESULT zr=GoTo(i);
+        if (zr!=ZR_OK)
+            return zr;
+        // read back the way unzLocateFile reads it, so long names match the same
+        char fn[UNZ_MAXFILENAMEINZIP+1];
+        unzGetCurrentFileInfo(uf,NULL,fn,sizeof(fn)-1,NULL,0,NULL,0);
+        fn[UNZ_MAXFILENAMEINZIP]=0;
+        idx->names.insert(std::make_pair(std::string(fn),i));
+        idx->folded.insert(std::make_pair(FoldZipName(fn),i));
+    }
+    nameindex=idx;
+    return ZR_OK;
+}
+
+// the index of the item called name, or -1
+int TUnzip::Lookup(const TCHAR *name, bool ic)
+{
+    if (name==NULL || _tcslen(name)>=UNZ_MAXFILENAMEINZIP || Index()!=ZR_OK)
+        return -1;
+    char nameA[MAX_PATH];
+#ifdef _UNICODE
+    GetAnsiFileName(name, nameA, MAX_PATH-1);
+#else
+    strcpy(nameA, name);
+#endif
+    const std::unordered_map<std::string,int> &map = (ic ? nameindex->folded : nameindex->names);
+    std::unordered_map<std::string,int>::const_iterator it = map.find(ic ? FoldZipName(nameA) : std::string(nameA));
+    return (it==map.end() ? -1 : it->second);
+}
+
 ZRESULT TUnzip::Find(const TCHAR *name, bool ic, int *index, ZIPENTRY *ze)
 {
-    int res = unzLocateFile(uf,name,ic?CASE_INSENSITIVE:CASE_SENSITIVE);
-    if (res!=UNZ_OK) {
+    int i = Lookup(name,ic);
+    if (i<0 || GoTo(i)!=ZR_OK) {
         if (index!=0)
             *index=-1;
         if (ze!=NULL) {
-            ZeroMemory(ze,sizeof(ZIPENTRY));
+            memset(ze,0,sizeof(ZIPENTRY));
             ze->index=-1;
         }
         return ZR_NOTFOUND;
@@ -4010,7 +4660,6 @@ ZRESULT TUnzip::Find(const TCHAR *name, bool ic, int *index, ZIPENTRY *ze)
     if (currentfile!=-1)
         unzCloseCurrentFile(uf);
     currentfile=-1;
-    int i = (int)uf->num_file;
     if (index!=NULL)
         *index=i;
     if (ze!=NULL) {
@@ -4074,12 +4723,9 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
             if (currentfile!=-1)
                 unzCloseCurrentFile(uf);
             currentfile=-1;
-            if (index>=(int)uf->gi.number_entry)
-                return ZR_ARGS;
-            if (index<(int)uf->num_file)
-                unzGoToFirstFile(uf);
-            while ((int)uf->num_file<index)
-                unzGoToNextFile(uf);
+            ZRESULT zr=GoTo(index);
+            if (zr!=ZR_OK)
+                return zr;
             unzOpenCurrentFile(uf);
             currentfile=index;
         }
@@ -4098,14 +4744,17 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
     if (currentfile!=-1)
         unzCloseCurrentFile(uf);
     currentfile=-1;
-    if (index >= (int)uf->gi.number_entry)
-        return ZR_ARGS;
-    if (index < (int)uf->num_file)
-        unzGoToFirstFile(uf);
-    while ((int)uf->num_file<index)
-        unzGoToNextFile(uf);
+    ZRESULT zr=GoTo(index);
+    if (zr!=ZR_OK)
+        return zr;
     ZIPENTRY ze;
     Get(index,&ze);
+#ifndef _MSC_VER
+    // the upper half of the external attributes holds the unix mode, if the zip was made on unix
+    unz_file_info ufi;
+    unzGetCurrentFileInfo(uf,&ufi,NULL,0,NULL,0,NULL,0);
+    mode_t unixmode = ((ufi.version>>8)==3) ? (mode_t)(ufi.external_fa>>16) : 0;
+#endif
 
     // zipentry=directory is handled specially
     if ((ze.attr & FILE_ATTRIBUTE_DIRECTORY) != 0) {
@@ -4127,9 +4776,15 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
     }
 
     // otherwise, we write the zipentry to a file/handle
+#ifdef _MSC_VER
     HANDLE h;
     if (flags==ZIP_HANDLE)
         h=dst;
+#else
+    int h;
+    if (flags==ZIP_HANDLE)
+        h=(int)(intptr_t)dst;
+#endif
     else {
         const TCHAR *name = (const TCHAR *)dst;
         const TCHAR *c = name;
@@ -4151,12 +4806,21 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
             else
                 EnsureDirectory(rootdir,dir);
         }
+#ifdef _MSC_VER
         h = ::CreateFile((const TCHAR*)dst, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
                          NULL, NULL);
+#else
+        h = open((const char*)dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+#endif
     }
 
+#ifdef _MSC_VER
     if (h == INVALID_HANDLE_VALUE)
         return ZR_NOFILE;
+#else
+    if (h < 0)
+        return ZR_NOFILE;
+#endif
 
     unzOpenCurrentFile(uf);
     BYTE buf[16384];
@@ -4170,14 +4834,29 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
         }
         if (res==0)
             break;
+#ifdef _MSC_VER
         DWORD writ;
         BOOL bres = WriteFile(h,buf,res,&writ,NULL);
         if (!bres) {
             haderr=true;
             break;
         }
+#else
+        int writ = 0;
+        while (writ < res) {
+            ssize_t wres = write(h,buf+writ,res-writ);
+            if (wres<0 && errno==EINTR) continue;
+            if (wres<=0) break;
+            writ += (int)wres;
+        }
+        if (writ < res) {
+            haderr=true;
+            break;
+        }
+#endif
     }
     bool settime=false;
+#ifdef _MSC_VER
     DWORD type = GetFileType(h);
     if (type==FILE_TYPE_DISK && !haderr)
         settime=true;
@@ -4185,12 +4864,90 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
         SetFileTime(h,&ze.ctime,&ze.atime,&ze.mtime);
     if (flags!=ZIP_HANDLE)
         CloseHandle(h);
-    unzCloseCurrentFile(uf);
+#else
+    struct stat st;
+    if (fstat(h,&st)==0 && S_ISREG(st.st_mode) && !haderr)
+        settime=true;
+    if (settime) {
+        struct timespec times[2];
+        times[0] = filetime2timespec(ze.atime);
+        times[1] = filetime2timespec(ze.mtime);
+        futimens(h,times);
+        if (unixmode!=0)
+            fchmod(h,unixmode&0777); // never setuid, setgid or sticky from a downloaded archive
+    }
+    if (flags!=ZIP_HANDLE)
+        close(h);
+#endif
+    const int closeres = unzCloseCurrentFile(uf);
     if (haderr)
         return ZR_WRITE;
+    if (closeres==UNZ_CRCERROR)
+        return ZR_CORRUPT;
     return ZR_OK;
 }
 
+// unzips the named items into dir, visiting them in the order they are
+// stored rather than the order they are named, so that the archive is read
+// front to back just once
+ZRESULT TUnzip::UnzipMany(const TCHAR *const *names, int count, bool ic, const TCHAR *dir, ZRESULT *results)
+{
+    if (count<0 || (count>0 && names==NULL))
+        return ZR_ARGS;
+    std::vector<std::pair<int,int> > order; // (item, position in names)
+    std::vector<ZRESULT> res(count,ZR_NOTFOUND);
+    order.reserve(count);
+    for (int n=0; n<count; n++) {
+        int i = Lookup(names[n],ic);
+        if (i>=0)
+            order.push_back(std::make_pair(i,n));
+    }
+    std::sort(order.begin(),order.end());
+
+    for (size_t k=0; k<order.size(); k++) {
+        int i = order[k].first;
+        if (k>0 && order[k-1].first==i) { // named twice, unzipped once
+            res[order[k].second]=res[order[k-1].second];
+            continue;
+        }
+        ZIPENTRY ze;
+        ZRESULT zr=Get(i,&ze);
+        if (zr==ZR_OK) {
+            TCHAR dst[MAX_PATH];
+            dst[0]=0;
+            if (dir!=NULL && dir[0]!=0) {
+                _tcsncpy(dst,dir,MAX_PATH-2);
+                dst[MAX_PATH-2]=0;
+                size_t len=_tcslen(dst);
+                if (dst[len-1]!=_T('/') && dst[len-1]!=_T('\\'))
+                    _tcscat(dst,_T("/"));
+            }
+            size_t dirlen=_tcslen(dst);
+#ifdef _UNICODE
+            GetUnicodeFileName(ze.name, dst+dirlen, MAX_PATH-1-(int)dirlen);
+            zr=Unzip(i,dst,0,ZIP_FILENAME);
+#else
+            if (dirlen+strlen(ze.name)>=MAX_PATH)
+                zr=ZR_ARGS;
+            else {
+                strcpy(dst+dirlen, ze.name);
+                zr=Unzip(i,dst,0,ZIP_FILENAME);
+            }
+#endif
+        }
+        res[order[k].second]=zr;
+    }
+
+    ZRESULT first=ZR_OK;
+    for (int n=0; n<count; n++) {
+        if (results!=NULL)
+            results[n]=res[n];
+        if (first==ZR_OK)
+            first=res[n];
+    }
+    return first;
+}
+
 ZRESULT TUnzip::Close()
 {
     if (currentfile!=-1) unzCloseCurrentFile(uf);
@@ -4202,9 +4959,581 @@ ZRESULT TUnzip::Close()
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// TStreamUnzip extracts an archive from its bytes in order, as they are being
+// downloaded: each local header is parsed as soon as it has arrived, the
+// entry behind it is stored or inflated straight into its file, and the
+// central directory, which comes last, is kept to be checked at the end.
+
+#define ZIPLOCALHEADERMAGIC   0x04034b50
+#define ZIPCENTRALHEADERMAGIC 0x02014b50
+#define ZIPENDHEADERMAGIC     0x06054b50
+#define ZIPDESCRIPTORMAGIC    0x08074b50
+#define ZIP64ENDHEADERMAGIC   0x06064b50
+#define ZIP64LOCATORMAGIC     0x07064b50
+#define SIZEZIPENDHEADER      (0x16)
+#define SIZEZIP64ENDHEADER    (0x38)
+#define SIZEZIP64LOCATOR      (0x14)
+#define SIZEZIPDESCRIPTOR     (0x0c)
+#define ZIPSTREAM_OUTBUFSIZE  (0x10000)
+
+static uLong getzipshort(const Byte *p)
+{
+    return (uLong)p[0] | ((uLong)p[1] << 8);
+}
+
+static uLong getziplong(const Byte *p)
+{
+    return getzipshort(p) | (getzipshort(p + 2) << 16);
+}
+
+static uLong64 getziplong64(const Byte *p)
+{
+    return (uLong64)getziplong(p) | ((uLong64)getziplong(p + 4) << 32);
+}
+
+typedef struct
+{ std::string name;
+  bool isdir;
+  uLong crc;
+  uLong comp_size;
+  uLong unc_size;
+  FILETIME atime,mtime;
+  uLong version;             // version made by, its high byte is the host system
+  uLong external_fa;         // only known from the central directory
+} TStreamEntry;
+
+class TStreamUnzip
+{ public:
+  TStreamUnzip();
+  ~TStreamUnzip();
+
+  ZRESULT Open(const char *dir);
+  ZRESULT Write(const Byte *data, unsigned int len);
+  ZRESULT End();
+  ZRESULT Get(int index, ZIPENTRY *ze);
+  ZRESULT Close();
+
+  private:
+  enum { SU_SIGNATURE, SU_HEADER, SU_NAME, SU_DATA, SU_DESCRIPTOR, SU_CENTRAL, SU_ENDED };
+
+  unsigned int Collect(const Byte *data, unsigned int len);
+  ZRESULT BeginEntry();
+  ZRESULT Extract(const Byte *data, unsigned int len, unsigned int *used);
+  ZRESULT Output(const Byte *buf, unsigned int len);
+  ZRESULT EndEntry();
+  ZRESULT CheckEntry(uLong ecrc, uLong ecomp, uLong eunc);
+  ZRESULT CheckCentral();
+  bool CreateParents(const std::string &path);
+  bool CloseOutput(bool settime);
+
+  std::string rootdir;
+  std::string lastdir;       // the directory of the previous entry, known to exist
+  int state;
+  ZRESULT result;            // the first failure, after which all bytes are refused
+  std::vector<Byte> head;    // bytes of a header or a data descriptor collected so far
+  unsigned int headsize;     // how many of them are wanted
+  std::vector<Byte> central; // central directory and end record
+  std::vector<TStreamEntry> entries;
+  uLong flag, method;        // of the current entry
+  uLong expcrc, expcomp, expunc;
+  uLong crc, compin, uncout; // what the current entry really has
+  bool inflating;
+  z_stream stream;
+#ifdef _MSC_VER
+  HANDLE hout;
+#else
+  int hout;
+#endif
+  Byte outbuf[ZIPSTREAM_OUTBUFSIZE];
+};
+
+TStreamUnzip::TStreamUnzip()
+    : state(SU_SIGNATURE), result(ZR_OK), headsize(4), flag(0), method(0)
+    , expcrc(0), expcomp(0), expunc(0), crc(0), compin(0), uncout(0), inflating(false)
+{
+    memset(&stream,0,sizeof(stream));
+#ifdef _MSC_VER
+    hout=INVALID_HANDLE_VALUE;
+#else
+    hout=-1;
+#endif
+}
 
+TStreamUnzip::~TStreamUnzip()
+{
+    Close();
+}
 
-ZRESULT lasterrorU=ZR_OK;
+ZRESULT TStreamUnzip::Open(const char *dir)
+{
+    if (dir==0 || dir[0]==0)
+        return ZR_ARGS;
+    rootdir=dir;
+    char last=rootdir[rootdir.size()-1];
+    if (last!='/' && last!='\\')
+        return ZR_ARGS;
+    if (!CreateParents(rootdir))
+        return ZR_NOFILE;
+    return ZR_OK;
+}
+
+// creates every directory of path up to its last slash
+bool TStreamUnzip::CreateParents(const std::string &path)
+{
+    std::string::size_type end=path.find_last_of("/\\");
+    if (end==std::string::npos || end==0)
+        return true;
+    std::string dir(path,0,end);
+    if (dir==lastdir)
+        return true;
+    std::string::size_type pos=dir.find_first_of("/\\",1);
+    for (;;) {
+        std::string sub(dir,0,pos);
+        // the parents that the previous entry needed exist already
+        bool known=(lastdir.compare(0,sub.size(),sub)==0 && (lastdir.size()==sub.size() || lastdir[sub.size()]=='/' || lastdir[sub.size()]=='\\'));
+        if (!known) {
+#ifdef _MSC_VER
+            CreateDirectoryA(sub.c_str(),NULL);
+#else
+            mkdir(sub.c_str(),0755);
+#endif
+        }
+        if (pos==std::string::npos)
+            break;
+        pos=dir.find_first_of("/\\",pos+1);
+    }
+#ifdef _MSC_VER
+    DWORD attr=GetFileAttributesA(dir.c_str());
+    if (attr==INVALID_FILE_ATTRIBUTES || (attr&FILE_ATTRIBUTE_DIRECTORY)==0)
+        return false;
+#else
+    struct stat st;
+    if (stat(dir.c_str(),&st)!=0 || !S_ISDIR(st.st_mode))
+        return false;
+#endif
+    lastdir=dir;
+    return true;
+}
+
+unsigned int TStreamUnzip::Collect(const Byte *data, unsigned int len)
+{
+    unsigned int n=headsize-(unsigned int)head.size();
+    if (n>len)
+        n=len;
+    head.insert(head.end(),data,data+n);
+    return n;
+}
+
+ZRESULT TStreamUnzip::Write(const Byte *data, unsigned int len)
+{
+    if (result!=ZR_OK)
+        return ZR_FAILED;
+    if (state==SU_ENDED)
+        return ZR_ENDED;
+    while (len>0 && result==ZR_OK) {
+        unsigned int used=0;
+        switch (state) {
+        case SU_SIGNATURE:
+            used=Collect(data,len);
+            if (head.size()<headsize)
+                break;
+            if (getziplong(&head[0])==ZIPLOCALHEADERMAGIC) {
+                headsize=SIZEZIPLOCALHEADER;
+                state=SU_HEADER;
+            }
+            else if (getziplong(&head[0])==ZIPCENTRALHEADERMAGIC || getziplong(&head[0])==ZIPENDHEADERMAGIC) {
+                central.swap(head);
+                head.clear();
+                state=SU_CENTRAL;
+            }
+            else
+                result=ZR_CORRUPT;
+            break;
+        case SU_HEADER:
+            used=Collect(data,len);
+            if (head.size()<headsize)
+                break;
+            headsize=SIZEZIPLOCALHEADER+(unsigned int)getzipshort(&head[26])+(unsigned int)getzipshort(&head[28]);
+            state=SU_NAME;
+            if (head.size()==headsize)
+                result=BeginEntry();
+            break;
+        case SU_NAME:
+            used=Collect(data,len);
+            if (head.size()==headsize)
+                result=BeginEntry();
+            break;
+        case SU_DATA:
+            result=Extract(data,len,&used);
+            break;
+        case SU_DESCRIPTOR:
+            // the descriptor signature is optional
+            used=Collect(data,len);
+            if (headsize==SIZEZIPDESCRIPTOR && head.size()>=4 && getziplong(&head[0])==ZIPDESCRIPTORMAGIC) {
+                headsize+=4;
+                used+=Collect(data+used,len-used);
+            }
+            if (head.size()==headsize) {
+                const Byte *d=&head[headsize-SIZEZIPDESCRIPTOR];
+                result=CheckEntry(getziplong(d),getziplong(d+4),getziplong(d+8));
+            }
+            break;
+        case SU_CENTRAL:
+            central.insert(central.end(),data,data+len);
+            used=len;
+            break;
+        }
+        data+=used;
+        len-=used;
+    }
+    return result;
+}
+
+ZRESULT TStreamUnzip::BeginEntry()
+{
+    const Byte *h=&head[0];
+    flag=getzipshort(h+6);
+    method=getzipshort(h+8);
+    uLong dosDate=getziplong(h+10);
+    expcrc=getziplong(h+14);
+    expcomp=getziplong(h+18);
+    expunc=getziplong(h+22);
+    unsigned int namelen=(unsigned int)getzipshort(h+26);
+    unsigned int extralen=(unsigned int)getzipshort(h+28);
+    const Byte *extra=h+SIZEZIPLOCALHEADER+namelen;
+    if (namelen==0 || namelen>=MAX_PATH)
+        return ZR_CORRUPT;
+
+    TStreamEntry entry;
+    entry.name.assign((const char*)h+SIZEZIPLOCALHEADER,namelen);
+    entry.isdir=(entry.name[namelen-1]=='/' || entry.name[namelen-1]=='\\');
+    entry.crc=0;
+    entry.comp_size=0;
+    entry.unc_size=0;
+    entry.version=0;
+    entry.external_fa=0;
+#ifdef _MSC_VER
+    FILETIME lft;
+    DosDateTimeToFileTime((WORD)((dosDate>>16)&0xFFFF),(WORD)(dosDate&0xFFFF),&lft);
+    LocalFileTimeToFileTime(&lft,&entry.mtime);
+#else
+    entry.mtime=dosdatetime2filetime((WORD)((dosDate>>16)&0xFFFF),(WORD)(dosDate&0xFFFF));
+#endif
+    entry.atime=entry.mtime;
+
+    bool zip64=(expcomp==0xFFFFFFFF || expunc==0xFFFFFFFF);
+    unsigned int epos=0;
+    while (epos+4<=extralen) {
+        uLong etype=getzipshort(extra+epos);
+        unsigned int esize=(unsigned int)getzipshort(extra+epos+2);
+        if (epos+4+esize>extralen)
+            break;
+        if (etype==0x0001)
+            zip64=true;
+        else if (etype==0x5455 && esize>=1) {
+            // "UT": flags, then the modify and access times that the flags say are present
+            const Byte *e=extra+epos+4;
+            unsigned int tpos=1;
+            if ((e[0]&1)!=0 && tpos+4<=esize) {
+                entry.mtime=timet2filetime((time_t)(int)getziplong(e+tpos));
+                entry.atime=entry.mtime;
+                tpos+=4;
+            }
+            if ((e[0]&2)!=0 && tpos+4<=esize)
+                entry.atime=timet2filetime((time_t)(int)getziplong(e+tpos));
+        }
+        epos+=4+esize;
+    }
+
+    // only the central directory could tell where such entries end
+    if (zip64 || ((flag&8)!=0 && method==0))
+        return ZR_SEEK;
+    if ((flag&1)!=0 || (method!=0 && method!=Z_DEFLATED))
+        return ZR_SEEK;
+    if (entry.name[0]=='/' || entry.name[0]=='\\' || (namelen>1 && entry.name[1]==':'))
+        return ZR_SEEK;
+    for (std::string::size_type pos=0; pos<namelen; ) {
+        std::string::size_type end=entry.name.find_first_of("/\\",pos);
+        if (end==std::string::npos)
+            end=namelen;
+        if (end-pos==2 && entry.name.compare(pos,2,"..")==0)
+            return ZR_SEEK;
+        pos=end+1;
+    }
+
+    entries.push_back(entry);
+    head.clear();
+
+    std::string path(rootdir+entry.name);
+    if (!CreateParents(path))
+        return ZR_NOFILE;
+    if (!entry.isdir) {
+#ifdef _MSC_VER
+        hout=CreateFileA(path.c_str(),GENERIC_WRITE,0,NULL,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+        if (hout==INVALID_HANDLE_VALUE)
+            return ZR_NOFILE;
+#else
+        hout=open(path.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0666);
+        if (hout<0)
+            return ZR_NOFILE;
+#endif
+    }
+
+    crc=0;
+    compin=0;
+    uncout=0;
+    if (method==Z_DEFLATED) {
+        memset(&stream,0,sizeof(stream));
+        if (inflateInit2(&stream)!=Z_OK)
+            return ZR_NOALLOC;
+        inflating=true;
+    }
+    state=SU_DATA;
+    if ((flag&8)==0 && expcomp==0)
+        return EndEntry();
+    return ZR_OK;
+}
+
+ZRESULT TStreamUnzip::Extract(const Byte *data, unsigned int len, unsigned int *used)
+{
+    // without a data descriptor the size is known, so the next header is never passed to inflate
+    bool sized=((flag&8)==0);
+    if (sized && len>expcomp-compin)
+        len=(unsigned int)(expcomp-compin);
+
+    if (method==0) {
+        ZRESULT zr=Output(data,len);
+        if (zr!=ZR_OK)
+            return zr;
+        *used=len;
+        compin+=len;
+        return (compin==expcomp ? EndEntry() : ZR_OK);
+    }
+
+    stream.next_in=(Byte*)data;
+    stream.avail_in=len;
+    int err=Z_OK;
+    for (;;) {
+        stream.next_out=outbuf;
+        stream.avail_out=ZIPSTREAM_OUTBUFSIZE;
+        err=inflate(&stream,Z_SYNC_FLUSH);
+        unsigned int produced=ZIPSTREAM_OUTBUFSIZE-stream.avail_out;
+        if (produced>0) {
+            ZRESULT zr=Output(outbuf,produced);
+            if (zr!=ZR_OK)
+                return zr;
+        }
+        if (err==Z_STREAM_END)
+            break;
+        if (err!=Z_OK && err!=Z_BUF_ERROR)
+            return ZR_FLATE;
+        if (stream.avail_out!=0)
+            break; // all the input there is has been inflated
+    }
+    *used=len-stream.avail_in;
+    compin+=*used;
+    if (err==Z_STREAM_END || (sized && compin==expcomp))
+        return EndEntry();
+    if (*used==0)
+        return ZR_FLATE;
+    return ZR_OK;
+}
+
+ZRESULT TStreamUnzip::Output(const Byte *buf, unsigned int len)
+{
+    crc=ucrc32(crc,buf,len);
+    uncout+=len;
+#ifdef _MSC_VER
+    if (hout==INVALID_HANDLE_VALUE)
+        return ZR_OK;
+    DWORD writ;
+    if (!WriteFile(hout,buf,len,&writ,NULL) || writ!=len)
+        return ZR_WRITE;
+#else
+    if (hout<0)
+        return ZR_OK;
+    unsigned int writ=0;
+    while (writ<len) {
+        ssize_t wres=write(hout,buf+writ,len-writ);
+        if (wres<0 && errno==EINTR)
+            continue;
+        if (wres<=0)
+            return ZR_WRITE;
+        writ+=(unsigned int)wres;
+    }
+#endif
+    return ZR_OK;
+}
+
+ZRESULT TStreamUnzip::EndEntry()
+{
+    if (inflating) {
+        inflateEnd(&stream);
+        inflating=false;
+    }
+    if ((flag&8)!=0) {
+        state=SU_DESCRIPTOR;
+        headsize=SIZEZIPDESCRIPTOR;
+        return ZR_OK;
+    }
+    return CheckEntry(expcrc,expcomp,expunc);
+}
+
+ZRESULT TStreamUnzip::CheckEntry(uLong ecrc, uLong ecomp, uLong eunc)
+{
+    TStreamEntry &entry=entries.back();
+    entry.crc=crc;
+    entry.comp_size=compin;
+    entry.unc_size=uncout;
+    bool match=(crc==ecrc && compin==ecomp && uncout==eunc);
+    if (!CloseOutput(match))
+        return ZR_WRITE;
+    if (!match)
+        return ZR_CORRUPT;
+    head.clear();
+    headsize=4;
+    state=SU_SIGNATURE;
+    return ZR_OK;
+}
+
+bool TStreamUnzip::CloseOutput(bool settime)
+{
+    const TStreamEntry &entry=entries.back();
+#ifdef _MSC_VER
+    if (hout==INVALID_HANDLE_VALUE)
+        return true;
+    if (settime)
+        SetFileTime(hout,NULL,&entry.atime,&entry.mtime);
+    bool ok=(CloseHandle(hout)!=FALSE);
+    hout=INVALID_HANDLE_VALUE;
+#else
+    if (hout<0)
+        return true;
+    if (settime) {
+        struct timespec times[2];
+        times[0]=filetime2timespec(entry.atime);
+        times[1]=filetime2timespec(entry.mtime);
+        futimens(hout,times);
+    }
+    bool ok=(close(hout)==0);
+    hout=-1;
+#endif
+    return ok;
+}
+
+ZRESULT TStreamUnzip::End()
+{
+    if (result!=ZR_OK)
+        return ZR_FAILED;
+    if (state==SU_ENDED)
+        return ZR_ENDED;
+    result=(state==SU_CENTRAL ? CheckCentral() : ZR_CORRUPT);
+    state=SU_ENDED;
+    return result;
+}
+
+ZRESULT TStreamUnzip::CheckCentral()
+{
+    size_t size=central.size();
+    if (size<SIZEZIPENDHEADER)
+        return ZR_CORRUPT;
+    const Byte *c=&central[0];
+
+    // the end record is last, but for a comment of its own length
+    size_t endpos=size-SIZEZIPENDHEADER;
+    while (getziplong(c+endpos)!=ZIPENDHEADERMAGIC || endpos+SIZEZIPENDHEADER+getzipshort(c+endpos+20)!=size) {
+        if (endpos==0)
+            return ZR_CORRUPT;
+        endpos--;
+    }
+    // past 65535 entries the counts live in a zip64 end record, which sits
+    // with its locator right before the classic one
+    size_t centralend=endpos;
+    if (endpos>=SIZEZIP64ENDHEADER+SIZEZIP64LOCATOR && getziplong(c+endpos-SIZEZIP64LOCATOR)==ZIP64LOCATORMAGIC) {
+        centralend=endpos-SIZEZIP64LOCATOR-SIZEZIP64ENDHEADER;
+        const Byte *z=c+centralend;
+        if (getziplong(z)!=ZIP64ENDHEADERMAGIC || getziplong64(z+32)!=entries.size() || getziplong64(z+40)!=centralend)
+            return ZR_CORRUPT;
+    }
+    else if (getzipshort(c+endpos+10)!=entries.size() || getziplong(c+endpos+12)!=endpos)
+        return ZR_CORRUPT;
+
+    size_t pos=0;
+    for (size_t i=0; i<entries.size(); i++) {
+        const Byte *h=c+pos;
+        if (pos+SIZECENTRALDIRITEM>centralend || getziplong(h)!=ZIPCENTRALHEADERMAGIC)
+            return ZR_CORRUPT;
+        size_t namelen=getzipshort(h+28);
+        size_t itemsize=SIZECENTRALDIRITEM+namelen+getzipshort(h+30)+getzipshort(h+32);
+        if (pos+itemsize>centralend)
+            return ZR_CORRUPT;
+        TStreamEntry &entry=entries[i];
+        if (entry.name.size()!=namelen || memcmp(entry.name.data(),h+SIZECENTRALDIRITEM,namelen)!=0)
+            return ZR_CORRUPT;
+        if (getziplong(h+16)!=entry.crc || getziplong(h+20)!=entry.comp_size || getziplong(h+24)!=entry.unc_size)
+            return ZR_CORRUPT;
+        entry.version=getzipshort(h+4);
+        entry.external_fa=getziplong(h+38);
+        pos+=itemsize;
+    }
+    if (pos!=centralend)
+        return ZR_CORRUPT;
+
+#ifndef _MSC_VER
+    // unix permissions are only found in the central directory, so they come last
+    for (size_t i=0; i<entries.size(); i++) {
+        const TStreamEntry &entry=entries[i];
+        mode_t unixmode=(mode_t)((entry.external_fa>>16)&0777); // never setuid, setgid or sticky from a downloaded archive
+        if (!entry.isdir && (entry.version>>8)==3 && unixmode!=0)
+            chmod((rootdir+entry.name).c_str(),unixmode);
+    }
+#endif
+    return ZR_OK;
+}
+
+ZRESULT TStreamUnzip::Get(int index, ZIPENTRY *ze)
+{
+    if (ze==0)
+        return ZR_ARGS;
+    memset(ze,0,sizeof(ZIPENTRY));
+    if (index==-1) {
+        ze->index=(int)entries.size();
+        return ZR_OK;
+    }
+    if (index<0 || index>=(int)entries.size())
+        return ZR_ARGS;
+    const TStreamEntry &entry=entries[index];
+    ze->index=index;
+    strcpy(ze->name,entry.name.c_str());
+    ze->attr=FILE_ATTRIBUTE_NORMAL;
+    if (entry.isdir)
+        ze->attr|=FILE_ATTRIBUTE_DIRECTORY;
+    ze->atime=entry.atime;
+    ze->ctime=entry.mtime;
+    ze->mtime=entry.mtime;
+    ze->comp_size=(long long)entry.comp_size;
+    ze->unc_size=(long long)entry.unc_size;
+    return ZR_OK;
+}
+
+ZRESULT TStreamUnzip::Close()
+{
+    if (inflating) {
+        inflateEnd(&stream);
+        inflating=false;
+    }
+    if (!entries.empty())
+        CloseOutput(false);
+    return ZR_OK;
+}
+
+
+
+
+
+thread_local ZRESULT lasterrorU=ZR_OK; // per thread, as clones of one zip may be unzipped at once
 
 unsigned int FormatZipMessageU(ZRESULT code, char *buf,unsigned int len)
 {
@@ -4415,6 +5744,22 @@ ZRESULT UnzipItem(HZIP hz, int index, void *dst, unsigned int len, DWORD flags)
     return lasterrorU;
 }
 
+ZRESULT UnzipItems(HZIP hz, const TCHAR *const *names, int count, bool ic, const TCHAR *dir, ZRESULT *results)
+{
+    if (hz==0) {
+        lasterrorU=ZR_ARGS;
+        return ZR_ARGS;
+    }
+    TUnzipHandleData *han = (TUnzipHandleData*)hz;
+    if (han->flag!=1) {
+        lasterrorU=ZR_ZMODE;
+        return ZR_ZMODE;
+    }
+    TUnzip *unz = han->unz;
+    lasterrorU = unz->UnzipMany(names,count,ic,dir,results);
+    return lasterrorU;
+}
+
 ZRESULT CloseZipU(HZIP hz)
 {
     if (hz==0) {
@@ -4440,5 +5785,83 @@ bool IsZipHandleU(HZIP hz)
     return (han->flag==1);
 }
 
+HZIP CloneZip(HZIP hz)
+{
+    if (hz==0) {
+        lasterrorU=ZR_ARGS;
+        return 0;
+    }
+    TUnzipHandleData *src = (TUnzipHandleData*)hz;
+    if (src->flag!=1) {
+        lasterrorU=ZR_ZMODE;
+        return 0;
+    }
+    TUnzip *unz = new TUnzip();
+    lasterrorU = unz->Clone(*src->unz);
+    if (lasterrorU!=ZR_OK) {
+        delete unz;
+        return 0;
+    }
+    TUnzipHandleData *han = new TUnzipHandleData;
+    han->flag=1;
+    han->unz=unz;
+    return (HZIP)han;
+}
+
+HZIPSTREAM OpenZipStream(const char *dir)
+{
+    TStreamUnzip *unz = new TStreamUnzip();
+    lasterrorU = unz->Open(dir);
+    if (lasterrorU!=ZR_OK) {
+        delete unz;
+        return 0;
+    }
+    return (HZIPSTREAM)unz;
+}
+
+ZRESULT WriteZipStream(HZIPSTREAM hs, const void *data, unsigned int len)
+{
+    if (hs==0 || (data==0 && len!=0)) {
+        lasterrorU=ZR_ARGS;
+        return ZR_ARGS;
+    }
+    TStreamUnzip *unz = (TStreamUnzip*)hs;
+    lasterrorU = unz->Write((const Byte*)data,len);
+    return lasterrorU;
+}
+
+ZRESULT EndZipStream(HZIPSTREAM hs)
+{
+    if (hs==0) {
+        lasterrorU=ZR_ARGS;
+        return ZR_ARGS;
+    }
+    TStreamUnzip *unz = (TStreamUnzip*)hs;
+    lasterrorU = unz->End();
+    return lasterrorU;
+}
+
+ZRESULT GetZipStreamItem(HZIPSTREAM hs, int index, ZIPENTRY *ze)
+{
+    if (hs==0) {
+        lasterrorU=ZR_ARGS;
+        return ZR_ARGS;
+    }
+    TStreamUnzip *unz = (TStreamUnzip*)hs;
+    lasterrorU = unz->Get(index,ze);
+    return lasterrorU;
+}
+
+ZRESULT CloseZipStream(HZIPSTREAM hs)
+{
+    if (hs==0) {
+        lasterrorU=ZR_ARGS;
+        return ZR_ARGS;
+    }
+    TStreamUnzip *unz = (TStreamUnzip*)hs;
+    lasterrorU = unz->Close();
+    delete unz;
+    return lasterrorU;
+}
+
 
-#endif // _MSC_VER
@@ -102,7 +102,14 @@
 #include <windows.h>
 #include <tchar.h>
 #include <time.h>
+#include <math.h>
 #include "xzip/xzip.h"
+#include "xzip/xcrc32.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #pragma warning(disable : 4996)	// disable bogus deprecation warning
 
@@ -710,11 +717,13 @@ public:
 		readfunc = 0; 
 		flush_outbuf = 0;
 		err = 0;
+		last_block = 1;
 	}
 
 	void *param;
 	int level; 
 	bool seekable;
+	int last_block;	// 0 if more deflated data follows this, as for all but the last block of a parallel deflate
 	READFUNC readfunc; 
 	FLUSHFUNC flush_outbuf;
 	TTreeState ts; 
@@ -1634,7 +1643,7 @@ void lm_init (TState &state, int pack_level, ush *flags)
 {
     register unsigned j;
 
-    Assert(state,pack_level>=1 && pack_level<=8,"bad pack level");
+    Assert(state,pack_level>=1 && pack_level<=9,"bad pack level");
 
     /* Do not slide the window if the whole input is already in memory
      * (window_size > 0)
@@ -1963,7 +1972,7 @@ ulg deflate_fast(TState &state)
          */
         if (state.ds.lookahead < MIN_LOOKAHEAD) fill_window(state);
     }
-    return FLUSH_BLOCK(state,1); /* eof */
+    return FLUSH_BLOCK(state,state.last_block); /* eof */
 }
 
 /* ===========================================================================
@@ -2072,7 +2081,7 @@ ulg deflate(TState &state)
     }
     if (match_available) ct_tally (state,0, state.ds.window[state.ds.strstart-1]);
 
-    return FLUSH_BLOCK(state,1); /* eof */
+    return FLUSH_BLOCK(state,state.last_block); /* eof */
 }
 
 
@@ -2162,73 +2171,11 @@ int putend(int n, ulg s, ulg c, extent m, char *z, WRITEFUNC wfunc, void *param)
 
 
 
-const ulg crc_table[256] = {
-  0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
-  0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
-  0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L,
-  0x90bf1d91L, 0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-  0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L, 0x136c9856L,
-  0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL, 0x14015c4fL, 0x63066cd9L,
-  0xfa0f3d63L, 0x8d080df5L, 0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L,
-  0xa2677172L, 0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-  0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L, 0x32d86ce3L,
-  0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L, 0x26d930acL, 0x51de003aL,
-  0xc8d75180L, 0xbfd06116L, 0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L,
-  0xb8bda50fL, 0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-  0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL, 0x76dc4190L,
-  0x01db7106L, 0x98d220bcL, 0xefd5102aL, 0x71b18589L, 0x06b6b51fL,
-  0x9fbfe4a5L, 0xe8b8d433L, 0x7807c9a2L, 0x0f00f934L, 0x9609a88eL,
-  0xe10e9818L, 0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-  0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL, 0x6c0695edL,
-  0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L, 0x65b0d9c6L, 0x12b7e950L,
-  0x8bbeb8eaL, 0xfcb9887cL, 0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L,
-  0xfbd44c65L, 0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-  0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL, 0x4369e96aL,
-  0x346ed9fcL, 0xad678846L, 0xda60b8d0L, 0x44042d73L, 0x33031de5L,
-  0xaa0a4c5fL, 0xdd0d7cc9L, 0x5005713cL, 0x270241aaL, 0xbe0b1010L,
-  0xc90c2086L, 0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-  0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L, 0x59b33d17L,
-  0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL, 0xedb88320L, 0x9abfb3b6L,
-  0x03b6e20cL, 0x74b1d29aL, 0xead54739L, 0x9dd277afL, 0x04db2615L,
-  0x73dc1683L, 0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-  0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L, 0xf00f9344L,
-  0x8708a3d2L, 0x1e01f268L, 0x6906c2feL, 0xf762575dL, 0x806567cbL,
-  0x196c3671L, 0x6e6b06e7L, 0xfed41b76L, 0x89d32be0L, 0x10da7a5aL,
-  0x67dd4accL, 0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-  0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L, 0xd1bb67f1L,
-  0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL, 0xd80d2bdaL, 0xaf0a1b4cL,
-  0x36034af6L, 0x41047a60L, 0xdf60efc3L, 0xa867df55L, 0x316e8eefL,
-  0x4669be79L, 0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-  0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL, 0xc5ba3bbeL,
-  0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L, 0xc2d7ffa7L, 0xb5d0cf31L,
-  0x2cd99e8bL, 0x5bdeae1dL, 0x9b64c2b0L, 0xec63f226L, 0x756aa39cL,
-  0x026d930aL, 0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-  0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L, 0x92d28e9bL,
-  0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L, 0x86d3d2d4L, 0xf1d4e242L,
-  0x68ddb3f8L, 0x1fda836eL, 0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L,
-  0x18b74777L, 0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-  0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L, 0xa00ae278L,
-  0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L, 0xa7672661L, 0xd06016f7L,
-  0x4969474dL, 0x3e6e77dbL, 0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L,
-  0x37d83bf0L, 0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-  0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L, 0xbad03605L,
-  0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L,
-  0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
-  0x2d02ef8dL
-};
-
-#define CRC32(c, b) (crc_table[((int)(c) ^ (b)) & 0xff] ^ ((c) >> 8))
-#define DO1(buf)  crc = CRC32(crc, *buf++)
-#define DO2(buf)  DO1(buf); DO1(buf)
-#define DO4(buf)  DO2(buf); DO2(buf)
-#define DO8(buf)  DO4(buf); DO4(buf)
 
+// slicing-by-8, or PCLMULQDQ / ARMv8 CRC32 where available, see XCrc32.cpp
 ulg crc32(ulg crc, const uch *buf, extent len)
 { if (buf==NULL) return 0L;
-  crc = crc ^ 0xffffffffL;
-  while (len >= 8) {DO8(buf); len -= 8;}
-  if (len) do {DO1(buf);} while (--len);
-  return crc ^ 0xffffffffL;  // (instead of ~c for 64-bit machines)
+  return xcrc32(crc, buf, len);
 }
 
 
@@ -2366,10 +2313,163 @@ ZRESULT GetFileInfo(HANDLE hf, ulg *attr, long *size, iztimes *times, ulg *times
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
+// Parallel deflate, in the manner of pigz. A large item is cut into blocks
+// of DEFLATE_BLOCK_SIZE which are deflated at the same time, each primed with
+// the WSIZE bytes in front of it so that matches can still reach back into
+// the previous block. Every block but the last ends with an empty stored
+// block: that brings the bit stream to a byte boundary without ending it,
+// so the deflated blocks are simply written one after the other. Items of
+// up to DEFLATE_SMALL_SIZE are deflated whole instead, several at a time.
+#define DEFLATE_BLOCK_SIZE (128*1024)
+#define DEFLATE_SMALL_SIZE (2*DEFLATE_BLOCK_SIZE)
+
+class TDeflateJob
+{ public:
+  TDeflateJob() : dictlen(0),level(8),last(true),att(0),flg(0),pos(0),failed(false),done(false) {}
+
+  std::vector<char> in;     // the dictionary, then the data to deflate
+  unsigned dictlen;         // how much of in only primes the window
+  int level;
+  bool last;                // whether this ends the item's deflate stream
+  ush att, flg;             // as ct_init and lm_init leave them
+  std::vector<char> out;    // the deflated data
+  unsigned pos;             // how much of in the deflater has read
+  bool failed;
+  bool done;                // set by the pool, under its lock
+  char buf[16384];
+
+  void Run();
+  static unsigned sread(TState &s,char *buf,unsigned size);
+  static unsigned sflush(void *param,const char *buf, unsigned *size);
+};
+
+unsigned TDeflateJob::sread(TState &s,char *buf,unsigned size)
+{ // static
+  TDeflateJob *job = (TDeflateJob*)s.param;
+  unsigned red = (unsigned)job->in.size()-job->pos;
+  if (red>size) red=size;
+  if (red>0) memcpy(buf,&job->in[job->pos],red);
+  job->pos += red;
+  return red;
+}
+
+unsigned TDeflateJob::sflush(void *param,const char *buf, unsigned *size)
+{ // static
+  if (*size==0) return 0;
+  TDeflateJob *job = (TDeflateJob*)param;
+  job->out.insert(job->out.end(),buf,buf+*size);
+  unsigned writ=*size; *size=0;
+  return writ;
+}
+
+void TDeflateJob::Run()
+{ TState *pstate=new TState();
+  TState &state=*pstate;
+  state.readfunc=sread; state.flush_outbuf=sflush;
+  state.param=this; state.level=level; state.seekable=false; state.err=NULL;
+  state.last_block=(last?1:0);
+  state.ts.static_dtree[0].dl.len = 0;
+  bi_init(state,buf,sizeof(buf),TRUE);
+  ct_init(state,&att);
+  lm_init(state,level,&flg);
+  if (dictlen>0)
+  { // hash the dictionary as though it had just been deflated, but emit none of it
+    unsigned end = state.ds.lookahead;
+    IPos hash_head;
+    for (unsigned s=0; s<dictlen && s+MIN_MATCH<=end; s++) INSERT_STRING(s,hash_head);
+    state.ds.strstart = dictlen;
+    state.ds.block_start = (long)dictlen;
+    state.ds.lookahead -= dictlen;
+  }
+  deflate(state);
+  if (!last)
+  { send_bits(state,(STORED_BLOCK<<1)+0,3); // empty, to end on a byte boundary
+    copy_block(state,NULL,0,1);
+  }
+  failed = (state.err!=NULL);
+  delete pstate;
+}
+
+
+// the threads that parallel deflate runs on; a job belongs to whoever
+// submits it and must be waited for before it is deleted
+class TDeflatePool
+{ public:
+  TDeflatePool(unsigned int thread_count);
+  ~TDeflatePool();
+
+  unsigned int size() const {return (unsigned int)threads.size();}
+  void Submit(TDeflateJob *job);
+  void Wait(TDeflateJob *job);
+
+  private:
+  void Work();
+
+  std::vector<std::thread> threads;
+  std::deque<TDeflateJob*> jobs;
+  std::mutex mutex;
+  std::condition_variable wake;     // a job was queued, or the pool is stopping
+  std::condition_variable finished; // a job is done
+  bool stop;
+};
+
+TDeflatePool::TDeflatePool(unsigned int thread_count) : stop(false)
+{ for (unsigned int i=0; i<thread_count; i++) threads.push_back(std::thread(&TDeflatePool::Work,this));
+}
+
+TDeflatePool::~TDeflatePool()
+{ { std::lock_guard<std::mutex> lock(mutex);
+    stop=true;
+  }
+  wake.notify_all();
+  for (size_t i=0; i<threads.size(); i++) threads[i].join();
+}
+
+void TDeflatePool::Submit(TDeflateJob *job)
+{ { std::lock_guard<std::mutex> lock(mutex);
+    job->done=false;
+    jobs.push_back(job);
+  }
+  wake.notify_one();
+}
+
+void TDeflatePool::Wait(TDeflateJob *job)
+{ std::unique_lock<std::mutex> lock(mutex);
+  while (!job->done) finished.wait(lock);
+}
+
+void TDeflatePool::Work()
+{ for (;;)
+  { TDeflateJob *job=NULL;
+    { std::unique_lock<std::mutex> lock(mutex);
+      while (!stop && jobs.empty()) wake.wait(lock);
+      if (jobs.empty()) return;
+      job=jobs.front(); jobs.pop_front();
+    }
+    job->Run();
+    { std::lock_guard<std::mutex> lock(mutex);
+      job->done=true;
+    }
+    finished.notify_all();
+  }
+}
+
+
+// a small item that is being deflated in the background, to be written
+// once all the items in front of it have been
+class TZipDeferred
+{ public:
+  TZipFileInfo zfi;
+  char xloc[EB_L_UT_SIZE], xcen[EB_C_UT_SIZE]; // what zfi.extra and zfi.cextra point to
+  ulg crc; long isize;
+  TDeflateJob job;
+};
+
+
 class TZip
 { public:
-  TZip() : hfout(0),hmapout(0),zfis(0),obuf(0),hfin(0),writ(0),oerr(false),hasputcen(false),ooffset(0) {}
-  ~TZip() {}
+  TZip() : hfout(0),hmapout(0),zfis(0),obuf(0),hfin(0),writ(0),oerr(false),hasputcen(false),ooffset(0),level(8),pool(0),ilevel(8),aheadpos(0) {}
+  ~TZip() {delete pool;}
 
   // These variables say about the file we're writing into
   // We can write to pipe, file-by-handle, file-by-name, memory-to-memmapfile
@@ -2385,8 +2485,12 @@ class TZip
   bool hasputcen;           // have we yet placed the central directory?
   //
   TZipFileInfo *zfis;       // each file gets added onto this list, for writing the table at the end
+  int level;                // pack level for deflate, 1..9
+  TDeflatePool *pool;       // if set, deflate runs on these threads
+  std::deque<TZipDeferred*> deferred; // small items deflating in the background, in the order they were added
 
   ZRESULT Create(void *z,unsigned int len,DWORD flags);
+  ZRESULT SetDeflate(int newlevel, unsigned int thread_count);
   static unsigned sflush(void *param,const char *buf, unsigned *size);
   static unsigned swrite(void *param,const char *buf, unsigned size);
   unsigned int write(const char *buf,unsigned int size);
@@ -2406,6 +2510,8 @@ class TZip
   ulg csize;                               // compressed size, set by the compression routines
   // and this is used by some of the compression routines
   char buf[16384];
+  int ilevel;                              // pack level for this item, 0 to store it
+  std::vector<char> ahead; size_t aheadpos; // input already read (and crc'd) by the probe, served first
 
 
   ZRESULT open_file(const TCHAR *fn);
@@ -2414,12 +2520,18 @@ class TZip
   ZRESULT open_dir();
   static unsigned sread(TState &s,char *buf,unsigned size);
   unsigned read(char *buf, unsigned size);
+  bool incompressible();
   ZRESULT iclose();
 
   ZRESULT ideflate(TZipFileInfo *zfi);
+  void read_block(TDeflateJob *job);
+  ZRESULT ideflate_blocks(TZipFileInfo *zfi);
   ZRESULT istore();
 
-  ZRESULT Add(const char *odstzn, void *src,unsigned int len, DWORD flags);
+  ZRESULT Add(const char *odstzn, void *src,unsigned int len, DWORD flags, int itemlevel);
+  ZRESULT defer(TZipFileInfo &zfi);
+  ZRESULT flush_deferred(size_t keep);
+  void remember(const TZipFileInfo &zfi);
   ZRESULT AddCentral();
 
 };
@@ -2493,6 +2605,21 @@ ZRESULT TZip::Create(void *z,unsigned int len,DWORD flags)
 }
 
 
+ZRESULT TZip::SetDeflate(int newlevel, unsigned int thread_count)
+{ if (newlevel<1 || newlevel>9) return ZR_ARGS;
+  if (hasputcen) return ZR_ENDED;
+  if (thread_count==0) thread_count=std::thread::hardware_concurrency();
+  // the items still deflating were meant to use the old settings
+  ZRESULT res=flush_deferred(0);
+  level=newlevel;
+  if (pool==0 || pool->size()!=thread_count)
+  { delete pool; pool=0;
+    if (thread_count>1) pool=new TDeflatePool(thread_count);
+  }
+  return res;
+}
+
+
 unsigned TZip::sflush(void *param,const char *buf, unsigned *size)
 { // static
   if (*size==0) return 0;
@@ -2586,6 +2713,7 @@ ZRESULT TZip::GetMemory(void **pbuf, unsigned long *plen)
 { // When the user calls GetMemory, they're presumably at the end
   // of all their adding. In any case, we have to add the central
   // directory now, otherwise the memory we tell them won't be complete.
+  flush_deferred(0);
   if (!hasputcen) AddCentral(); hasputcen=true;
   if (pbuf!=NULL) *pbuf=(void*)obuf;
   if (plen!=NULL) *plen=writ;
@@ -2596,7 +2724,9 @@ ZRESULT TZip::GetMemory(void **pbuf, unsigned long *plen)
 ZRESULT TZip::Close()
 { // if the directory hadn't already been added through a call to GetMemory,
   // then we do it now
-  ZRESULT res=ZR_OK; if (!hasputcen) res=AddCentral(); hasputcen=true;
+  ZRESULT res=flush_deferred(0);
+  if (!hasputcen) {ZRESULT cres=AddCentral(); if (res==ZR_OK) res=cres;} hasputcen=true;
+  delete pool; pool=0;
   if (obuf!=0 && hmapout!=0) UnmapViewOfFile(obuf); obuf=0;
   if (hmapout!=0) CloseHandle(hmapout); hmapout=0;
   if (hfout!=0) CloseHandle(hfout); hfout=0;
@@ -2607,7 +2737,7 @@ ZRESULT TZip::Close()
 
 
 ZRESULT TZip::open_file(const TCHAR *fn)
-{ hfin=0; bufin=0; selfclosehf=false; crc=CRCVAL_INITIAL; isize=0; csize=0; ired=0;
+{ ahead.clear(); aheadpos=0; hfin=0; bufin=0; selfclosehf=false; crc=CRCVAL_INITIAL; isize=0; csize=0; ired=0;
   if (fn==0) return ZR_ARGS;
   HANDLE hf = CreateFile(fn,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,0,NULL);
   if (hf==INVALID_HANDLE_VALUE) return ZR_NOFILE;
@@ -2617,7 +2747,7 @@ ZRESULT TZip::open_file(const TCHAR *fn)
   return ZR_OK;
 }
 ZRESULT TZip::open_handle(HANDLE hf,unsigned int len)
-{ hfin=0; bufin=0; selfclosehf=false; crc=CRCVAL_INITIAL; isize=0; csize=0; ired=0;
+{ ahead.clear(); aheadpos=0; hfin=0; bufin=0; selfclosehf=false; crc=CRCVAL_INITIAL; isize=0; csize=0; ired=0;
   if (hf==0 || hf==INVALID_HANDLE_VALUE) return ZR_ARGS;
   DWORD type = GetFileType(hf);
   if (type==FILE_TYPE_DISK)
@@ -2644,7 +2774,7 @@ ZRESULT TZip::open_handle(HANDLE hf,unsigned int len)
   }
 }
 ZRESULT TZip::open_mem(void *src,unsigned int len)
-{ hfin=0; bufin=(const char*)src; selfclosehf=false; crc=CRCVAL_INITIAL; ired=0; csize=0; ired=0;
+{ ahead.clear(); aheadpos=0; hfin=0; bufin=(const char*)src; selfclosehf=false; crc=CRCVAL_INITIAL; ired=0; csize=0; ired=0;
   lenin=len; posin=0;
   if (src==0 || len==0) return ZR_ARGS;
   attr= 0x80000000; // just a normal file
@@ -2660,7 +2790,7 @@ ZRESULT TZip::open_mem(void *src,unsigned int len)
   return ZR_OK;
 }
 ZRESULT TZip::open_dir()
-{ hfin=0; bufin=0; selfclosehf=false; crc=CRCVAL_INITIAL; isize=0; csize=0; ired=0;
+{ ahead.clear(); aheadpos=0; hfin=0; bufin=0; selfclosehf=false; crc=CRCVAL_INITIAL; isize=0; csize=0; ired=0;
   attr= 0x41C00010; // a readable writable directory, and again directory
   isize = 0;
   iseekable=false;
@@ -2681,7 +2811,14 @@ unsigned TZip::sread(TState &s,char *buf,unsigned size)
 }
 
 unsigned TZip::read(char *buf, unsigned size)
-{ if (bufin!=0)
+{ if (aheadpos<ahead.size())
+  { size_t red = ahead.size()-aheadpos;
+    if (red>size) red=size;
+    memcpy(buf, &ahead[aheadpos], red);
+    aheadpos += red;
+    return (unsigned)red;
+  }
+  if (bufin!=0)
   { if (posin>=lenin) return 0; // end of input
     ulg red = lenin-posin;
     if (red>size) red=size;
@@ -2702,6 +2839,44 @@ unsigned TZip::read(char *buf, unsigned size)
   else {oerr=ZR_NOTINITED; return 0;}
 }
 
+// Looks at the start of the item (PROBE_SIZE bytes) and says whether it is
+// already compressed: images, installers, nested zips and the like have an
+// order-0 entropy of nearly 8 bits a byte, and deflate only burns time on
+// them to make them slightly larger. Input from a handle is read ahead into
+// 'ahead', which read() hands out again before reading any further.
+#define PROBE_SIZE (64*1024)
+#define PROBE_MIN  (16*1024)   // below this the estimate is biased too low to trust
+#define PROBE_BITS 7.95        // bits a byte at or above which the item is stored
+
+bool TZip::incompressible()
+{ const unsigned char *p; size_t n;
+  if (bufin!=0)
+  { p=(const unsigned char*)bufin+posin; n=lenin-posin;
+    if (n>PROBE_SIZE) n=PROBE_SIZE;
+  }
+  else
+  { std::vector<char> first(PROBE_SIZE);
+    size_t have=0;
+    while (have<first.size())
+    { unsigned int red=read(&first[have],(unsigned int)(first.size()-have));
+      if (red==0 || red==(unsigned int)EOF) break;
+      have+=red;
+    }
+    first.resize(have);
+    ahead.swap(first); aheadpos=0;
+    if (have==0) return false;
+    p=(const unsigned char*)&ahead[0]; n=have;
+  }
+  if (n<PROBE_MIN) return false;
+  unsigned int counts[256]; memset(counts,0,sizeof(counts));
+  for (size_t i=0; i<n; i++) counts[p[i]]++;
+  // H = log2(n) - sum(c*log2(c))/n
+  double sum=0;
+  for (int i=0; i<256; i++) if (counts[i]>1) sum += counts[i]*log((double)counts[i]);
+  double bits = (log((double)n) - sum/n) / log(2.0);
+  return bits>=PROBE_BITS;
+}
+
 ZRESULT TZip::iclose()
 { if (selfclosehf && hfin!=0) CloseHandle(hfin); hfin=0;
   bool mismatch = (isize!=-1 && isize!=ired);
@@ -2740,7 +2915,7 @@ ZRESULT TZip::ideflate(TZipFileInfo *zfi)
 	ZRESULT zr = ZR_OK;
 	TState* state=new TState();
 	(*state).readfunc=sread; (*state).flush_outbuf=sflush;
-	(*state).param=this; (*state).level=8; (*state).seekable=iseekable; (*state).err=NULL;
+	(*state).param=this; (*state).level=ilevel; (*state).seekable=iseekable; (*state).err=NULL;
 	// the following line will make ct_init realise it has to perform the init
 	(*state).ts.static_dtree[0].dl.len = 0;
 	// It would be nicer if I could figure out precisely which data had to
@@ -2760,6 +2935,54 @@ ZRESULT TZip::ideflate(TZipFileInfo *zfi)
 	return zr;
 }
 
+// reads the job's block, after its dictionary
+void TZip::read_block(TDeflateJob *job)
+{ size_t have=job->in.size();
+  job->in.resize(have+DEFLATE_BLOCK_SIZE);
+  while (have<job->in.size())
+  { unsigned int red=read(&job->in[have],(unsigned int)(job->in.size()-have));
+    if (red==0 || red==(unsigned int)EOF) break;
+    have+=red;
+  }
+  job->in.resize(have);
+}
+
+// deflates the item a block at a time on the pool, see DEFLATE_BLOCK_SIZE
+ZRESULT TZip::ideflate_blocks(TZipFileInfo *zfi)
+{ ZRESULT zr=ZR_OK;
+  std::deque<TDeflateJob*> inflight;
+  csize=0;
+  TDeflateJob *job=new TDeflateJob();
+  read_block(job);
+  for (;;)
+  { // a block is only known to be the last once the next one comes up empty
+    TDeflateJob *next=NULL;
+    if (job->in.size()==job->dictlen+DEFLATE_BLOCK_SIZE)
+    { next=new TDeflateJob();
+      next->dictlen=WSIZE;
+      next->in.assign(job->in.end()-WSIZE,job->in.end());
+      read_block(next);
+      if (next->in.size()==next->dictlen) {delete next; next=NULL;}
+    }
+    job->level=ilevel; job->att=zfi->att; job->last=(next==NULL);
+    pool->Submit(job);
+    inflight.push_back(job);
+    // write what is done, in order, keeping the memory held by blocks in flight bounded
+    while (inflight.size()>(next==NULL ? 0 : 2*pool->size()))
+    { TDeflateJob *done=inflight.front(); inflight.pop_front();
+      pool->Wait(done);
+      if (zr==ZR_OK && done->failed) zr=ZR_FLATE;
+      if (zr==ZR_OK && !done->out.empty() && write(&done->out[0],(unsigned int)done->out.size())!=done->out.size()) zr=ZR_WRITE;
+      csize+=(ulg)done->out.size();
+      zfi->flg|=done->flg;
+      delete done;
+    }
+    if (next==NULL) break;
+    job=next;
+  }
+  return zr;
+}
+
 ZRESULT TZip::istore()
 { ulg size=0;
   for (;;)
@@ -2774,7 +2997,7 @@ ZRESULT TZip::istore()
 
 
 
-ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags)
+ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags, int itemlevel)
 { 
 	if (oerr) 
 		return ZR_FAILED;
@@ -2794,8 +3017,9 @@ ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags)
 	}
 	bool isdir = (flags==ZIP_FOLDER);
 	bool needs_trailing_slash = (isdir && dstzn[strlen(dstzn)-1]!='/');
+	ilevel = (itemlevel<0 ? level : itemlevel);
 	int method=DEFLATE; 
-	if (isdir || HasZipSuffix(dstzn)) 
+	if (isdir || ilevel==0 || HasZipSuffix(dstzn)) 
 		method=STORE;
 
 	// now open whatever was our input source:
@@ -2811,6 +3035,22 @@ ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags)
 	else return ZR_ARGS;
 	if (openres!=ZR_OK) 
 		return openres;
+	// a stored item's size goes in its local header, so it has to be known up front
+	if (method==DEFLATE && isize>=0 && incompressible())
+		method=STORE;
+
+	// with a pool, small items are deflated several at a time and written later;
+	// anything else is written now, after the items that are still deflating
+	bool deferring = (pool!=0 && !isdir && method==DEFLATE && iseekable && isize>=0 && isize<=DEFLATE_SMALL_SIZE);
+	if (!deferring)
+	{
+		ZRESULT flushres = flush_deferred(0);
+		if (flushres!=ZR_OK)
+		{
+			iclose();
+			return flushres;
+		}
+	}
 
 	// A zip "entry" consists of a local header (which includes the file name),
 	// then the compressed data, and possibly an extended local header.
@@ -2872,6 +3112,9 @@ ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags)
 	memcpy(zfi.cextra,zfi.extra,EB_C_UT_SIZE);
 	zfi.cextra[EB_LEN] = EB_UT_LEN(1);
 
+	if (deferring)
+		return defer(zfi);
+
 
 	// (1) Start by writing the local header:
 	int r = putlocal(&zfi,swrite,this);
@@ -2889,7 +3132,9 @@ ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags)
 
 	//(2) Write deflated/stored file to zip file
 	ZRESULT writeres=ZR_OK;
-	if (!isdir && method==DEFLATE) 
+	if (!isdir && method==DEFLATE && pool!=0)
+		writeres=ideflate_blocks(&zfi);
+	else if (!isdir && method==DEFLATE) 
 		writeres=ideflate(&zfi);
 	else if (!isdir && method==STORE) 
 		writeres=istore();
@@ -2936,23 +3181,81 @@ ZRESULT TZip::Add(const char *odstzn, void *src,unsigned int len, DWORD flags)
 	if (oerr!=ZR_OK) 
 		return oerr;
 
-	// Keep a copy of the zipfileinfo, for our end-of-zip directory
-	char *cextra = new char[zfi.cext]; 
-	memcpy(cextra,zfi.cextra,zfi.cext); zfi.cextra=cextra;
-	TZipFileInfo *pzfi = new TZipFileInfo; 
-	memcpy(pzfi,&zfi,sizeof(zfi));
-	if (zfis==NULL) 
-		zfis=pzfi;
-	else 
-	{
-		TZipFileInfo *z=zfis; 
-		while (z->nxt!=NULL) 
-			z=z->nxt; 
-		z->nxt=pzfi;
-	}
+	remember(zfi);
 	return ZR_OK;
 }
 
+// reads a small item and starts deflating it on the pool; it is written by
+// flush_deferred, after the items added before it
+ZRESULT TZip::defer(TZipFileInfo &zfi)
+{ TZipDeferred *item=new TZipDeferred();
+  item->job.in.resize(isize);
+  long red=0;
+  while (red<isize)
+  { unsigned int cin=read(&item->job.in[red],(unsigned int)(isize-red));
+    if (cin==0 || cin==(unsigned int)EOF) break;
+    red+=cin;
+  }
+  ZRESULT res=iclose(); // which checks that all isize bytes came
+  if (res!=ZR_OK) {delete item; return res;}
+  item->zfi=zfi;
+  memcpy(item->xloc,zfi.extra,EB_L_UT_SIZE); item->zfi.extra=item->xloc;
+  memcpy(item->xcen,zfi.cextra,EB_C_UT_SIZE); item->zfi.cextra=item->xcen;
+  item->crc=crc; item->isize=isize;
+  item->job.level=ilevel; item->job.att=zfi.att;
+  pool->Submit(&item->job);
+  deferred.push_back(item);
+  return flush_deferred(2*pool->size());
+}
+
+// writes deferred items, in order, until no more than keep are left;
+// returns the first error, although every item it gets to is written or dropped
+ZRESULT TZip::flush_deferred(size_t keep)
+{ ZRESULT res=ZR_OK;
+  while (deferred.size()>keep)
+  { TZipDeferred *item=deferred.front(); deferred.pop_front();
+    pool->Wait(&item->job);
+    TZipFileInfo &zfi=item->zfi;
+    ZRESULT zr=(item->job.failed ? ZR_WRITE : oerr);
+    if (zr==ZR_OK)
+    { // everything is known by now, so the local header is right first time
+      zfi.crc=item->crc;
+      zfi.siz=(ulg)item->job.out.size();
+      zfi.len=(ulg)item->isize;
+      zfi.att=item->job.att;
+      zfi.flg=(ush)((zfi.flg|item->job.flg)&~8);
+      zfi.lflg=zfi.flg;
+      zfi.off=writ+ooffset;
+      if (putlocal(&zfi,swrite,this)!=ZE_OK) zr=ZR_WRITE;
+      writ += 4 + LOCHEAD + (unsigned int)zfi.nam + (unsigned int)zfi.ext;
+      if (zr==ZR_OK && zfi.siz>0 && write(&item->job.out[0],(unsigned int)zfi.siz)!=zfi.siz) zr=ZR_WRITE;
+      writ += zfi.siz;
+      if (zr==ZR_OK) zr=oerr;
+      if (zr==ZR_OK) remember(zfi);
+    }
+    if (res==ZR_OK) res=zr;
+    delete item;
+  }
+  return res;
+}
+
+// keeps a copy of the zipfileinfo, for our end-of-zip directory
+void TZip::remember(const TZipFileInfo &zfi)
+{ TZipFileInfo *pzfi = new TZipFileInfo;
+  memcpy(pzfi,&zfi,sizeof(zfi));
+  pzfi->cextra = new char[zfi.cext];
+  memcpy(pzfi->cextra,zfi.cextra,zfi.cext);
+  pzfi->extra = NULL;
+  pzfi->nxt = NULL;
+  if (zfis==NULL)
+    zfis=pzfi;
+  else
+  { TZipFileInfo *z=zfis;
+    while (z->nxt!=NULL) z=z->nxt;
+    z->nxt=pzfi;
+  }
+}
+
 ZRESULT TZip::AddCentral()
 { // write central directory
   int numentries = 0;
@@ -3048,8 +3351,12 @@ HZIP CreateZipZ(void *z,unsigned int len,DWORD flags)
 }
 
 ZRESULT ZipAdd(HZIP hz, const TCHAR *dstzn, void *src, unsigned int len, DWORD flags)
+{ return ZipAddLevel(hz, dstzn, src, len, flags, ZIP_LEVEL_DEFAULT);
+}
+
+ZRESULT ZipAddLevel(HZIP hz, const TCHAR *dstzn, void *src, unsigned int len, DWORD flags, int level)
 { 
-	if (hz == 0) 
+	if (hz == 0 || level < ZIP_LEVEL_DEFAULT || level > 9) 
 	{
 		lasterrorZ = ZR_ARGS;
 		return ZR_ARGS;
@@ -3083,18 +3390,27 @@ ZRESULT ZipAdd(HZIP hz, const TCHAR *dstzn, void *src, unsigned int len, DWORD f
 #endif
 
 	if (flags == ZIP_FILENAME) {
-		lasterrorZ = zip->Add(szDest, src, len, flags);
+		lasterrorZ = zip->Add(szDest, src, len, flags, level);
 	} else {
 		if (flags == ZIP_FOLDER) {
-			lasterrorZ = zip->Add(szDest, src, len, flags);
+			lasterrorZ = zip->Add(szDest, src, len, flags, level);
 		} else {
-			lasterrorZ = zip->Add((char *)dstzn, src, len, flags);
+			lasterrorZ = zip->Add((char *)dstzn, src, len, flags, level);
 		}
 	}
 
 	return lasterrorZ;
 }
 
+ZRESULT ZipSetDeflate(HZIP hz, int level, unsigned int thread_count)
+{ if (hz==0) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  TZipHandleData *han = (TZipHandleData*)hz;
+  if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
+  TZip *zip = han->zip;
+  lasterrorZ = zip->SetDeflate(level,thread_count);
+  return lasterrorZ;
+}
+
 ZRESULT ZipGetMemory(HZIP hz, void **buf, unsigned long *len)
 { if (hz==0) {if (buf!=0) *buf=0; if (len!=0) *len=0; lasterrorZ=ZR_ARGS;return ZR_ARGS;}
   TZipHandleData *han = (TZipHandleData*)hz;
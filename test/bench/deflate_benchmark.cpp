@@ -0,0 +1,110 @@
+/*
+ * deflate benchmark of xzip
+ *
+ * zips the given files into a memory zip once per thread count and reports
+ * time, throughput and the size of the zip, so the parallel deflate of
+ * ZipSetDeflate can be compared with deflating on the calling thread
+ *
+ * build (windows, xzip is windows only):
+ *   cl /EHsc /O2 /I..\..\inc deflate_benchmark.cpp ..\..\src\xzip\xzip.cpp ..\..\src\xzip\xcrc32.cpp
+ *
+ * run:
+ *   deflate_benchmark.exe <level> <thread count> [thread count ...] -- <file> [file ...]
+ *   e.g. deflate_benchmark.exe 8 1 4 0 -- big.dll small1.txt small2.txt
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif // _MSC_VER
+#include "xzip/xzip.h"
+
+static bool load_file(const char * filename, std::vector<char> & content)
+{
+    FILE * file = fopen(filename, "rb");
+    if (nullptr == file)
+    {
+        return false;
+    }
+    char buffer[65536];
+    size_t size = 0;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.insert(content.end(), buffer, buffer + size);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 5)
+    {
+        printf("usage: %s <level> <thread count> [thread count ...] -- <file> [file ...]\n", argv[0]);
+        return 1;
+    }
+
+    const int level = atoi(argv[1]);
+    std::vector<unsigned int> thread_counts;
+    int index = 2;
+    for (; index < argc && 0 != strcmp(argv[index], "--"); ++index)
+    {
+        thread_counts.push_back(static_cast<unsigned int>(atoi(argv[index])));
+    }
+
+    /* the files are read up front, so only deflate is timed */
+    std::vector<std::string> names;
+    std::vector<std::vector<char> > contents;
+    size_t total_size = 0;
+    for (++index; index < argc; ++index)
+    {
+        std::vector<char> content;
+        if (!load_file(argv[index], content) || content.empty())
+        {
+            printf("skip %s (missing or empty)\n", argv[index]);
+            continue;
+        }
+        names.push_back(argv[index]);
+        total_size += content.size();
+        contents.push_back(content);
+    }
+
+    printf("%u files, %u bytes, level %d\n", static_cast<unsigned int>(names.size()), static_cast<unsigned int>(total_size), level);
+
+    for (size_t count_index = 0; count_index < thread_counts.size(); ++count_index)
+    {
+        const std::chrono::steady_clock::time_point begin_time = std::chrono::steady_clock::now();
+        HZIP hzip = CreateZip(0, static_cast<unsigned int>(total_size / 2 + 65536), ZIP_MEMORY);
+        if (0 == hzip || ZR_OK != ZipSetDeflate(hzip, level, thread_counts[count_index]))
+        {
+            printf("create zip failed\n");
+            return 2;
+        }
+        for (size_t file_index = 0; file_index < names.size(); ++file_index)
+        {
+            if (ZR_OK != ZipAdd(hzip, names[file_index].c_str(), &contents[file_index][0], static_cast<unsigned int>(contents[file_index].size()), ZIP_MEMORY))
+            {
+                printf("add %s failed\n", names[file_index].c_str());
+                return 3;
+            }
+        }
+        void * zip_data = nullptr;
+        unsigned long zip_size = 0;
+        if (ZR_OK != ZipGetMemory(hzip, &zip_data, &zip_size))
+        {
+            printf("get memory failed\n");
+            return 4;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_time).count();
+        CloseZip(hzip);
+        printf("threads %2u: %8.1f ms, %7.1f MB/s, zip %lu bytes (%.3f)\n", thread_counts[count_index], seconds * 1000.0, (seconds > 0.0 ? total_size / seconds / (1024.0 * 1024.0) : 0.0), zip_size, static_cast<double>(zip_size) / total_size);
+    }
+
+    return 0;
+}
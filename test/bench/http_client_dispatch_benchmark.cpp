@@ -0,0 +1,160 @@
+/*
+ * dispatch benchmark of http client
+ *
+ * measures how long a posted request waits before a downloader picks it up
+ * (queue_latency of get_metrics, from post_download_request until a worker
+ * takes the request, so neither the transfer nor on_response is counted),
+ * and how much cpu an idle client burns while its downloaders wait for requests
+ *
+ * build (linux):
+ *   g++ -std=c++11 -O2 -I../../inc http_client_dispatch_benchmark.cpp \
+ *       -L../../lib/linux/x64 -lhttp_client -lstupid_base -lcurl -lpthread
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <condition_variable>
+#include "http_client.h"
+
+class BenchmarkSink : public IHttpClientSink
+{
+public:
+    BenchmarkSink()
+        : m_response_count(0)
+        , m_response_mutex()
+        , m_response_condition()
+    {
+
+    }
+
+public:
+    virtual void on_response(const http_response_callback_info_t &) override
+    {
+        {
+            std::lock_guard<std::mutex> response_guard(m_response_mutex);
+            ++m_response_count;
+        }
+        m_response_condition.notify_one();
+    }
+
+    void wait_response(size_t response_count)
+    {
+        std::unique_lock<std::mutex> response_lock(m_response_mutex);
+        while (m_response_count < response_count)
+        {
+            m_response_condition.wait(response_lock);
+        }
+    }
+
+private:
+    size_t                          m_response_count;
+    std::mutex                      m_response_mutex;
+    std::condition_variable         m_response_condition;
+};
+
+static void benchmark_dispatch_latency(const char * engine_name, const http_client_option_t & client_option, const std::string & source_url, size_t request_count)
+{
+    BenchmarkSink benchmark_sink;
+
+    IHttpClient * http_client = create_http_client();
+    if (nullptr == http_client || !http_client->init(client_option))
+    {
+        printf("%-10s init failure\n", engine_name);
+        destroy_http_client(http_client);
+        return;
+    }
+
+    /* let the downloaders go idle before the first post */
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    for (size_t index = 0; index < request_count; ++index)
+    {
+        http_download_request_t download_request;
+        download_request.need_unzip = false;
+        download_request.response_sink = &benchmark_sink;
+        snprintf(download_request.url_request, sizeof(download_request.url_request), "%s?%u", source_url.c_str(), static_cast<unsigned int>(index));
+        snprintf(download_request.save_pathname, sizeof(download_request.save_pathname), "./http_client_benchmark.out");
+
+        http_client->post_download_request(download_request);
+        benchmark_sink.wait_response(index + 1);
+
+        /* idle gap, so every post hits a sleeping downloader */
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    http_client_metrics_t metrics;
+    http_client->get_metrics(metrics);
+    const http_latency_stats_t & queue_latency = metrics.queue_latency;
+    printf("%-10s enqueue->dispatch us of %u requests: min %6u  p50 %6u  p99 %6u  max %6u\n", engine_name, static_cast<unsigned int>(queue_latency.count), static_cast<unsigned int>(queue_latency.min_time), static_cast<unsigned int>(queue_latency.p50_time), static_cast<unsigned int>(queue_latency.p99_time), static_cast<unsigned int>(queue_latency.max_time));
+
+    http_client->exit();
+    destroy_http_client(http_client);
+}
+
+static void benchmark_idle_cpu(const char * engine_name, const http_client_option_t & client_option, size_t idle_seconds)
+{
+    IHttpClient * http_client = create_http_client();
+    if (nullptr == http_client || !http_client->init(client_option))
+    {
+        printf("%-10s init failure\n", engine_name);
+        destroy_http_client(http_client);
+        return;
+    }
+
+    const std::clock_t cpu_begin = std::clock();
+    std::this_thread::sleep_for(std::chrono::seconds(idle_seconds));
+    const std::clock_t cpu_end = std::clock();
+
+    printf("%-10s idle cpu over %u s with %u threads: %.3f ms\n", engine_name, static_cast<unsigned int>(idle_seconds), static_cast<unsigned int>(client_option.max_downloader_count), 1000.0 * (cpu_end - cpu_begin) / CLOCKS_PER_SEC);
+
+    http_client->exit();
+    destroy_http_client(http_client);
+}
+
+int main(int, char * [])
+{
+    const char * source_pathname = "./http_client_benchmark.src";
+    FILE * source_file = fopen(source_pathname, "wb");
+    if (nullptr == source_file)
+    {
+        printf("create %s failure\n", source_pathname);
+        return 1;
+    }
+    fwrite("benchmark", 1, 9, source_file);
+    fclose(source_file);
+
+    char current_dirname[512] = { 0 };
+    if (nullptr == realpath(".", current_dirname))
+    {
+        printf("get current directory failure\n");
+        return 2;
+    }
+    const std::string source_url = std::string("file://") + current_dirname + "/http_client_benchmark.src";
+
+    http_client_option_t blocking_option;
+    blocking_option.engine_mode = http_client_engine_t::engine_blocking_downloader;
+    blocking_option.max_downloader_count = 8;
+
+    http_client_option_t event_option;
+    event_option.engine_mode = http_client_engine_t::engine_event_driven;
+    event_option.max_downloader_count = 2;
+    event_option.max_in_flight_count = 64;
+
+    benchmark_dispatch_latency("blocking", blocking_option, source_url, 200);
+    benchmark_dispatch_latency("event", event_option, source_url, 200);
+
+    benchmark_idle_cpu("blocking", blocking_option, 3);
+    benchmark_idle_cpu("event", event_option, 3);
+
+    remove(source_pathname);
+    remove("./http_client_benchmark.out");
+
+    return 0;
+}
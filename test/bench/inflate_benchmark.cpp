@@ -0,0 +1,146 @@
+/*
+ * inflate benchmark of xunzip
+ *
+ * inflates every entry of one or more zip archives (the corpus) into memory
+ * and reports compressed bytes, uncompressed bytes and throughput per
+ * archive; build it once with each inflate backend to compare them, e.g. a
+ * source corpus and a binary corpus can be made with
+ *   zip -r -q text.zip /usr/include
+ *   find /usr/lib -name '*.so' | zip -q bin.zip -@
+ *
+ * build (linux):
+ *   g++ -std=c++11 -O2 -I../../inc -DXUNZIP_FAST_INFLATE=0 -o inflate_old inflate_benchmark.cpp ../../src/xzip/xunzip.cpp ../../src/xzip/xcrc32.cpp
+ *   g++ -std=c++11 -O2 -I../../inc -DXUNZIP_FAST_INFLATE=1 -o inflate_new inflate_benchmark.cpp ../../src/xzip/xunzip.cpp ../../src/xzip/xcrc32.cpp
+ *
+ * run:
+ *   ./inflate_old text.zip bin.zip [rounds]
+ *   ./inflate_new text.zip bin.zip [rounds]
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif // _MSC_VER
+#include "xzip/xunzip.h"
+
+struct inflate_result_t
+{
+    inflate_result_t()
+        : entry_count(0)
+        , failure_count(0)
+        , compressed_size(0)
+        , uncompressed_size(0)
+        , elapsed_ms(0.0)
+    {
+
+    }
+
+    size_t          entry_count;
+    size_t          failure_count;
+    unsigned long   compressed_size;
+    unsigned long   uncompressed_size;
+    double          elapsed_ms;
+};
+
+static bool inflate_archive(const std::string & zip_filename, inflate_result_t & inflate_result)
+{
+    HZIP hzip = OpenZip(const_cast<char *>(zip_filename.c_str()), 0, ZIP_FILENAME);
+    if (0 == hzip)
+    {
+        printf("open zip (%s) failed\n", zip_filename.c_str());
+        return false;
+    }
+
+    ZIPENTRY zipentry;
+    memset(&zipentry, 0x00, sizeof(zipentry));
+    GetZipItem(hzip, -1, &zipentry);
+
+    std::vector<char> buffer;
+
+    /* only the inflate (and crc) of each entry is timed, not the archive listing */
+    const int count = zipentry.index;
+    for (int index = 0; index < count; ++index)
+    {
+        if (ZR_OK != GetZipItem(hzip, index, &zipentry))
+        {
+            ++inflate_result.failure_count;
+            continue;
+        }
+        if (0 != (zipentry.attr & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            continue;
+        }
+        buffer.resize(static_cast<size_t>(zipentry.unc_size) + 1);
+        const std::chrono::steady_clock::time_point begin_time = std::chrono::steady_clock::now();
+        ZRESULT zresult = ZR_OK;
+        do
+        {
+            zresult = UnzipItem(hzip, index, &buffer[0], static_cast<unsigned int>(buffer.size()), ZIP_MEMORY);
+        } while (ZR_MORE == zresult);
+        inflate_result.elapsed_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin_time).count();
+        if (ZR_OK != zresult)
+        {
+            ++inflate_result.failure_count;
+            continue;
+        }
+        ++inflate_result.entry_count;
+        inflate_result.compressed_size += zipentry.comp_size;
+        inflate_result.uncompressed_size += zipentry.unc_size;
+    }
+
+    CloseZip(hzip);
+
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <zip file> [zip file ...] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> zip_filenames;
+    int round_count = 3;
+    for (int index = 1; index < argc; ++index)
+    {
+        if (index == argc - 1 && index > 1 && 0 != atoi(argv[index]))
+        {
+            round_count = atoi(argv[index]);
+            break;
+        }
+        zip_filenames.push_back(argv[index]);
+    }
+
+    printf("inflate backend: %s\n", (XUNZIP_FAST_INFLATE ? "fast (64-bit bit buffer)" : "classic (zlib 1.1.3)"));
+
+    for (size_t file_index = 0; file_index < zip_filenames.size(); ++file_index)
+    {
+        double best_ms = 0.0;
+        inflate_result_t best_result;
+        for (int round = 0; round < round_count; ++round)
+        {
+            inflate_result_t inflate_result;
+            if (!inflate_archive(zip_filenames[file_index], inflate_result))
+            {
+                return 2;
+            }
+            if (0 == round || inflate_result.elapsed_ms < best_ms)
+            {
+                best_ms = inflate_result.elapsed_ms;
+                best_result = inflate_result;
+            }
+        }
+        const double seconds = best_ms / 1000.0;
+        printf("%s: %u entries (%u failed), %lu -> %lu bytes, best of %d: %.1f ms, %.1f MB/s\n", zip_filenames[file_index].c_str(), static_cast<unsigned int>(best_result.entry_count), static_cast<unsigned int>(best_result.failure_count), best_result.compressed_size, best_result.uncompressed_size, round_count, best_ms, (seconds > 0.0 ? best_result.uncompressed_size / seconds / (1024.0 * 1024.0) : 0.0));
+    }
+
+    return 0;
+}
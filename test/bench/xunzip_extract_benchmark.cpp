@@ -0,0 +1,115 @@
+/*
+ * extract benchmark of xunzip
+ *
+ * extracts every entry of a zip archive into a directory, the same way
+ * http client unzips a downloaded file, and reports entries, bytes and
+ * throughput of each round; a large, many-entry archive can be made with
+ *   zip -r -q big.zip <some source tree>
+ *
+ * build (linux):
+ *   g++ -std=c++11 -O2 -I../../inc xunzip_extract_benchmark.cpp ../../src/xzip/xunzip.cpp ../../src/xzip/xcrc32.cpp
+ *
+ * run:
+ *   ./a.out big.zip /tmp/xunzip_out/ [rounds]
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif // _MSC_VER
+#include "xzip/xunzip.h"
+
+struct extract_result_t
+{
+    extract_result_t()
+        : entry_count(0)
+        , failure_count(0)
+        , compressed_size(0)
+        , uncompressed_size(0)
+        , elapsed_ms(0.0)
+    {
+
+    }
+
+    size_t          entry_count;
+    size_t          failure_count;
+    unsigned long   compressed_size;
+    unsigned long   uncompressed_size;
+    double          elapsed_ms;
+};
+
+static bool extract_archive(const std::string & zip_filename, const std::string & unzip_dirname, extract_result_t & extract_result)
+{
+    const std::chrono::steady_clock::time_point begin_time = std::chrono::steady_clock::now();
+
+    HZIP hzip = OpenZip(const_cast<char *>(zip_filename.c_str()), 0, ZIP_FILENAME);
+    if (0 == hzip)
+    {
+        printf("open zip (%s) failed\n", zip_filename.c_str());
+        return false;
+    }
+
+    ZIPENTRY zipentry;
+    memset(&zipentry, 0x00, sizeof(zipentry));
+    GetZipItem(hzip, -1, &zipentry);
+
+    const int count = zipentry.index;
+    for (int index = 0; index < count; ++index)
+    {
+        if (ZR_OK != GetZipItem(hzip, index, &zipentry))
+        {
+            ++extract_result.failure_count;
+            continue;
+        }
+        const std::string unzip_filename(unzip_dirname + zipentry.name);
+        if (ZR_OK != UnzipItem(hzip, index, const_cast<char *>(unzip_filename.c_str()), 0, ZIP_FILENAME))
+        {
+            ++extract_result.failure_count;
+            continue;
+        }
+        ++extract_result.entry_count;
+        extract_result.compressed_size += zipentry.comp_size;
+        extract_result.uncompressed_size += zipentry.unc_size;
+    }
+
+    CloseZip(hzip);
+
+    extract_result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin_time).count();
+
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3)
+    {
+        printf("usage: %s <zip file> <output directory/> [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string zip_filename(argv[1]);
+    std::string unzip_dirname(argv[2]);
+    if ('/' != unzip_dirname[unzip_dirname.size() - 1] && '\\' != unzip_dirname[unzip_dirname.size() - 1])
+    {
+        unzip_dirname += "/";
+    }
+    const int round_count = (argc > 3 ? atoi(argv[3]) : 3);
+
+    for (int round = 0; round < round_count; ++round)
+    {
+        extract_result_t extract_result;
+        if (!extract_archive(zip_filename, unzip_dirname, extract_result))
+        {
+            return 2;
+        }
+        const double seconds = extract_result.elapsed_ms / 1000.0;
+        printf("round %d: %u entries (%u failed), %lu -> %lu bytes, %.1f ms, %.1f MB/s\n", round + 1, static_cast<unsigned int>(extract_result.entry_count), static_cast<unsigned int>(extract_result.failure_count), extract_result.compressed_size, extract_result.uncompressed_size, extract_result.elapsed_ms, (seconds > 0.0 ? extract_result.uncompressed_size / seconds / (1024.0 * 1024.0) : 0.0));
+    }
+
+    return 0;
+}
@@ -47,10 +47,24 @@ struct http_response_callback_error_t
         callback_message_create_file_failure, 
         callback_message_rename_file_failure, 
         callback_message_unzip_file_failure, 
-        callback_message_download_been_stopped
+        callback_message_download_been_stopped, 
+        callback_message_verify_message_digest_failure
     };
 };
 
+struct HTTP_CLIENT_TYPE http_transfer_timing_t
+{
+    http_transfer_timing_t();
+
+    size_t              namelookup_time;           /* microseconds from the start of the transfer until the name was resolved */
+    size_t              connect_time;              /* microseconds until the tcp connection was made */
+    size_t              appconnect_time;           /* microseconds until the tls handshake was done, zero without tls */
+    size_t              starttransfer_time;        /* microseconds until the first byte of the response came */
+    size_t              total_time;                /* microseconds the whole transfer took */
+    size_t              download_speed;            /* bytes per second */
+    size_t              download_size;             /* bytes */
+};
+
 struct HTTP_CLIENT_TYPE http_response_callback_info_t
 {
     http_response_callback_info_t();
@@ -60,6 +74,7 @@ struct HTTP_CLIENT_TYPE http_response_callback_info_t
     size_t              error_code;
     char                url_request[512];
     char                save_pathname[512];
+    http_transfer_timing_t transfer_timing;        /* of the download, zero if nothing was downloaded */
 };
 
 struct HTTP_CLIENT_TYPE IHttpClientSink
@@ -68,6 +83,15 @@ struct HTTP_CLIENT_TYPE IHttpClientSink
     virtual void on_response(const http_response_callback_info_t & callback_info) = 0;
 };
 
+struct http_digest_check_t
+{
+    enum value_t
+    {
+        check_by_hash_request, /* message_digest is the digest of local file, download if hash_request answers another one */
+        check_by_local_file    /* message_digest is the digest of remote file, download if local file does not match it */
+    };
+};
+
 struct HTTP_CLIENT_TYPE http_download_request_t
 {
     http_download_request_t();
@@ -78,11 +102,153 @@ struct HTTP_CLIENT_TYPE http_download_request_t
     char                url_request[512];
     char                hash_request[512];
     char                save_pathname[512];
-    char                message_digest[64];
+    char                message_digest[128];   /* hex of md5, sha1, sha256 or xxh64, the kind is told by its length */
+    size_t              digest_check_mode;     /* http_digest_check_t::value_t */
 };
 
 typedef bool (* storage_callback_t) (const char * data, size_t data_len, void * storage);
 
+struct http_data_request_type_t
+{
+    enum value_t
+    {
+        request_get_data,     /* as get_data */
+        request_get_file_size /* as get_file_size */
+    };
+};
+
+struct HTTP_CLIENT_TYPE http_data_callback_info_t
+{
+    http_data_callback_info_t();
+
+    size_t              request_type;              /* http_data_request_type_t::value_t */
+    size_t              user_data;
+    size_t              status_code;
+    size_t              error_code;                /* http_response_callback_error_t::value_t */
+    char                url_request[512];
+    size_t              file_size;                 /* of request_get_file_size */
+    const char        * data;                      /* body of request_get_data without storage callback, valid until on_data returns */
+    size_t              data_len;
+    http_transfer_timing_t transfer_timing;
+};
+
+struct HTTP_CLIENT_TYPE IHttpDataSink
+{
+    virtual ~IHttpDataSink() = 0;
+    virtual void on_data(const http_data_callback_info_t & callback_info) = 0;
+};
+
+struct HTTP_CLIENT_TYPE http_data_request_t
+{
+    http_data_request_t();
+
+    size_t              request_type;              /* http_data_request_type_t::value_t */
+    size_t              user_data;
+    IHttpDataSink     * data_sink;
+    char                url_request[512];
+    storage_callback_t  storage_callback;          /* body of request_get_data goes here on a worker thread, or to on_data at once if it is nullptr */
+    void              * storage_buffer;
+};
+
+struct http_client_engine_t
+{
+    enum value_t
+    {
+        engine_blocking_downloader, /* every downloader thread runs one blocking transfer at a time */
+        engine_event_driven         /* every event loop thread drives many transfers with curl multi, and has a completion thread for file work and callbacks */
+    };
+};
+
+struct HTTP_CLIENT_TYPE http_client_option_t
+{
+    http_client_option_t();
+
+    size_t              engine_mode;               /* http_client_engine_t::value_t */
+    size_t              max_downloader_count;      /* downloader threads, or event loop threads if engine is event driven */
+    size_t              max_in_flight_count;       /* max concurrent transfers of all event loops, used if engine is event driven */
+    size_t              connection_idle_timeout;   /* seconds an idle keep-alive connection can be reused, zero means no reuse, used by both engines */
+    size_t              max_host_connection_count; /* max idle keep-alive connections kept per scheme, host and port, used if engine is blocking (an event loop keeps the connections of its transfers in the cache of its curl multi) */
+    bool                share_connection_cache;    /* share one connection cache by all threads (libcurl does not support it well under concurrency) */
+    size_t              max_segment_count;         /* byte ranges one large file is fetched over concurrently, one means no segmented download, used if engine is blocking */
+    size_t              min_segment_size;          /* bytes, a file is split only if every range gets at least so many */
+    char                digest_index_pathname[512]; /* file which keeps digests of verified local files over runs, empty means no index */
+    size_t              max_unzip_thread_count;    /* threads that unzip the entries of one zip together, one means they are unzipped one by one */
+};
+
+struct HTTP_CLIENT_TYPE http_client_connection_stats_t
+{
+    http_client_connection_stats_t();
+
+    size_t              transfer_count;            /* transfers which got a response */
+    size_t              new_connection_count;      /* transfers which opened a new connection */
+    size_t              reused_connection_count;   /* transfers which reused a keep-alive connection */
+    bool                tls_stats_available;       /* true if built with HTTP_CLIENT_WITH_OPENSSL, else the tls counts below are not counted */
+    size_t              tls_handshake_count;       /* tls handshakes, valid only if tls_stats_available */
+    size_t              tls_resumed_count;         /* tls handshakes which resumed a shared session, valid only if tls_stats_available */
+};
+
+struct HTTP_CLIENT_TYPE http_latency_stats_t
+{
+    http_latency_stats_t();
+
+    size_t              count;
+    size_t              min_time;                  /* microseconds, as are the rest */
+    size_t              max_time;
+    size_t              mean_time;
+    size_t              p50_time;                  /* percentiles are within 3% */
+    size_t              p90_time;
+    size_t              p99_time;
+    size_t              p999_time;
+};
+
+struct HTTP_CLIENT_TYPE http_client_metrics_t
+{
+    http_client_metrics_t();
+
+    size_t              request_count;             /* transfers which got a response, digest requests and probes included */
+    size_t              download_bytes;
+    size_t              download_speed;            /* bytes per second of the time spent receiving responses */
+    http_latency_stats_t namelookup_latency;       /* name resolution */
+    http_latency_stats_t connect_latency;          /* tcp connect, after name resolution, zero on a reused connection */
+    http_latency_stats_t tls_latency;              /* tls handshake, counted only for transfers which made one */
+    http_latency_stats_t first_byte_latency;       /* from the connection being ready until the first byte of the response */
+    http_latency_stats_t transfer_latency;         /* from the first byte until the last */
+    http_latency_stats_t total_latency;
+    size_t              posted_count;              /* requests queued by post_download_request */
+    size_t              duplicate_count;           /* requests turned away since the same url was queued or downloading */
+    size_t              queue_length;              /* requests waiting for a worker now */
+    size_t              in_flight_count;           /* requests workers have now */
+    size_t              worker_count;              /* downloader threads, or event loop threads, see get_worker_stats */
+    http_latency_stats_t queue_latency;            /* from post_download_request until a worker takes the request */
+    http_latency_stats_t dispatch_first_byte_latency; /* from a worker taking the request until the first byte of the file, digest request included */
+    http_latency_stats_t dispatch_response_latency; /* from a worker taking the request until on_response, unzip included */
+};
+
+struct HTTP_CLIENT_TYPE http_client_worker_stats_t
+{
+    http_client_worker_stats_t();
+
+    size_t              slot_count;                /* requests the worker can have at once, one if engine is blocking */
+    size_t              in_flight_count;           /* requests the worker has now */
+    size_t              completed_count;           /* requests the worker has answered */
+    size_t              busy_time;                 /* microseconds the worker had a request, busy_time / up_time is its utilization */
+    size_t              up_time;                   /* microseconds since init */
+};
+
+struct http_client_log_level_t
+{
+    enum value_t
+    {
+        log_trace,      /* 0 */
+        log_debug,      /* 1, per request successes */
+        log_info,       /* 2, init and exit, the default */
+        log_warning,    /* 3, a fallback was taken */
+        log_error,      /* 4, a request or call failed */
+        log_critical,   /* 5, the client can not work */
+        log_off         /* 6 */
+    };
+};
+
 class HTTP_CLIENT_TYPE IHttpClient
 {
 public:
@@ -90,19 +256,35 @@ public:
 
 public:
     virtual bool init(size_t max_downloader_count = 1) = 0;
+    virtual bool init(const http_client_option_t & client_option) = 0;
     virtual void exit() = 0;
 
 public:
-    virtual void post_download_request(const http_download_request_t & download_request) = 0;
+    virtual void post_download_request(const http_download_request_t & download_request) = 0; /* if the digest index says the local file is unchanged, on_response is called at once on the calling thread, so do not post while holding a lock that on_response takes */
+    virtual size_t post_download_requests(const http_download_request_t * download_requests, size_t download_request_count) = 0; /* one lock and one wakeup for all, returns how many were taken (queued, or answered at once on the calling thread as unchanged) */
     virtual void stop_download_request(const http_download_request_t & download_request) = 0;
 
 public:
     virtual bool get_file_size(const char * url_request, size_t & file_size, size_t & url_status_code, size_t & url_error_code) = 0;
     virtual bool get_data(const char * url_request, storage_callback_t storage_callback, void * storage_buffer, size_t & url_status_code, size_t & url_error_code) = 0;
+    virtual bool post_data_request(const http_data_request_t & data_request) = 0; /* returns at once and runs on the download workers ahead of queued downloads, data_sink gets on_data unless false is returned */
+
+public:
+    virtual void get_connection_stats(http_client_connection_stats_t & connection_stats) = 0;
+    virtual void get_metrics(http_client_metrics_t & metrics) = 0;
+    virtual bool get_worker_stats(size_t worker_index, http_client_worker_stats_t & worker_stats) = 0; /* false if worker_index is not below worker_count */
 };
 
 HTTP_CLIENT_CXX_API(IHttpClient *) create_http_client();
 HTTP_CLIENT_CXX_API(void) destroy_http_client(IHttpClient *);
 
+/*
+ * ./http_client.log is shared by all http clients of the process, records below log_level (http_client_log_level_t::value_t) are not even formatted,
+ * and building with HTTP_CLIENT_LOG_MIN_LEVEL=n removes the records below level n from the library altogether
+ */
+HTTP_CLIENT_CXX_API(void) set_http_client_log_level(size_t log_level);
+/* once the log would pass max_file_size bytes it is moved to http_client.log.1 (keeping max_file_count old logs) and begun again, zero max_file_size means no limit */
+HTTP_CLIENT_CXX_API(void) set_http_client_log_rotation(size_t max_file_size, size_t max_file_count);
+
 
 #endif // HTTP_CLIENT_H
@@ -186,6 +186,9 @@ void HttpClientSink::handle_message(const http_response_callback_info_t & callba
         case http_response_callback_error_t::callback_message_download_been_stopped:
             ofs << "    " << "download been stopped" << std::endl;
             break;
+        case http_response_callback_error_t::callback_message_verify_message_digest_failure:
+            ofs << "    " << "verify message digest failure" << std::endl;
+            break;
         default:
             ofs << "    " << "<unknown message>" << std::endl;
             break;
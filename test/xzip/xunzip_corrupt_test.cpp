@@ -0,0 +1,159 @@
+/*
+ * corrupted archive test of xunzip
+ *
+ * flips every bit of a small deflated zip, one at a time, and unzips each
+ * copy both from memory (OpenZip, UnzipItem) and as a stream (OpenZipStream,
+ * WriteZipStream); a broken copy must fail cleanly, e.g. a bad dynamic
+ * huffman header must not free the bit length table twice (CVE-2002-0059),
+ * so run it under a memory checker
+ *
+ * build (linux):
+ *   g++ -std=c++11 -g -fsanitize=address -I../../inc xunzip_corrupt_test.cpp ../../src/xzip/xunzip.cpp ../../src/xzip/xcrc32.cpp
+ *
+ * run:
+ *   ./a.out /tmp/xunzip_corrupt/
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif // _MSC_VER
+#include "xzip/xunzip.h"
+
+/* a.txt, 1.5 kB of text deflated with dynamic huffman trees (zip -9) */
+static const unsigned char s_sample_zip[] =
+{
+    0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x02, 0x00, 0x08, 0x00, 0x14, 0x02, 0x52, 0x5d, 0xcc, 0xd2,
+    0x3a, 0xa2, 0x8f, 0x01, 0x00, 0x00, 0x43, 0x08, 0x00, 0x00, 0x05, 0x00, 0x1c, 0x00, 0x61, 0x2e,
+    0x74, 0x78, 0x74, 0x55, 0x54, 0x09, 0x00, 0x03, 0xe7, 0x0f, 0xd4, 0x6a, 0xe7, 0x0f, 0xd4, 0x6a,
+    0x75, 0x78, 0x0b, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x8d,
+    0x55, 0x5b, 0x72, 0x84, 0x30, 0x0c, 0xfb, 0xef, 0x29, 0x72, 0x35, 0x0a, 0xa1, 0xcb, 0x94, 0xc7,
+    0x0e, 0xb0, 0xed, 0x2c, 0xa7, 0x6f, 0xd9, 0x58, 0xc1, 0x12, 0xa4, 0xd3, 0x0f, 0x08, 0x21, 0xb6,
+    0x6c, 0xcb, 0x8f, 0x6c, 0xdd, 0x3d, 0xac, 0x73, 0x8c, 0x4b, 0x88, 0xe3, 0x3a, 0x3f, 0x43, 0xd3,
+    0x7d, 0xc4, 0x65, 0x0d, 0xdd, 0xd8, 0xf6, 0xd5, 0x1a, 0xc3, 0x7b, 0x3f, 0xd5, 0x9f, 0x4b, 0x68,
+    0xa6, 0xef, 0xb1, 0x9f, 0xaa, 0x06, 0xfb, 0xed, 0x57, 0x6b, 0x8e, 0xcb, 0x63, 0x88, 0x59, 0x32,
+    0x8b, 0x34, 0xcf, 0xb1, 0x1a, 0xba, 0x5a, 0x21, 0x12, 0x7c, 0x7a, 0x03, 0xd5, 0x24, 0xd5, 0x48,
+    0x12, 0x82, 0xbe, 0xd9, 0x11, 0x1d, 0xf3, 0xd3, 0x16, 0xf1, 0xc5, 0xb6, 0xb6, 0x30, 0x9c, 0xba,
+    0x97, 0xad, 0x26, 0x16, 0x6e, 0x8f, 0xb6, 0x1d, 0xaa, 0xd1, 0x94, 0xd2, 0x3f, 0x8d, 0xde, 0x70,
+    0x21, 0x7a, 0x44, 0x9e, 0x9c, 0x49, 0x4a, 0x2c, 0x6b, 0x0b, 0xbc, 0x36, 0x1f, 0x76, 0x1a, 0x0b,
+    0x0c, 0x5f, 0x47, 0x04, 0xc5, 0x6a, 0xae, 0x6f, 0xdd, 0xd7, 0x81, 0xc7, 0xcc, 0xed, 0xb0, 0x90,
+    0x30, 0x45, 0x6c, 0xf7, 0xa3, 0xec, 0xb7, 0x81, 0x59, 0x90, 0x9c, 0x8c, 0x52, 0x8c, 0x1e, 0x08,
+    0xdf, 0x10, 0xe2, 0x4c, 0x5d, 0x67, 0x35, 0x19, 0xdb, 0x72, 0xd5, 0x01, 0x43, 0x92, 0x94, 0xe2,
+    0x52, 0x08, 0x33, 0xb0, 0x6b, 0xe3, 0x91, 0xf8, 0x64, 0xcb, 0xae, 0xc0, 0x4f, 0x61, 0xcf, 0x4e,
+    0x61, 0x3b, 0x87, 0x4c, 0xa5, 0x65, 0x3b, 0x0d, 0x99, 0x9a, 0x66, 0xf7, 0x07, 0x28, 0x9e, 0xa7,
+    0x14, 0x29, 0xb3, 0x83, 0x73, 0x2d, 0x4b, 0x00, 0x73, 0x52, 0x7c, 0xf3, 0x48, 0x6c, 0x57, 0x34,
+    0x66, 0xc2, 0x18, 0xad, 0x70, 0x78, 0x14, 0x8d, 0xc5, 0x61, 0x72, 0x54, 0x1e, 0x64, 0x8d, 0x9d,
+    0x93, 0xa2, 0x56, 0x06, 0x2c, 0x6e, 0x6e, 0x2f, 0xac, 0x10, 0xbe, 0x74, 0xd0, 0xe5, 0xd7, 0x65,
+    0x5e, 0x7a, 0x52, 0x3a, 0x8b, 0xc7, 0xd7, 0xdf, 0x7d, 0x72, 0x7e, 0x4b, 0x72, 0x88, 0x0f, 0xcd,
+    0x94, 0x0c, 0x24, 0xe8, 0x10, 0x5d, 0x17, 0x73, 0x52, 0xaa, 0x8d, 0xd8, 0xf9, 0xc7, 0x98, 0x15,
+    0xab, 0x34, 0xe2, 0x0c, 0x24, 0x39, 0x0d, 0x86, 0x1d, 0x86, 0xef, 0x59, 0xee, 0x0c, 0xfc, 0x2d,
+    0xad, 0x00, 0xa3, 0x2a, 0x70, 0x4e, 0x6a, 0x67, 0x49, 0x38, 0x4a, 0x1d, 0x65, 0xb8, 0x24, 0xab,
+    0x65, 0xca, 0xdd, 0x7a, 0x1a, 0x4c, 0x07, 0xd4, 0xab, 0x92, 0xd5, 0xd2, 0xf9, 0xc3, 0x15, 0xbc,
+    0xb0, 0x99, 0x95, 0xa9, 0xfb, 0xf4, 0xef, 0xe5, 0x48, 0x84, 0xf7, 0x3a, 0x4c, 0x94, 0x48, 0xb1,
+    0xe8, 0x33, 0x83, 0xc9, 0x56, 0xb8, 0x24, 0xf5, 0x06, 0x70, 0x57, 0x89, 0x9e, 0x71, 0xef, 0x14,
+    0x7a, 0xc2, 0xd1, 0x00, 0x13, 0xb4, 0xe3, 0xe0, 0x39, 0xc1, 0xaf, 0xb3, 0xb7, 0x1f, 0x50, 0x4b,
+    0x01, 0x02, 0x1e, 0x03, 0x14, 0x00, 0x02, 0x00, 0x08, 0x00, 0x14, 0x02, 0x52, 0x5d, 0xcc, 0xd2,
+    0x3a, 0xa2, 0x8f, 0x01, 0x00, 0x00, 0x43, 0x08, 0x00, 0x00, 0x05, 0x00, 0x18, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x00, 0x00, 0x00, 0x00, 0x61, 0x2e, 0x74, 0x78,
+    0x74, 0x55, 0x54, 0x05, 0x00, 0x03, 0xe7, 0x0f, 0xd4, 0x6a, 0x75, 0x78, 0x0b, 0x00, 0x01, 0x04,
+    0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x50, 0x4b, 0x05, 0x06, 0x00, 0x00, 0x00,
+    0x00, 0x01, 0x00, 0x01, 0x00, 0x4b, 0x00, 0x00, 0x00, 0xce, 0x01, 0x00, 0x00, 0x00, 0x00,
+};
+
+static bool unzip_from_memory(std::vector<unsigned char> & archive)
+{
+    HZIP hzip = OpenZip(&archive[0], static_cast<unsigned int>(archive.size()), ZIP_MEMORY);
+    if (0 == hzip)
+    {
+        return false;
+    }
+
+    ZIPENTRY zipentry;
+    memset(&zipentry, 0x00, sizeof(zipentry));
+    bool unzip_success = (ZR_OK == GetZipItem(hzip, 0, &zipentry));
+    if (unzip_success)
+    {
+        std::vector<char> buffer(4096);
+        ZRESULT zresult = ZR_OK;
+        do
+        {
+            zresult = UnzipItem(hzip, 0, &buffer[0], static_cast<unsigned int>(buffer.size()), ZIP_MEMORY);
+        } while (ZR_MORE == zresult);
+        unzip_success = (ZR_OK == zresult);
+    }
+
+    CloseZip(hzip);
+
+    return unzip_success;
+}
+
+static bool unzip_from_stream(const std::vector<unsigned char> & archive, const std::string & unzip_dirname)
+{
+    HZIPSTREAM hstream = OpenZipStream(unzip_dirname.c_str());
+    if (0 == hstream)
+    {
+        return false;
+    }
+
+    /* small pieces, so that inflate stops and resumes inside the block headers */
+    bool unzip_success = true;
+    for (size_t offset = 0; unzip_success && offset < archive.size(); offset += 7)
+    {
+        const size_t piece_size = (archive.size() - offset < 7 ? archive.size() - offset : 7);
+        unzip_success = (ZR_OK == WriteZipStream(hstream, &archive[offset], static_cast<unsigned int>(piece_size)));
+    }
+    if (unzip_success)
+    {
+        unzip_success = (ZR_OK == EndZipStream(hstream));
+    }
+
+    CloseZipStream(hstream);
+
+    return unzip_success;
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <output directory/>\n", argv[0]);
+        return 1;
+    }
+
+    std::string unzip_dirname(argv[1]);
+    if ('/' != unzip_dirname[unzip_dirname.size() - 1] && '\\' != unzip_dirname[unzip_dirname.size() - 1])
+    {
+        unzip_dirname += "/";
+    }
+
+    std::vector<unsigned char> archive(s_sample_zip, s_sample_zip + sizeof(s_sample_zip));
+    if (!unzip_from_memory(archive) || !unzip_from_stream(archive, unzip_dirname))
+    {
+        printf("the intact archive can not be unzipped\n");
+        return 2;
+    }
+
+    size_t memory_failure_count = 0;
+    size_t stream_failure_count = 0;
+    for (size_t bit_index = 0; bit_index < archive.size() * 8; ++bit_index)
+    {
+        archive[bit_index / 8] ^= static_cast<unsigned char>(1 << (bit_index % 8));
+        if (!unzip_from_memory(archive))
+        {
+            ++memory_failure_count;
+        }
+        if (!unzip_from_stream(archive, unzip_dirname))
+        {
+            ++stream_failure_count;
+        }
+        archive[bit_index / 8] ^= static_cast<unsigned char>(1 << (bit_index % 8));
+    }
+
+    printf("%u corrupted copies: %u failed from memory, %u failed as a stream\n", static_cast<unsigned int>(archive.size() * 8), static_cast<unsigned int>(memory_failure_count), static_cast<unsigned int>(stream_failure_count));
+
+    return 0;
+}